@@ -24,7 +24,7 @@ http_routing::~http_routing();
         bool bRet = false;
         boost::system::result <boost::url_view> const uRes = boost::urls::parse_uri(path);
         if (!uRes) {
-            this->_qlogger.error(fmt::format("Routing Error: Path is not valid {}", uRes.error().message()));
+            WHZ_LOG_ERROR(this->_qlogger, "Routing Error: Path is not valid {}", uRes.error().message());
             //LOG_ERROR("Routing Error: Path is not valid {}", uRes.error().message());
             std::cerr << "Routing Error: Path is not valid " << uRes.error().message()
                       << std::endl;
@@ -77,7 +77,7 @@ http_routing::~http_routing();
             }
             return mmpl;
         } else {
-            this->_qlogger.error(fmt::format("Routing Error: path is empty or could not be found: {}", fpath));
+            WHZ_LOG_ERROR(this->_qlogger, "Routing Error: path is empty or could not be found: {}", fpath);
             //LOG_ERROR("Routing Error: path is empty or could not be found: {}", fpath);
             std::cerr << "Routing Error: path is empty or could not be found: " << fpath << std::endl;
             return std::nullopt;
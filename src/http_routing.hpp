@@ -48,7 +48,7 @@ protected:
 private:
   std::string _basedomain;
   MMPathlist _page_pathResources;   /// Contains the page/file names and the relative filepath they reside in
-  whz::whz_qlogger _qlogger;
+  whz::whz_qlogger _qlogger{"routing"};
 };
 
 } // namespace WHZ
@@ -0,0 +1,74 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+// whz-accesslog: decodes the binary access log of whz-core (ACCESS_LOG_FORMAT "binary") into readable text.
+//
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "CLI/CLI.hpp"
+#include "fmt/format.h"
+#include "whz_access_log_format.hpp"
+
+using namespace whz;
+
+namespace {
+    // One record per line, tab separated, with the full timestamp and latency
+    void AppendTsv(std::string &buffer, const access_record &record) {
+        fmt::format_to(std::back_inserter(buffer), "{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\n", record.timestamp_ns,
+                       record.peer_string(), record.peer_port, access_method_name(record.method), record.path_view(),
+                       record.status, record.bytes_in, record.bytes_out, record.latency_ns);
+    }
+
+    bool DecodeFile(const std::string &file_path, bool tsv) {
+        std::ifstream file(file_path, std::ios::binary);
+        if (!file) {
+            std::cerr << "ERROR: Failed to open the file " << file_path << std::endl;
+            return false;
+        }
+        const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const auto &magic = access_log_binary::magic;
+        if (data.size() < magic.size() || !std::equal(magic.begin(), magic.end(), data.begin())) {
+            std::cerr << "ERROR: " << file_path << " is not a binary whz access log" << std::endl;
+            return false;
+        }
+
+        std::string out;
+        std::size_t offset = magic.size();
+        while (offset < data.size()) {
+            auto decoded = access_log_binary::decode(std::span<const char>(data).subspan(offset));
+            if (!decoded) {
+                // A record cut off at the end, e.g. the file was copied while the server wrote it
+                std::cerr << "WARNING: " << file_path << " ends with an incomplete record at byte " << offset << std::endl;
+                break;
+            }
+            tsv ? AppendTsv(out, decoded->first) : append_clf(out, decoded->first);
+            offset += decoded->second;
+            if (out.size() > 1024 * 1024) {
+                std::cout << out;
+                out.clear();
+            }
+        }
+        std::cout << out;
+        return true;
+    }
+}
+
+auto main(int argc, char **argv) -> int {
+    CLI::App app{"WorkHorz access log decoder"};
+
+    std::vector<std::string> files;
+    bool tsv = false;
+    app.add_option("files", files, "Binary access log files, rotated files in the order to print them")->required();
+    app.add_flag("--tsv", tsv, "Print tab separated fields with nanosecond timestamp and latency instead of CLF");
+    CLI11_PARSE(app, argc, argv);
+
+    bool bRet = true;
+    for (const auto &file_path : files) {
+        bRet = DecodeFile(file_path, tsv) && bRet;
+    }
+    return bRet ? 0 : 1;
+}
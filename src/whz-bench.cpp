@@ -0,0 +1,576 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+// whz-bench: HTTP/1.1 load generator for whz-core. In the default closed loop every connection keeps --pipeline
+// requests in flight and sends the next one as soon as a response arrives. With --rate it runs an open loop: the
+// requests are sent on a fixed schedule and the latency is measured from the time a request was due, so a stalled
+// server shows up in the percentiles instead of just lowering the request rate (coordinated omission).
+// Responses need a Content-Length or end with the connection, chunked responses are counted as errors.
+//
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "CLI/CLI.hpp"
+#include "fmt/format.h"
+#include "whz_bench_histogram.hpp"
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+    using boost::asio::ip::tcp;
+    using whz::latency_histogram;
+
+    struct bench_options {
+        std::string host = "127.0.0.1";
+        std::string port = "8080";
+        std::size_t connections = 64;
+        std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        std::size_t pipeline = 1;       /// Requests in flight per connection
+        double duration_s = 10;
+        double warmup_s = 1;            /// Run before measuring, fills caches and connection pools
+        double rate = 0;                /// Requests per second over all connections, 0 = closed loop
+        bool no_keep_alive = false;     /// One request per connection
+        std::string requests_file;
+        bool json = false;
+    };
+
+    /// Counters of one worker thread, only touched by its io_context
+    struct worker_stats {
+        latency_histogram latency;
+        std::uint64_t responses = 0;
+        std::array<std::uint64_t, 6> status_classes{};  /// [1] = 1xx ... [5] = 5xx, [0] anything else
+        std::uint64_t errors = 0;       /// Failed connects, reads and writes, responses that aren't HTTP
+        std::uint64_t reconnects = 0;   /// Connections the server closed after a complete response
+        std::uint64_t bytes_read = 0;
+
+        void merge(const worker_stats &other) {
+            latency.merge(other.latency);
+            responses += other.responses;
+            for (std::size_t i = 0; i < status_classes.size(); ++i) {
+                status_classes[i] += other.status_classes[i];
+            }
+            errors += other.errors;
+            reconnects += other.reconnects;
+            bytes_read += other.bytes_read;
+        }
+    };
+
+    struct run_state {
+        std::atomic<bool> recording{false};     /// False during the warmup
+        std::atomic<bool> stopping{false};
+    };
+
+    /// The requests to send, picked at random by weight
+    struct request_mix {
+        std::vector<std::string> requests;      /// Complete requests as sent
+        std::vector<std::uint64_t> cumulative;  /// Running sum of the weights
+
+        [[nodiscard]] const std::string &pick(std::uint64_t random) const {
+            const auto it = std::upper_bound(cumulative.begin(), cumulative.end(), random % cumulative.back());
+            return requests[static_cast<std::size_t>(it - cumulative.begin())];
+        }
+    };
+
+    std::string BuildRequest(const bench_options &options, std::string_view method, std::string_view path) {
+        const bool has_body = method == "POST" || method == "PUT" || method == "PATCH";
+        return fmt::format("{} {} HTTP/1.1\r\nHost: {}:{}\r\nUser-Agent: whz-bench\r\n{}{}\r\n", method, path,
+                           options.host, options.port, options.no_keep_alive ? "Connection: close\r\n" : "",
+                           has_body ? "Content-Length: 0\r\n" : "");
+    }
+
+    /**
+     * @brief Read the request mix, one request per line: METHOD PATH [WEIGHT]. Empty lines and lines starting
+     * with # are skipped, the weight defaults to 1. Without a file every request is GET /.
+     *
+     */
+    std::optional<request_mix> LoadRequestMix(const bench_options &options) {
+        request_mix mix;
+        std::uint64_t total = 0;
+        if (options.requests_file.empty()) {
+            mix.requests.push_back(BuildRequest(options, "GET", "/"));
+            mix.cumulative.push_back(1);
+            return mix;
+        }
+        std::ifstream file(options.requests_file);
+        if (!file) {
+            std::cerr << "ERROR: Failed to open the request file " << options.requests_file << std::endl;
+            return std::nullopt;
+        }
+        std::string line;
+        std::size_t line_number = 0;
+        while (std::getline(file, line)) {
+            ++line_number;
+            std::istringstream fields(line);
+            std::string method, path;
+            std::uint64_t weight = 1;
+            if (!(fields >> method) || method.starts_with('#')) {
+                continue;
+            }
+            if (!(fields >> path) || (!(fields >> weight) && !fields.eof()) || weight == 0) {
+                std::cerr << "ERROR: " << options.requests_file << ":" << line_number
+                          << ": expected METHOD PATH [WEIGHT]" << std::endl;
+                return std::nullopt;
+            }
+            total += weight;
+            mix.requests.push_back(BuildRequest(options, method, path));
+            mix.cumulative.push_back(total);
+        }
+        if (mix.requests.empty()) {
+            std::cerr << "ERROR: " << options.requests_file << " has no requests" << std::endl;
+            return std::nullopt;
+        }
+        return mix;
+    }
+
+    bool EqualsNoCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    /**
+     * @brief One client connection. Lives on one io_context, all members are only used by its thread. Requests
+     * that are unanswered when the server closes the connection after a complete response are sent again on the
+     * next connection, with their original send time.
+     *
+     */
+    class client_connection : public std::enable_shared_from_this<client_connection> {
+    public:
+        client_connection(boost::asio::io_context &io, const tcp::resolver::results_type &endpoints,
+                          const bench_options &options, const request_mix &mix, run_state &state,
+                          worker_stats &stats, std::uint64_t seed)
+                : _socket(io), _schedule_timer(io), _retry_timer(io), _endpoints(endpoints), _options(options),
+                  _mix(mix), _state(state), _stats(stats), _random(seed | 1) {}
+
+        void start() {
+            if (_options.rate > 0) {
+                _interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(
+                        static_cast<double>(_options.connections) / _options.rate));
+                // Spread the connections over one interval, so they don't all send at the same time
+                _next_due = clock_type::now() + _interval * static_cast<std::int64_t>(_random % 1000) / 1000;
+                schedule();
+            }
+            connect();
+        }
+
+    private:
+        struct sent_request {
+            clock_type::time_point due;     /// When it was sent, in the open loop when it should have been
+            const std::string *request;
+        };
+
+        std::uint64_t next_random() {
+            // xorshift64, enough to pick from the request mix
+            _random ^= _random << 13;
+            _random ^= _random >> 7;
+            _random ^= _random << 17;
+            return _random;
+        }
+
+        [[nodiscard]] std::size_t depth() const { return _options.no_keep_alive ? 1 : _options.pipeline; }
+
+        void connect() {
+            if (_state.stopping) {
+                return;
+            }
+            boost::asio::async_connect(_socket, _endpoints,
+                [self = shared_from_this()](boost::system::error_code ec, const tcp::endpoint &) {
+                    if (ec) {
+                        self->count_error();
+                        self->retry_later();
+                        return;
+                    }
+                    self->_socket.set_option(tcp::no_delay(true));
+                    self->on_connected();
+                });
+        }
+
+        void retry_later() {
+            _retry_timer.expires_after(std::chrono::milliseconds(100));
+            _retry_timer.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+                if (!ec) {
+                    self->connect();
+                }
+            });
+        }
+
+        void on_connected() {
+            _connected = true;
+            // Requests left from the previous connection go first
+            std::deque<sent_request> resend;
+            resend.swap(_in_flight);
+            for (const auto &entry : resend) {
+                send(entry.due, *entry.request);
+            }
+            fill();
+            read();
+        }
+
+        // Send as many requests as the pipeline depth allows
+        void fill() {
+            while (_connected && !_state.stopping && _in_flight.size() < depth()) {
+                if (_options.rate > 0) {
+                    if (_backlog.empty()) {
+                        break;
+                    }
+                    send(_backlog.front(), _mix.pick(next_random()));
+                    _backlog.pop_front();
+                } else {
+                    send(clock_type::now(), _mix.pick(next_random()));
+                }
+            }
+        }
+
+        void send(clock_type::time_point due, const std::string &request) {
+            _in_flight.push_back({due, &request});
+            _out += request;
+            flush();
+        }
+
+        void flush() {
+            if (_writing || _out.empty()) {
+                return;
+            }
+            _writing = true;
+            _sending.swap(_out);
+            _out.clear();
+            boost::asio::async_write(_socket, boost::asio::buffer(_sending),
+                [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+                    self->_writing = false;
+                    self->_sending.clear();
+                    if (ec == boost::asio::error::operation_aborted) {
+                        self->flush();  // The old socket was closed, _out is for the new one
+                        return;
+                    }
+                    if (ec) {
+                        self->reset(false);
+                        return;
+                    }
+                    self->flush();
+                });
+        }
+
+        // Open loop: a request is due every _interval, whether or not the previous ones were answered
+        void schedule() {
+            _schedule_timer.expires_at(_next_due);
+            _schedule_timer.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+                if (ec || self->_state.stopping) {
+                    return;
+                }
+                for (auto now = clock_type::now(); self->_next_due <= now; self->_next_due += self->_interval) {
+                    self->_backlog.push_back(self->_next_due);
+                }
+                self->fill();
+                self->schedule();
+            });
+        }
+
+        void read() {
+            _socket.async_read_some(boost::asio::buffer(_buffer),
+                [self = shared_from_this()](boost::system::error_code ec, std::size_t bytes) {
+                    if (!ec) {
+                        if (self->_state.recording) {
+                            self->_stats.bytes_read += bytes;
+                        }
+                        self->_in.append(self->_buffer.data(), bytes);
+                        if (!self->parse_responses()) {
+                            self->reset(false);
+                            return;
+                        }
+                        if (!self->_connected) {
+                            return;     // Closed by the server after the last response, reconnecting
+                        }
+                        self->fill();
+                        self->read();
+                    } else if (ec == boost::asio::error::eof) {
+                        // A response delimited by the end of the connection is complete now
+                        if (self->_body_until_close) {
+                            self->complete_response(self->_status);
+                        }
+                        self->reset(self->_in.empty() || self->_body_until_close);
+                    } else if (ec != boost::asio::error::operation_aborted) {
+                        self->reset(false);
+                    }
+                });
+        }
+
+        // Consume the complete responses in _in, false if the data isn't an HTTP response
+        bool parse_responses() {
+            while (!_body_until_close) {
+                const auto header_end = _in.find("\r\n\r\n");
+                if (header_end == std::string::npos) {
+                    return _in.size() < 64 * 1024;
+                }
+                const std::string_view header(_in.data(), header_end);
+                if (!header.starts_with("HTTP/1.") || header.size() < 12) {
+                    return false;
+                }
+                const int status = std::atoi(std::string(header.substr(9, 3)).c_str());
+
+                std::optional<std::size_t> content_length;
+                bool close = false;
+                std::size_t line_start = header.find("\r\n");
+                while (line_start != std::string_view::npos) {
+                    line_start += 2;
+                    const auto line_end = header.find("\r\n", line_start);
+                    const auto line = header.substr(line_start, line_end == std::string_view::npos
+                                                                ? std::string_view::npos : line_end - line_start);
+                    const auto colon = line.find(':');
+                    if (colon != std::string_view::npos) {
+                        const auto name = line.substr(0, colon);
+                        auto value = line.substr(colon + 1);
+                        value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+                        if (EqualsNoCase(name, "Content-Length")) {
+                            content_length = static_cast<std::size_t>(std::strtoull(std::string(value).c_str(), nullptr, 10));
+                        } else if (EqualsNoCase(name, "Transfer-Encoding")) {
+                            return false;   // Chunked isn't supported, see the top of the file
+                        } else if (EqualsNoCase(name, "Connection") && EqualsNoCase(value, "close")) {
+                            close = true;
+                        }
+                    }
+                    line_start = line_end;
+                }
+
+                const std::size_t body_start = header_end + 4;
+                const bool no_body = status < 200 || status == 204 || status == 304;
+                if (!content_length && !no_body) {
+                    // The body ends with the connection
+                    _body_until_close = true;
+                    _status = status;
+                    return true;
+                }
+                const std::size_t length = no_body ? 0 : *content_length;
+                if (_in.size() < body_start + length) {
+                    return true;
+                }
+                _in.erase(0, body_start + length);
+                complete_response(status);
+                if (close) {
+                    // Nothing more comes on this connection, the rest is sent on the next one
+                    reset(true);
+                    return true;
+                }
+            }
+            return true;
+        }
+
+        void complete_response(int status) {
+            if (_in_flight.empty()) {
+                return;
+            }
+            const auto now = clock_type::now();
+            if (_state.recording) {
+                _stats.latency.record(static_cast<std::uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(now - _in_flight.front().due).count()));
+                ++_stats.responses;
+                ++_stats.status_classes[status >= 100 && status < 600 ? static_cast<std::size_t>(status / 100) : 0];
+            }
+            _in_flight.pop_front();
+        }
+
+        void count_error(std::uint64_t n = 1) {
+            if (_state.recording) {
+                _stats.errors += n;
+            }
+        }
+
+        /// Close and connect again. clean means the server closed after a complete response, the requests still
+        /// in flight are sent again. Otherwise they're counted as errors and dropped.
+        void reset(bool clean) {
+            if (!_connected) {
+                return;
+            }
+            _connected = false;
+            boost::system::error_code ignored;
+            _socket.close(ignored);
+            _in.clear();
+            _out.clear();
+            _body_until_close = false;
+            if (clean) {
+                if (_state.recording && !_options.no_keep_alive) {
+                    ++_stats.reconnects;
+                }
+            } else {
+                count_error(std::max<std::size_t>(1, _in_flight.size()));
+                _in_flight.clear();
+            }
+            connect();
+        }
+
+        tcp::socket _socket;
+        boost::asio::steady_timer _schedule_timer;
+        boost::asio::steady_timer _retry_timer;
+        const tcp::resolver::results_type &_endpoints;
+        const bench_options &_options;
+        const request_mix &_mix;
+        run_state &_state;
+        worker_stats &_stats;
+        std::uint64_t _random;
+
+        bool _connected = false;
+        bool _writing = false;
+        bool _body_until_close = false;
+        int _status = 0;                        /// Of the response whose body ends with the connection
+        std::deque<sent_request> _in_flight;    /// Sent and not answered yet, in order
+        std::deque<clock_type::time_point> _backlog;   /// Open loop: due, but the pipeline is full
+        clock_type::time_point _next_due{};
+        clock_type::duration _interval{};
+        std::string _out;                       /// Waiting for the current write to finish
+        std::string _sending;
+        std::string _in;
+        std::array<char, 16 * 1024> _buffer{};
+    };
+
+    std::string FormatNs(double ns) {
+        if (ns < 1'000) {
+            return fmt::format("{:.0f} ns", ns);
+        }
+        if (ns < 1'000'000) {
+            return fmt::format("{:.1f} µs", ns / 1'000);
+        }
+        if (ns < 1'000'000'000) {
+            return fmt::format("{:.2f} ms", ns / 1'000'000);
+        }
+        return fmt::format("{:.2f} s", ns / 1'000'000'000);
+    }
+
+    constexpr std::array<double, 6> Percentiles{50, 75, 90, 99, 99.9, 99.99};
+
+    void PrintText(const bench_options &options, const worker_stats &total, double seconds) {
+        const auto &latency = total.latency;
+        std::cout << fmt::format("whz-bench {}:{}, {:.1f} s, {} threads, {} connections, pipeline {}, {}\n",
+                                 options.host, options.port, seconds, options.threads, options.connections,
+                                 options.no_keep_alive ? 1 : options.pipeline,
+                                 options.rate > 0 ? fmt::format("open loop at {:.0f} req/s", options.rate)
+                                                  : std::string("closed loop"));
+        std::cout << fmt::format("  Requests:  {} ({:.1f} req/s), {:.2f} MB/s read\n", total.responses,
+                                 static_cast<double>(total.responses) / seconds,
+                                 static_cast<double>(total.bytes_read) / seconds / (1024 * 1024));
+        std::cout << fmt::format("  Responses: 1xx {}, 2xx {}, 3xx {}, 4xx {}, 5xx {}, other {}\n",
+                                 total.status_classes[1], total.status_classes[2], total.status_classes[3],
+                                 total.status_classes[4], total.status_classes[5], total.status_classes[0]);
+        std::cout << fmt::format("  Errors:    {}, reconnects {}\n", total.errors, total.reconnects);
+        std::cout << fmt::format("  Latency:   mean {}, max {}\n", FormatNs(latency.mean()),
+                                 FormatNs(static_cast<double>(latency.max())));
+        for (const double p : Percentiles) {
+            std::cout << fmt::format("    p{:<6} {}\n", p, FormatNs(static_cast<double>(latency.percentile(p))));
+        }
+    }
+
+    // One line for scripts that compare runs
+    void PrintJson(const bench_options &options, const worker_stats &total, double seconds) {
+        const auto &latency = total.latency;
+        std::string out = fmt::format(
+                R"({{"connections":{},"threads":{},"pipeline":{},"rate":{},"duration_s":{:.3f},"requests":{},)"
+                R"("requests_per_s":{:.1f},"bytes_read":{},"errors":{},"reconnects":{},)"
+                R"("status":{{"1xx":{},"2xx":{},"3xx":{},"4xx":{},"5xx":{},"other":{}}},)"
+                R"("latency_ns":{{"mean":{:.0f},"max":{})",
+                options.connections, options.threads, options.no_keep_alive ? 1 : options.pipeline, options.rate,
+                seconds, total.responses, static_cast<double>(total.responses) / seconds, total.bytes_read,
+                total.errors, total.reconnects, total.status_classes[1], total.status_classes[2],
+                total.status_classes[3], total.status_classes[4], total.status_classes[5], total.status_classes[0],
+                latency.mean(), latency.max());
+        for (const double p : Percentiles) {
+            out += fmt::format(R"(,"p{}":{})", p, latency.percentile(p));
+        }
+        out += "}}\n";
+        std::cout << out;
+    }
+
+    std::chrono::nanoseconds Seconds(double s) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(s));
+    }
+}
+
+auto main(int argc, char **argv) -> int {
+    CLI::App app{"WorkHorz HTTP load generator"};
+
+    bench_options options;
+    app.add_option("--host", options.host, "Server address, default: 127.0.0.1");
+    app.add_option("-p, --port", options.port, "Server port, default: 8080");
+    app.add_option("-c, --connections", options.connections, "Open connections, default: 64");
+    app.add_option("-t, --threads", options.threads, "Threads, each with its own share of the connections, default: one per core");
+    app.add_option("-d, --duration", options.duration_s, "Measured seconds, default: 10");
+    app.add_option("-w, --warmup", options.warmup_s, "Seconds of load before measuring, default: 1");
+    app.add_option("--pipeline", options.pipeline, "Requests in flight per connection, default: 1");
+    app.add_option("-r, --rate", options.rate, "Open loop at this many requests per second over all connections, default: closed loop");
+    app.add_option("--requests", options.requests_file, "Request mix, one 'METHOD PATH [WEIGHT]' per line, default: GET /");
+    app.add_flag("--no-keep-alive", options.no_keep_alive, "Send Connection: close and open a new connection per request");
+    app.add_flag("--json", options.json, "Print the results as one line of JSON");
+    CLI11_PARSE(app, argc, argv);
+
+    if (options.connections == 0 || options.pipeline == 0 || options.duration_s <= 0 || options.warmup_s < 0 ||
+        options.rate < 0) {
+        std::cerr << "ERROR: connections, pipeline and duration must be positive" << std::endl;
+        return 1;
+    }
+    options.threads = std::clamp<std::size_t>(options.threads, 1, options.connections);
+
+    const auto mix = LoadRequestMix(options);
+    if (!mix) {
+        return 1;
+    }
+
+    boost::asio::io_context resolve_io;
+    tcp::resolver resolver(resolve_io);
+    boost::system::error_code ec;
+    const auto endpoints = resolver.resolve(options.host, options.port, ec);
+    if (ec) {
+        std::cerr << "ERROR: Failed to resolve " << options.host << ":" << options.port << ": " << ec.message()
+                  << std::endl;
+        return 1;
+    }
+
+    struct worker {
+        boost::asio::io_context io{1};
+        worker_stats stats;
+    };
+    run_state state;
+    std::vector<std::unique_ptr<worker>> workers;
+    for (std::size_t i = 0; i < options.threads; ++i) {
+        workers.push_back(std::make_unique<worker>());
+    }
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        auto &w = *workers[i % workers.size()];
+        std::make_shared<client_connection>(w.io, endpoints, options, *mix, state, w.stats,
+                                            0x9E3779B97F4A7C15ull * (i + 1))->start();
+    }
+
+    std::vector<std::jthread> threads;
+    for (auto &w : workers) {
+        threads.emplace_back([&io = w->io] { io.run(); });
+    }
+
+    std::this_thread::sleep_for(Seconds(options.warmup_s));
+    state.recording = true;
+    const auto start = clock_type::now();
+    std::this_thread::sleep_for(Seconds(options.duration_s));
+    state.recording = false;
+    const auto end = clock_type::now();
+    state.stopping = true;
+    for (auto &w : workers) {
+        w->io.stop();
+    }
+    threads.clear();
+
+    worker_stats total;
+    for (const auto &w : workers) {
+        total.merge(w->stats);
+    }
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    options.json ? PrintJson(options, total, seconds) : PrintText(options, total, seconds);
+    return total.responses > 0 ? 0 : 1;
+}
@@ -5,6 +5,11 @@
 
 #include "CLI/CLI.hpp"
 #include "whz_quill_wrapper.hpp"
+#include "whz_access_log.hpp"
+#include "whz_trace.hpp"
+#include "whz_output_cache.hpp"
+#include "whz_LUA_bytecode.hpp"
+#include "whz_LUA_pool.hpp"
 #include "whz_server.hpp"
 #include "LocalizationManager.hpp"
 #include "whz_encryption.hpp"
@@ -19,6 +24,32 @@
 
 using namespace whz;
 
+/**
+ * @brief Apply the live parameters of a config reload (SIGHUP) to the components started by main. Log levels,
+ * CONNECTION_TIMEOUT_MS and METRICS_PATH need no listener, they're read from the current snapshot where used.
+ *
+ */
+static void RegisterReloadListeners() {
+    whz::Config::get_instance().on_reload([](const config_snapshot& previous, const config_snapshot& current) {
+        if (previous.access_log_path != current.access_log_path ||
+            previous.access_log_format != current.access_log_format ||
+            previous.access_log_rotation_mb != current.access_log_rotation_mb) {
+            whz::whz_access_log::getInstance().start(whz::whz_access_log::options_from_config());
+        }
+        if (previous.trace_sample_rate != current.trace_sample_rate || previous.trace_path != current.trace_path ||
+            previous.trace_format != current.trace_format) {
+            whz::whz_tracer::getInstance().start(whz::whz_tracer::options_from_config());
+        }
+        if (previous.output_cache_max_mb != current.output_cache_max_mb ||
+            previous.output_cache_ttl_s != current.output_cache_ttl_s) {
+            whz::whz_output_cache::getInstance().configure_from_config();
+        }
+        if (previous.lua_bytecode_cache_path != current.lua_bytecode_cache_path) {
+            whz::whz_LUA_bytecode_cache::getInstance().configure_from_config();
+        }
+    });
+}
+
 auto main(int argc, char **argv) -> int {
 
     std::cout << "*** Start of server" << std::endl;
@@ -29,6 +60,9 @@ auto main(int argc, char **argv) -> int {
     std::string config_path;
     [[maybe_unused]] CLI::Option *opt = app.add_option("-c, --config", config_path,
                                                        "Path to WorkHorz config file, default: ./whz_config.json");
+    bool upgrade = false;
+    app.add_flag("--upgrade", upgrade,
+                 "Take over the listening socket of the running server over UPGRADE_SOCKET_PATH, which then drains and exits");
 
     // Read the commandline arguments
     try {
@@ -60,11 +94,16 @@ auto main(int argc, char **argv) -> int {
         std::cout << "After successful Config reading..." << std::endl;
     }
 
+    whz::whz_qlogger::setup(); // One log file for the whole process, from the LOG_* parameters
+    whz::whz_access_log::getInstance().start(whz::whz_access_log::options_from_config());
+    whz::whz_tracer::getInstance().start(whz::whz_tracer::options_from_config());
+    RegisterReloadListeners();
     whz::whz_qlogger qlogger;
     qlogger.info("My first logging message ma! :D");
     std::cout << "After 1st logging call..." << std::endl;
 
     std::filesystem::path path{"/tmp/whz"};
+    const std::size_t io_threads = 1; // Size of the io_context pool of the server
 
     // --------------------------------------------------------------------------------
     /// Testing the localization manager & translations
@@ -175,19 +214,28 @@ auto main(int argc, char **argv) -> int {
     std::cout << std::endl;
     // --------------------------------------------------------------------------------
     /// Testing the TemplateProcessor
-    auto processor_exp = TemplateProcessor::Create("database.db");
+    // One database pool for the whole server: WAL mode with a single writer thread and one read connection per
+    // io thread, so every io thread keeps its own connection and prepared statements
+    auto db_pool_exp = whz_db_pool::create(whz_db_pool::options_from_config(io_threads));
+    if (!db_pool_exp) {
+        std::cerr << "Error: " << db_pool_exp.error() << std::endl;
+        return 1;
+    }
+    auto db_pool = std::move(*db_pool_exp); // Also serves whz.db_query() of the Lua handlers
+    auto processor_exp = TemplateProcessor::Create(db_pool);
     if (!processor_exp) {
         std::cerr << "Error: " << processor_exp.error() << std::endl;
         return 1;
     }
-    auto processor = std::move(*processor_exp);
+    // Shared with the request handler of the server, which renders the .whzt requests with it
+    auto processor = std::make_shared<TemplateProcessor>(std::move(*processor_exp));
 
     // Set the TemplateDefiner instance
     auto template_definer = std::make_shared<TemplateDefiner>();
-    processor.SetTemplateDefiner(template_definer);
+    processor->SetTemplateDefiner(template_definer);
 
     // Process the template
-    auto result = processor.ProcessTemplate("template.whzt");
+    auto result = processor->ProcessTemplate("template.whzt");
     if (result) {
         std::cout << "Rendered Template:\n" << *result << std::endl;
     } else {
@@ -258,13 +306,64 @@ auto main(int argc, char **argv) -> int {
     std::cout << std::endl;
 
 
+    // --------------------------------------------------------------------------------
+    /// Templates rendered by the request handler: loaded in parallel or mapped from a pack once, then kept up to
+    /// date by the watcher
+    auto& template_cache = whz_templateCache::getInstance();
+    std::string template_path = whz::Config::get<whz::Config::ConfigParameter::TEMPLATE_PATH>();
+    if (template_path.empty()) {
+        template_path = path.string(); // The request handler looks templates up below the document root
+    }
+    const auto& template_pack_path = whz::Config::get<whz::Config::ConfigParameter::TEMPLATE_PACK_PATH>();
+    if (!template_pack_path.empty()) {
+        if (!template_cache.loadTemplatePack(template_pack_path)) {
+            WHZ_LOG_ERROR(qlogger, "Template pack {} not mapped, templates are read on first use", template_pack_path);
+        }
+    } else {
+        template_cache.loadTemplates(template_path, whz::Config::get<whz::Config::ConfigParameter::TEMPLATE_MEMORY_MAP>());
+    }
+    if (whz::Config::get<whz::Config::ConfigParameter::TEMPLATE_WATCH>() && !template_cache.watchTemplates(template_path)) {
+        WHZ_LOG_WARNING(qlogger, "Templates in {} not watched, changes need a restart", template_path);
+    }
+    // --------------------------------------------------------------------------------
+    /// Lua handlers: the states run the start script once, each io thread gets its own and runs its GC when idle
+    std::shared_ptr<whz_LUA_pool> lua_pool;
+    if (!whz::Config::get<whz::Config::ConfigParameter::LUA_START_SCRIPT_FILENAME>().empty()) {
+        auto lua_pool_exp = whz_LUA_pool::create(whz_LUA_pool::options_from_config(io_threads));
+        if (!lua_pool_exp) {
+            std::cerr << "Error: " << lua_pool_exp.error() << std::endl;
+            return 1;
+        }
+        lua_pool = std::move(*lua_pool_exp);
+        whz_LUA_pool::register_metrics(lua_pool);
+    }
+    // --------------------------------------------------------------------------------
+    std::cout << std::endl;
+
     qlogger.info("*** Starting WHZ Listening Server ***");
     std::cout << "*** Starting WHZ Listening Server ***" << std::endl;
-    whz::server s{"0.0.0.0", 8080, std::move(path), 1};
+    whz::server s{"0.0.0.0", 8080, std::move(path), io_threads};
+    s.set_template_processor(processor);
+    if (lua_pool) {
+        s.set_LUA_pool(lua_pool, db_pool);
+    }
+    if (upgrade) {
+        auto receiver = whz::whz_handoff_receiver::connect(
+                whz::Config::get<whz::Config::ConfigParameter::UPGRADE_SOCKET_PATH>());
+        if (!receiver) {
+            std::cerr << "ERROR: Upgrade failed, the running server keeps serving: " << receiver.error() << std::endl;
+            return 1;
+        }
+        s.adopt_listener(std::move(*receiver));
+    }
     std::cout << "-   press Ctrl-C to terminate the server   -" << std::endl;
 
     s.listen_and_serve();
     std::cout << std::endl;
+    template_cache.stopWatching();
+    whz::whz_tracer::getInstance().stop();
+    whz::whz_access_log::getInstance().stop();
+    whz::whz_qlogger::shutdown();
     return 0;
 }
 
@@ -3,6 +3,199 @@
 //
 
 #include "whz_LUA_api.hpp"
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "whz_metrics.hpp"
 
 namespace whz {
-} // whz
\ No newline at end of file
+
+    namespace {
+        using db_row = std::vector<std::pair<std::string, std::optional<std::string>>>;
+        using db_rows = std::vector<db_row>;
+
+        // Blocking work (SQLite) runs here, never on an io thread
+        boost::asio::thread_pool& BlockingPool() {
+            static boost::asio::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+            return pool;
+        }
+    }
+
+    void whz_LUA_api::init(sol::state& lua, boost::asio::io_context& io, std::shared_ptr<whz_db_pool> db_pool,
+                           bool idle_gc) {
+        this->_lua = &lua;
+        this->_io = &io;
+        this->_db_pool = std::move(db_pool);
+        this->_gc_step_kb = whz_LUA_gc::step_kb_from_config();
+        this->_gc_idle_budget = whz_LUA_gc::idle_budget_from_config();
+        this->_idle_gc.reset();
+        if (idle_gc) {
+            // Slices until the cycle is done, one idle period after the other
+            this->_idle_gc = std::make_unique<whz_LUA_idle_trigger>(io, [this] {
+                return !whz_LUA_gc::idle_step(this->_lua->lua_state(), this->_gc_step_kb, this->_gc_idle_budget,
+                                              this->_gc_stats);
+            });
+        }
+
+        register_http_types(lua);
+
+        sol::table whz = lua["whz"].get_or_create<sol::table>();
+        // whz.sleep(ms): suspends the handler for ms milliseconds
+        whz["sleep"] = sol::yielding([this](sol::this_state L, std::uint64_t milliseconds) {
+            async_sleep(L, milliseconds);
+        });
+        // whz.db_query(sql, ...): rows as array of {column = value} tables, or nil and the error message
+        if (this->_db_pool) {
+            whz["db_query"] = sol::yielding([this](sol::this_state L, std::string sql, sol::variadic_args params) {
+                async_db_query(L, std::move(sql), params);
+            });
+        }
+    }
+
+    void whz_LUA_api::register_http_types(sol::state& lua) {
+        // Plain accessors, a value is only pushed to LUA when the script reads it
+        lua.new_usertype<whz_LUA_request>("whz_request", sol::no_constructor,
+                "method", sol::readonly_property(&whz_LUA_request::method),
+                "path", sol::readonly_property(&whz_LUA_request::path),
+                "query_string", sol::readonly_property(&whz_LUA_request::query_string),
+                "http_version_major", sol::readonly_property(&whz_LUA_request::http_version_major),
+                "http_version_minor", sol::readonly_property(&whz_LUA_request::http_version_minor),
+                "header", &whz_LUA_request::header,
+                "query", &whz_LUA_request::query);
+        lua.new_usertype<whz_LUA_reply>("whz_reply", sol::no_constructor,
+                "write", &whz_LUA_reply::write,
+                "status", sol::property(&whz_LUA_reply::status, &whz_LUA_reply::set_status),
+                "set_header", &whz_LUA_reply::set_header,
+                "size", sol::readonly_property(&whz_LUA_reply::size));
+    }
+
+    void whz_LUA_api::handle_request(const sol::protected_function& handler, const request& req, reply& rep,
+                                     handler_done done) {
+        // The views live as long as the task, they are owned by its completion
+        auto views = std::make_shared<std::pair<whz_LUA_request, whz_LUA_reply>>(whz_LUA_request(req), whz_LUA_reply(rep));
+        auto* req_view = &views->first;
+        auto* rep_view = &views->second;
+        const auto start = std::chrono::steady_clock::now();
+        spawn(handler, [views = std::move(views), done = std::move(done), start](std::expected<std::string, std::string> result) {
+            whz_server_metrics::get().lua_handler_duration.observe(std::chrono::steady_clock::now() - start);
+            done(result ? std::expected<std::string, std::string>{} : std::move(result));
+        }, req_view, rep_view);
+    }
+
+    void whz_LUA_api::finish_if_done(lua_State* L, sol::protected_function_result result) {
+        if (result.status() == sol::call_status::yielded) {
+            return; // Waits for its operation, resume() continues it
+        }
+        // Read the outcome before the task goes, the result lives on the stack of the coroutine's thread
+        std::expected<std::string, std::string> outcome;
+        if (!result.valid()) {
+            sol::error err = result;
+            WHZ_LOG_ERROR(this->_qlogger, "LUA handler failed: {}", err.what());
+            outcome = std::unexpected(std::string(err.what()));
+        } else if (result.return_count() > 0) {
+            sol::object value = result;
+            if (value.get_type() == sol::type::string || value.get_type() == sol::type::number) {
+                outcome = value.as<std::string>();
+            }
+        }
+
+        auto it = this->_tasks.find(L);
+        if (it == this->_tasks.end()) {
+            return;
+        }
+        auto finished = std::move(it->second);
+        this->_tasks.erase(it);
+        finished->done(std::move(outcome));
+        if (this->_idle_gc) {
+            this->_idle_gc->touch();
+        }
+    }
+
+    void whz_LUA_api::async_sleep(sol::this_state L, std::uint64_t milliseconds) {
+        auto timer = std::make_shared<boost::asio::steady_timer>(*this->_io, std::chrono::milliseconds(milliseconds));
+        timer->async_wait([timer, alive = std::weak_ptr(this->_alive), L = L.lua_state()](const boost::system::error_code&) {
+            if (auto api = alive.lock()) {
+                (*api)->resume(L);
+            }
+        });
+    }
+
+    /**
+     * @brief Run the query on the blocking pool with a leased read connection. The rows are copied into plain C++
+     * values there and only turned into LUA tables back on the io thread, a LUA state must not be touched from the
+     * blocking pool.
+     *
+     */
+    void whz_LUA_api::async_db_query(sol::this_state L, std::string sql, sol::variadic_args params) {
+        std::vector<std::optional<std::string>> bindings;
+        for (auto param : params) {
+            switch (param.get_type()) {
+                case sol::type::string:
+                    bindings.emplace_back(param.as<std::string>());
+                    break;
+                case sol::type::number:
+                    bindings.emplace_back(fmt::format("{}", param.as<double>()));
+                    break;
+                case sol::type::boolean:
+                    bindings.emplace_back(param.as<bool>() ? "1" : "0");
+                    break;
+                default:
+                    bindings.emplace_back(std::nullopt);
+                    break;
+            }
+        }
+
+        boost::asio::post(BlockingPool(), [pool = this->_db_pool, io = this->_io, alive = std::weak_ptr(this->_alive),
+                                           L = L.lua_state(), sql = std::move(sql), bindings = std::move(bindings)] {
+            std::expected<db_rows, std::string> rows{db_rows{}};
+            try {
+                auto connection = pool->acquire();
+                auto& statement = connection->prepare(sql);
+                for (std::size_t i = 0; i < bindings.size(); ++i) {
+                    if (bindings[i]) {
+                        statement.bind(static_cast<int>(i + 1), *bindings[i]);
+                    } else {
+                        statement.bind(static_cast<int>(i + 1));
+                    }
+                }
+                while (statement.executeStep()) {
+                    db_row row;
+                    for (int column = 0; column < statement.getColumnCount(); ++column) {
+                        auto value = statement.getColumn(column);
+                        row.emplace_back(statement.getColumnName(column),
+                                         value.isNull() ? std::nullopt : std::optional<std::string>(value.getString()));
+                    }
+                    rows->push_back(std::move(row));
+                }
+            } catch (const std::exception& e) {
+                rows = std::unexpected(std::string(e.what()));
+            }
+
+            boost::asio::post(*io, [alive, L, rows = std::move(rows)] {
+                auto api = alive.lock();
+                if (!api) {
+                    return;
+                }
+                sol::state& lua = *(*api)->_lua;
+                if (!rows) {
+                    (*api)->resume(L, sol::lua_nil, rows.error());
+                    return;
+                }
+                sol::table result = lua.create_table(static_cast<int>(rows->size()), 0);
+                for (std::size_t i = 0; i < rows->size(); ++i) {
+                    sol::table row = lua.create_table(0, static_cast<int>((*rows)[i].size()));
+                    for (const auto& [column, value] : (*rows)[i]) {
+                        if (value) {
+                            row[column] = *value;
+                        }
+                    }
+                    result[i + 1] = row;
+                }
+                (*api)->resume(L, result);
+            });
+        });
+    }
+
+} // whz
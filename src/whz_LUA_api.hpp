@@ -4,6 +4,18 @@
 #pragma once
 
 //#include "whz_LUA_core.hpp"
+#define SOL_ALL_SAFETIES_ON 1
+#include <sol/sol.hpp>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "whz_database.hpp"
+#include "whz_LUA_gc.hpp"
+#include "whz_LUA_http.hpp"
 #include "whz_quill_wrapper.hpp"
 
 namespace whz {
@@ -12,15 +24,102 @@ namespace whz {
      * @brief API class that offers a user API to the LUA scripting engine it's a simplified interface allowing users to
      * interact with their own LUA scripts. This is a Facade pattern class.
      *
+     * Request handlers run as LUA coroutines. The async functions of the "whz" table (whz.sleep, whz.db_query) start
+     * the operation, yield, and the coroutine is resumed with the result when the operation completes. Completions
+     * are posted to the io_context the API is bound to, so the state is only ever touched by that io_context's
+     * thread and one thread multiplexes any number of suspended handlers. The GC of the state runs in idle slices
+     * once the io thread had no handler to start or finish for a while, not inside the handlers.
+     *
      */
     class whz_LUA_api {
     public:
+        /// Called once per handler on the io thread, with its return value as string or the LUA error
+        using handler_done = std::function<void(std::expected<std::string, std::string>)>;
+
         whz_LUA_api() = default;
+        whz_LUA_api(const whz_LUA_api&) = delete;
+        whz_LUA_api& operator=(const whz_LUA_api&) = delete;
         ~whz_LUA_api() = default;
 
+        /**
+         * @brief Bind the API to a state and register the "whz" table in it. The state must not be used by any other
+         * thread than the one running the io_context from then on.
+         *
+         * @param lua The state, e.g. a whz_LUA_state leased for the lifetime of the io thread
+         * @param io The io_context of the thread owning the state
+         * @param db_pool The pool whz.db_query() runs on, nullptr leaves whz.db_query() out
+         * @param idle_gc False if the owner of the state runs its GC, e.g. whz_LUA_pool::collect_idle()
+         */
+        void init(sol::state& lua, boost::asio::io_context& io, std::shared_ptr<whz_db_pool> db_pool = nullptr,
+                  bool idle_gc = true);
+
+        /**
+         * @brief Start a handler as coroutine, it runs until its first yield right away. A handler must only yield
+         * through the async functions of the API, a plain coroutine.yield() would never be resumed.
+         *
+         * @param handler The LUA function to run, it gets args as arguments
+         * @param done Called when the handler returned or failed, may be called before spawn() returns
+         */
+        template <typename... Args>
+        void spawn(const sol::protected_function& handler, handler_done done, Args&&... args) {
+            sol::thread thread = sol::thread::create(_lua->lua_state());
+            lua_State* L = thread.thread_state();
+            auto started = std::make_shared<task>(task{std::move(thread), sol::coroutine(L, handler), std::move(done)});
+            _tasks.emplace(L, started);
+            if (_idle_gc) {
+                _idle_gc->touch();
+            }
+            finish_if_done(L, started->coroutine(std::forward<Args>(args)...));
+        }
+
+        /**
+         * @brief Run a request handler as coroutine: handler(req, rep) with req a whz_request and rep a whz_reply
+         * view, see whz_LUA_http.hpp. The handler writes the body with rep:write(), its return value is ignored.
+         * The request and the reply must stay alive until done was called.
+         */
+        void handle_request(const sol::protected_function& handler, const request& req, reply& rep, handler_done done);
+
+        /// Register the whz_request and whz_reply usertypes, done by init()
+        static void register_http_types(sol::state& lua);
+
+        /// Number of handlers that are suspended and waiting for an operation to complete
+        [[nodiscard]] std::size_t in_flight() const { return _tasks.size(); }
+        [[nodiscard]] const whz_LUA_gc_stats& gc_stats() const { return _gc_stats; }
 
     private:
+        struct task {
+            sol::thread thread;         /// Keeps the LUA thread of the coroutine alive
+            sol::coroutine coroutine;
+            handler_done done;
+        };
+
+        // Resume the suspended coroutine running on L with the results of its pending operation
+        template <typename... Args>
+        void resume(lua_State* L, Args&&... args) {
+            auto it = _tasks.find(L);
+            if (it == _tasks.end()) {
+                return;
+            }
+            auto resumed = it->second; // The task may be erased while it runs
+            finish_if_done(L, resumed->coroutine(std::forward<Args>(args)...));
+        }
+
+        // Report and drop the task if the coroutine returned or failed, keep it if it yielded
+        void finish_if_done(lua_State* L, sol::protected_function_result result);
+
+        void async_sleep(sol::this_state L, std::uint64_t milliseconds);
+        void async_db_query(sol::this_state L, std::string sql, sol::variadic_args params);
 
+        sol::state* _lua = nullptr;
+        boost::asio::io_context* _io = nullptr;
+        std::shared_ptr<whz_db_pool> _db_pool;
+        std::unordered_map<lua_State*, std::shared_ptr<task>> _tasks;   /// Suspended coroutines, io thread only
+        std::unique_ptr<whz_LUA_idle_trigger> _idle_gc;    /// GC slices when the io thread is idle, see init()
+        std::size_t _gc_step_kb = 1024;
+        std::chrono::microseconds _gc_idle_budget{500};
+        whz_LUA_gc_stats _gc_stats;
+        std::shared_ptr<whz_LUA_api*> _alive = std::make_shared<whz_LUA_api*>(this);  /// Expires with the API
+        whz::whz_qlogger _qlogger{"lua_api"};
     };
 
 } // whz
@@ -0,0 +1,183 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_LUA_bytecode.hpp"
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <rapidhash.h>
+#include "whz_config.hpp"
+
+namespace whz {
+
+    namespace {
+        // Bytecode is only valid for the Lua build that wrote it, the version goes into every key
+#ifdef LUAJIT_VERSION
+        constexpr std::string_view kLuaBuild = LUAJIT_VERSION;
+#else
+        constexpr std::string_view kLuaBuild = LUA_RELEASE;
+#endif
+
+        int append_chunk(lua_State*, const void* data, std::size_t size, void* ud) {
+            static_cast<std::string*>(ud)->append(static_cast<const char*>(data), size);
+            return 0;
+        }
+    }
+
+    whz_LUA_bytecode_cache::whz_LUA_bytecode_cache() {
+        if (Config::get_instance().is_config_loaded()) {
+            configure_from_config();
+        }
+    }
+
+    void whz_LUA_bytecode_cache::configure(std::filesystem::path cache_dir) {
+        if (!cache_dir.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(cache_dir, ec);
+            if (ec) {
+                WHZ_LOG_ERROR(this->_qlogger, "LUA bytecode cache folder {} not usable: {}", cache_dir.string(), ec.message());
+                cache_dir.clear();
+            }
+        }
+        std::unique_lock lock(this->_mutex);
+        this->_cache_dir = std::move(cache_dir);
+    }
+
+    void whz_LUA_bytecode_cache::configure_from_config() {
+        configure(Config::get<Config::ConfigParameter::LUA_BYTECODE_CACHE_PATH>());
+    }
+
+    std::uint64_t whz_LUA_bytecode_cache::source_hash(std::string_view source) {
+        static const std::uint64_t seed = rapidhash(kLuaBuild.data(), kLuaBuild.size());
+        return rapidhash_withSeed(source.data(), source.size(), seed);
+    }
+
+    std::filesystem::path whz_LUA_bytecode_cache::disk_path(std::uint64_t hash) const {
+        return this->_cache_dir / fmt::format("{:016x}.luac", hash);
+    }
+
+    /**
+     * @brief Compile a script to bytecode in a throwaway state, the C API equivalent of string.dump(load(source)).
+     * Debug info is kept, so errors still report the chunk name and line numbers.
+     *
+     */
+    std::expected<std::string, std::string> whz_LUA_bytecode_cache::compile(std::string_view source,
+                                                                            const std::string &chunk_name) {
+        std::unique_ptr<lua_State, decltype(&lua_close)> L(luaL_newstate(), &lua_close);
+        if (!L) {
+            return std::unexpected("Could not create a LUA state to compile " + chunk_name);
+        }
+        if (luaL_loadbuffer(L.get(), source.data(), source.size(), chunk_name.c_str()) != 0) {
+            return std::unexpected(std::string(lua_tostring(L.get(), -1)));
+        }
+        std::string chunk;
+#if LUA_VERSION_NUM >= 503
+        const int status = lua_dump(L.get(), &append_chunk, &chunk, 0);
+#else
+        const int status = lua_dump(L.get(), &append_chunk, &chunk);
+#endif
+        if (status != 0 || chunk.empty()) {
+            return std::unexpected("Could not dump the bytecode of " + chunk_name);
+        }
+        return chunk;
+    }
+
+    std::expected<std::shared_ptr<const std::string>, std::string> whz_LUA_bytecode_cache::bytecode(std::string_view source,
+                                                                                                    const std::string &chunk_name) {
+        const std::uint64_t hash = source_hash(source);
+        std::filesystem::path file_path;
+        {
+            std::shared_lock lock(this->_mutex);
+            auto it = this->_chunks.find(hash);
+            if (it != this->_chunks.end()) {
+                return it->second;
+            }
+            if (!this->_cache_dir.empty()) {
+                file_path = disk_path(hash);
+            }
+        }
+
+        std::shared_ptr<const std::string> chunk;
+        if (!file_path.empty()) {
+            std::ifstream ifs(file_path, std::ios::in | std::ios::binary);
+            if (ifs) {
+                std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+                if (!content.empty()) {
+                    chunk = std::make_shared<const std::string>(std::move(content));
+                }
+            }
+        }
+        if (!chunk) {
+            auto compiled = compile(source, chunk_name);
+            if (!compiled) {
+                return std::unexpected(compiled.error());
+            }
+            chunk = std::make_shared<const std::string>(std::move(*compiled));
+
+            if (!file_path.empty()) {
+                // Written next to the final name and renamed, a crash never leaves a truncated chunk behind. The
+                // temporary name is per process and thread, states compiling the same script at once don't share it.
+                auto tmp_path = file_path;
+                tmp_path += "." + std::to_string(::getpid()) + "." +
+                            std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+                std::ofstream ofs(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+                ofs.write(chunk->data(), static_cast<std::streamsize>(chunk->size()));
+                ofs.close();
+                std::error_code ec;
+                if (ofs) {
+                    std::filesystem::rename(tmp_path, file_path, ec);
+                }
+                if (!ofs || ec) {
+                    std::filesystem::remove(tmp_path, ec);
+                    WHZ_LOG_WARNING(this->_qlogger, "Could not write the LUA bytecode of {} to {}", chunk_name,
+                                    file_path.string());
+                }
+            }
+        }
+
+        std::unique_lock lock(this->_mutex);
+        return this->_chunks.try_emplace(hash, std::move(chunk)).first->second; // Another thread may have been faster
+    }
+
+    std::expected<sol::protected_function, std::string> whz_LUA_bytecode_cache::load(sol::state &lua, std::string_view source,
+                                                                                     const std::string &chunk_name) {
+        auto chunk = bytecode(source, chunk_name);
+        if (!chunk) {
+            return std::unexpected(chunk.error());
+        }
+        sol::load_result loaded = lua.load(std::string_view(**chunk), chunk_name, sol::load_mode::binary);
+        if (!loaded.valid()) {
+            sol::error err = loaded;
+            return std::unexpected(std::string(err.what()));
+        }
+        return loaded.get<sol::protected_function>();
+    }
+
+    std::expected<void, std::string> whz_LUA_bytecode_cache::run(sol::state &lua, std::string_view source,
+                                                                 const std::string &chunk_name) {
+        auto chunk = load(lua, source, chunk_name);
+        if (!chunk) {
+            return std::unexpected(chunk.error());
+        }
+        sol::protected_function_result result = (*chunk)();
+        if (!result.valid()) {
+            sol::error err = result;
+            return std::unexpected(std::string(err.what()));
+        }
+        return {};
+    }
+
+    std::size_t whz_LUA_bytecode_cache::size() const {
+        std::shared_lock lock(this->_mutex);
+        return this->_chunks.size();
+    }
+
+    void whz_LUA_bytecode_cache::clear() {
+        std::unique_lock lock(this->_mutex);
+        this->_chunks.clear();
+    }
+
+} // whz
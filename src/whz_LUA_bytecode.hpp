@@ -0,0 +1,82 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#define SOL_ALL_SAFETIES_ON 1
+#include <sol/sol.hpp>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "whz_quill_wrapper.hpp"
+
+namespace whz {
+
+    /**
+     * @brief Singleton cache of compiled Lua chunks. A script is compiled once into bytecode (what string.dump()
+     * returns) and every state loads the bytecode from then on, which skips the parser. Chunks are keyed by the hash
+     * of their source and of the Lua version, so an edited script or another Lua build simply misses.
+     *
+     * With a cache folder set the bytecode is also written to disk and survives restarts. Lua doesn't verify bytecode
+     * when loading it, the folder must only be writable by the server itself.
+     *
+     */
+    class whz_LUA_bytecode_cache {
+    public:
+        whz_LUA_bytecode_cache(const whz_LUA_bytecode_cache &) = delete;
+        whz_LUA_bytecode_cache &operator=(const whz_LUA_bytecode_cache &) = delete;
+
+        static whz_LUA_bytecode_cache &getInstance() {
+            static whz_LUA_bytecode_cache instance;
+            return instance;
+        }
+
+        /// Keep the bytecode also in this folder, empty keeps it in memory only
+        void configure(std::filesystem::path cache_dir);
+        /// Configure from LUA_BYTECODE_CACHE_PATH, called by the constructor if the config is loaded
+        void configure_from_config();
+
+        /**
+         * @brief Get the bytecode of a script, compiling it on the first call.
+         *
+         * @param source The Lua source text
+         * @param chunk_name Name of the chunk in error messages, e.g. the script path
+         * @return The bytecode or the compile error
+         */
+        [[nodiscard]] std::expected<std::shared_ptr<const std::string>, std::string> bytecode(std::string_view source,
+                                                                                           const std::string &chunk_name);
+
+        /**
+         * @brief Load a script into the state from its cached bytecode, without running it.
+         *
+         * @return The loaded chunk, ready to call, or the compile or load error
+         */
+        [[nodiscard]] std::expected<sol::protected_function, std::string> load(sol::state &lua, std::string_view source,
+                                                                              const std::string &chunk_name);
+
+        /// Load and run a script from its cached bytecode, like sol::state::script() does with the source
+        std::expected<void, std::string> run(sol::state &lua, std::string_view source, const std::string &chunk_name);
+
+        [[nodiscard]] std::size_t size() const;
+        void clear();
+
+    private:
+        whz_LUA_bytecode_cache();
+
+        // Compile the source in a scratch state and dump it to bytecode
+        static std::expected<std::string, std::string> compile(std::string_view source, const std::string &chunk_name);
+        static std::uint64_t source_hash(std::string_view source);
+        [[nodiscard]] std::filesystem::path disk_path(std::uint64_t hash) const;
+
+        mutable std::shared_mutex _mutex;
+        std::unordered_map<std::uint64_t, std::shared_ptr<const std::string>> _chunks;
+        std::filesystem::path _cache_dir;   /// Guarded by _mutex
+        whz::whz_qlogger _qlogger{"lua_bytecode"};
+    };
+
+} // whz
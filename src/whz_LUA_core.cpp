@@ -5,6 +5,9 @@
 #include <fstream>
 #include "whz_LUA_core.hpp"
 #include "whz_quill_wrapper.hpp"
+#include "whz_LUA_bytecode.hpp"
+#include "whz_LUA_gc.hpp"
+#include "whz_LUA_ffi.hpp"
 
 namespace whz {
     bool whz_LUA_core::init_LUA(const std::string& startup_script_path) {
@@ -24,14 +27,14 @@ namespace whz {
         bool bRet = false;
         // check if file exists in the filesystem startup_script_path
         if (!std::filesystem::exists(startup_script_path)) {
-            this->_whz_qlogger.error(fmt::format("Error initializing LUA: Startup script not found: {}", startup_script_path.string()));
+            WHZ_LOG_ERROR(this->_whz_qlogger, "Error initializing LUA: Startup script not found: {}", startup_script_path.string());
             //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Error initializing LUA: Startup script not found: {}", startup_script_path);
             std::cerr << "Error initializing LUA: Startup script not found: " << startup_script_path << std::endl;
             return bRet;
         }
         // check if the file has the extension .LUA
         if (startup_script_path.extension() != ".lua") {
-            this->_whz_qlogger.error(fmt::format("Error initializing LUA: Startup script is not a LUA script: {}", startup_script_path.string()));
+            WHZ_LOG_ERROR(this->_whz_qlogger, "Error initializing LUA: Startup script is not a LUA script: {}", startup_script_path.string());
             std::cerr << "Error initializing LUA: Startup script is not a LUA script: " << startup_script_path << std::endl;
             return bRet;
         }
@@ -41,7 +44,7 @@ namespace whz {
         try {
             std::ifstream ifs(startup_script_path);
             if (!ifs.is_open()) {
-                this->_whz_qlogger.error(fmt::format("Error initializing LUA: Could not open startup script: {}", startup_script_path.string()));
+                WHZ_LOG_ERROR(this->_whz_qlogger, "Error initializing LUA: Could not open startup script: {}", startup_script_path.string());
                 //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Error initializing LUA: Could not open startup script: {}", startup_script_path);
                 std::cerr << "Error initializing LUA: Could not open startup script: " << startup_script_path
                           << std::endl;
@@ -51,7 +54,7 @@ namespace whz {
                                                             std::istreambuf_iterator<char>());
             ifs.close();
         } catch (const std::exception& e) {
-            this->_whz_qlogger.error(fmt::format("Error initializing LUA: Could not read startup script: {}", e.what()));
+            WHZ_LOG_ERROR(this->_whz_qlogger, "Error initializing LUA: Could not read startup script: {}", e.what());
             //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Error initializing LUA: Could not read startup script: {}", e.what());
             std::cerr << "Error initializing LUA: Could not read startup script: " << e.what() << std::endl;
             return bRet;
@@ -74,35 +77,49 @@ namespace whz {
         bool bRet = false;
 
         if (this->_startup_script_path.empty()) {
-            this->_whz_qlogger.error(fmt::format("Error running LUA startup script: No startup script defined."));
+            WHZ_LOG_ERROR(this->_whz_qlogger, "Error running LUA startup script: No startup script defined.");
             //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Error running LUA startup script: No startup script defined.");
             std::cerr << "Error running LUA startup script: No startup script defined." << std::endl;
             return bRet;
         }
 
         try {
-            // Set the LUA GC mode
-            this->_lua01.supports_gc_mode(sol::gc_mode::incremental);
+            // Generational/long-pause GC, the work is done in idle slices by step_LUA_gc()
+            whz_LUA_gc::configure(this->_lua01.lua_state());
 
-            this->_whz_qlogger.error(fmt::format("Test if LUA GC is turned on: : {}", this->_lua01.is_gc_on()));
-            //LOG_INFO(whz_qlogger::getInstance().getLogger(), "Test if LUA GC is turned on: : {}", this->_lua01.is_gc_on());
-            std::cout << "Test if LUA GC is turned on: " << this->_lua01.is_gc_on() << std::endl; // Check if GC is on
-
-            //this->_lua01.open_libraries(sol::lib::base, sol::lib::package, sol::lib::coroutine, sol::lib::string, sol::lib::os, sol::lib::math, sol::lib::table, sol::lib::debug, sol::lib::bit32, sol::lib::io, sol::lib::ffi, sol::lib::jit);
-            this->_lua01.open_libraries(sol::lib::base, sol::lib::package, sol::lib::coroutine, sol::lib::string, sol::lib::os, sol::lib::table, sol::lib::debug, sol::lib::bit32, sol::lib::io, sol::lib::ffi, sol::lib::jit);
+            open_LUA_libraries(this->_lua01);
             //this->_lua01.script_file(this->_startup_script_path);
-            this->_lua01.script(this->_startup_script_content_str);
+            // Runs from the cached bytecode, the source is only parsed the first time
+            auto ran = whz_LUA_bytecode_cache::getInstance().run(this->_lua01, this->_startup_script_content_str,
+                                                                 "@" + this->_startup_script_path.string());
+            if (!ran) {
+                throw std::runtime_error(ran.error());
+            }
             bRet = true;
         } catch (const std::exception& e) {
-            this->_whz_qlogger.error(fmt::format("Error running the LUA startup script ({}): {}", this->_startup_script_path.string(), e.what()));
+            WHZ_LOG_ERROR(this->_whz_qlogger, "Error running the LUA startup script ({}): {}", this->_startup_script_path.string(), e.what());
             //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Error running the LUA startup script ({}): {}", this->_startup_script_path, e.what());
             std::cerr << "Error running the LUA startup script (" << this->_startup_script_path << "): " << e.what() << std::endl;
         }
-        // Run the GC right now to clean up the LUA memory
-        this->_lua01.collect_garbage();
         return bRet;
     }
 
+    /**
+     * @brief Open the built-in LUA libraries, the same set for the main state and all pooled states.
+     *
+     * @param lua The state to open the libraries in
+     */
+    void whz_LUA_core::open_LUA_libraries(sol::state& lua) {
+        //lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::coroutine, sol::lib::string, sol::lib::os, sol::lib::math, sol::lib::table, sol::lib::debug, sol::lib::bit32, sol::lib::io, sol::lib::ffi, sol::lib::jit);
+        lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::coroutine, sol::lib::string, sol::lib::os, sol::lib::table, sol::lib::debug, sol::lib::bit32, sol::lib::io, sol::lib::ffi, sol::lib::jit);
+#ifdef LUAJIT_VERSION
+        // require("whz.ffi") gives the FFI fast path to the C helpers, see whz_LUA_ffi.hpp
+        const std::string ffi_module = "local whz_ffi_cdef = [==[" + std::string(whz_LUA_ffi_cdef()) + "]==]\n" +
+                                       std::string(whz_LUA_ffi_module());
+        lua["package"]["preload"]["whz.ffi"] = lua.load(ffi_module, "=whz.ffi").get<sol::protected_function>();
+#endif
+    }
+
     /**
      * @brief Initialize the LUA user facing API by calling all the public function and data definitions. Facade!
      *
@@ -128,9 +145,9 @@ namespace whz {
 
         // Check if the LUA startup script is defined in the config class
         if (this->_whz_config.is_config_loaded()) {
-            std::any lua_script_path = this->_whz_config.get_config_value(whz::Config::ConfigParameter::LUA_START_SCRIPT_FILENAME);
-            if (lua_script_path.has_value()) {
-                this->_startup_script_path = std::any_cast<std::string>(lua_script_path);
+            const auto& lua_script_path = this->_whz_config.snapshot().lua_start_script_filename;
+            if (!lua_script_path.empty()) {
+                this->_startup_script_path = lua_script_path;
                 bRet = true;
             }
         }
@@ -138,20 +155,15 @@ namespace whz {
     }
 
     /**
-     * @brief Do 1 step in the LUA garbage collector with the preconfigured step size. Or 100KB if not defined or invalid.
+     * @brief Run one idle slice of the LUA garbage collector: steps of LUA_GC_STEPSIZE KB until LUA_GC_IDLE_BUDGET_US
+     * is used up or the cycle finished. Call it when the state is idle, never in the middle of a request.
      *
-     * @return true The collectgarbage will return true if the triggered step was the last step of a garbage-collection cycle.
-     * @return false False if the step wasn't the last one of the cycle.
+     * @return true The slice finished a garbage-collection cycle.
+     * @return false The cycle isn't finished yet.
      */
     bool whz_LUA_core::step_LUA_gc() {
-        bool bRet = false;
-        if (whz::Config::get_instance().get_config_value(whz::Config::ConfigParameter::LUA_GC_STEPSIZE).has_value()) {
-            bRet = this->_lua01.step_gc(std::any_cast<int>(whz::Config::get_instance().get_config_value(whz::Config::ConfigParameter::LUA_GC_STEPSIZE))); // cast any to int
-        }
-        else {
-            bRet = this->_lua01.step_gc(100); // Default to 100 KB
-        }
-        return bRet;
+        return whz_LUA_gc::idle_step(this->_lua01.lua_state(), whz_LUA_gc::step_kb_from_config(),
+                                     whz_LUA_gc::idle_budget_from_config(), this->_gc_stats);
     }
 
 } // whz
\ No newline at end of file
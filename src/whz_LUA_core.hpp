@@ -8,6 +8,7 @@
 #include <filesystem>
 #include "whz_config.hpp"
 #include "whz_LUA_api.hpp"
+#include "whz_LUA_gc.hpp"
 #include "whz_quill_wrapper.hpp"
 
 // Some LUA Libs that are built-in and can be added as needed, the rest needs to be included manually in LUA.:
@@ -30,7 +31,10 @@ namespace whz {
         bool init_LUA(const std::filesystem::path& startup_script_path);
         bool init_LUA(void); /// Initialize the LUA scripting engine with a startup script defined in config
         bool run_LUA_startup_script(void); /// Runs until all scripts are done and return
-        bool step_LUA_gc(void); /// Do 1 step in the LUA garbage collector with the preconfigured step size
+        bool step_LUA_gc(void); /// Run one idle slice of the LUA garbage collector, see whz_LUA_gc
+        [[nodiscard]] const whz_LUA_gc_stats& gc_stats() const { return _gc_stats; }
+
+        static void open_LUA_libraries(sol::state& lua); /// Open the built-in LUA libs every WHZ state gets
 
     protected:
         void init_LUA_user_api(void); /// Initialize the LUA user facing API
@@ -41,8 +45,9 @@ namespace whz {
         std::filesystem::path _startup_script_path;
         std::string _startup_script_content_str;
         whz::whz_LUA_api _whz_LUA_user_api;
+        whz::whz_LUA_gc_stats _gc_stats;
         whz::Config& _whz_config;
-        whz::whz_qlogger _whz_qlogger;
+        whz::whz_qlogger _whz_qlogger{"lua_core"};
     };
 
 } // whz
@@ -0,0 +1,241 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_LUA_ffi.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <rapidhash.h>
+
+#define WHZ_FFI_EXPORT __attribute__((visibility("default"), used))
+
+namespace {
+    // Make room for extra more bytes, false if out of memory
+    bool reserve(whz_buf* buf, std::size_t extra) {
+        const std::size_t needed = buf->size + extra;
+        if (needed <= buf->capacity) {
+            return true;
+        }
+        std::size_t capacity = buf->capacity ? buf->capacity : 64;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        auto* data = static_cast<char*>(std::realloc(buf->data, capacity));
+        if (!data) {
+            return false;
+        }
+        buf->data = data;
+        buf->capacity = capacity;
+        return true;
+    }
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    constexpr char kHexDigits[] = "0123456789abcdef";
+}
+
+extern "C" {
+
+    WHZ_FFI_EXPORT whz_buf* whz_buf_new(size_t capacity) {
+        auto* buf = static_cast<whz_buf*>(std::calloc(1, sizeof(whz_buf)));
+        if (buf && capacity && !reserve(buf, capacity)) {
+            std::free(buf);
+            return nullptr;
+        }
+        return buf;
+    }
+
+    WHZ_FFI_EXPORT void whz_buf_free(whz_buf* buf) {
+        if (buf) {
+            std::free(buf->data);
+            std::free(buf);
+        }
+    }
+
+    WHZ_FFI_EXPORT void whz_buf_reset(whz_buf* buf) {
+        buf->size = 0;
+    }
+
+    WHZ_FFI_EXPORT int whz_buf_append(whz_buf* buf, const char* data, size_t len) {
+        if (!reserve(buf, len)) {
+            return -1;
+        }
+        std::memcpy(buf->data + buf->size, data, len);
+        buf->size += len;
+        return 0;
+    }
+
+    WHZ_FFI_EXPORT int whz_buf_append_html_escaped(whz_buf* buf, const char* text, size_t len) {
+        if (!reserve(buf, len)) { // Exact for text without special characters, grows further only if needed
+            return -1;
+        }
+        const std::size_t start = buf->size;
+        std::size_t run = 0; // Start of the current run of plain characters
+        for (std::size_t i = 0; i < len; ++i) {
+            const char* entity = nullptr;
+            switch (text[i]) {
+                case '&': entity = "&amp;"; break;
+                case '<': entity = "&lt;"; break;
+                case '>': entity = "&gt;"; break;
+                case '"': entity = "&quot;"; break;
+                case '\'': entity = "&#39;"; break;
+                default: continue;
+            }
+            if (whz_buf_append(buf, text + run, i - run) != 0 || whz_buf_append(buf, entity, std::strlen(entity)) != 0) {
+                buf->size = start;
+                return -1;
+            }
+            run = i + 1;
+        }
+        if (whz_buf_append(buf, text + run, len - run) != 0) {
+            buf->size = start;
+            return -1;
+        }
+        return 0;
+    }
+
+    WHZ_FFI_EXPORT int whz_buf_append_json_string(whz_buf* buf, const char* text, size_t len) {
+        if (!reserve(buf, len + 2)) {
+            return -1;
+        }
+        const std::size_t start = buf->size;
+        buf->data[buf->size++] = '"';
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < len; ++i) {
+            const auto c = static_cast<unsigned char>(text[i]);
+            char escaped[6] = {'\\', 0, 0, 0, 0, 0};
+            std::size_t escaped_len = 2;
+            switch (c) {
+                case '"': escaped[1] = '"'; break;
+                case '\\': escaped[1] = '\\'; break;
+                case '\n': escaped[1] = 'n'; break;
+                case '\r': escaped[1] = 'r'; break;
+                case '\t': escaped[1] = 't'; break;
+                case '\b': escaped[1] = 'b'; break;
+                case '\f': escaped[1] = 'f'; break;
+                default:
+                    if (c >= 0x20) {
+                        continue;
+                    }
+                    escaped[1] = 'u';
+                    escaped[2] = '0';
+                    escaped[3] = '0';
+                    escaped[4] = kHexDigits[c >> 4];
+                    escaped[5] = kHexDigits[c & 0xF];
+                    escaped_len = 6;
+            }
+            if (whz_buf_append(buf, text + run, i - run) != 0 || whz_buf_append(buf, escaped, escaped_len) != 0) {
+                buf->size = start;
+                return -1;
+            }
+            run = i + 1;
+        }
+        if (whz_buf_append(buf, text + run, len - run) != 0 || whz_buf_append(buf, "\"", 1) != 0) {
+            buf->size = start;
+            return -1;
+        }
+        return 0;
+    }
+
+    WHZ_FFI_EXPORT int whz_buf_append_json_number(whz_buf* buf, double value) {
+        if (!std::isfinite(value)) {
+            return whz_buf_append(buf, "null", 4);
+        }
+        char digits[32];
+        std::to_chars_result result;
+        if (value == std::trunc(value) && std::fabs(value) < 9007199254740992.0) {
+            result = std::to_chars(digits, digits + sizeof(digits), static_cast<long long>(value));
+        } else {
+            result = std::to_chars(digits, digits + sizeof(digits), value); // Shortest round-trip form
+        }
+        return whz_buf_append(buf, digits, static_cast<std::size_t>(result.ptr - digits));
+    }
+
+    WHZ_FFI_EXPORT int whz_buf_append_url_decoded(whz_buf* buf, const char* text, size_t len) {
+        if (!reserve(buf, len)) { // Decoding never makes the text longer
+            return -1;
+        }
+        char* out = buf->data + buf->size;
+        std::size_t written = 0;
+        for (std::size_t i = 0; i < len; ++i) {
+            if (text[i] == '%') {
+                const int high = i + 2 < len ? hex_value(text[i + 1]) : -1;
+                const int low = i + 2 < len ? hex_value(text[i + 2]) : -1;
+                if (high < 0 || low < 0) {
+                    return -1; // Nothing was committed to the buffer yet
+                }
+                out[written++] = static_cast<char>(high * 16 + low);
+                i += 2;
+            } else {
+                out[written++] = text[i] == '+' ? ' ' : text[i];
+            }
+        }
+        buf->size += written;
+        return 0;
+    }
+
+    WHZ_FFI_EXPORT uint64_t whz_hash64(const char* data, size_t len) {
+        return rapidhash(data, len);
+    }
+}
+
+namespace whz {
+
+    std::string_view whz_LUA_ffi_cdef() {
+        return R"cdef(
+typedef struct whz_buf { char* data; size_t size; size_t capacity; } whz_buf;
+whz_buf* whz_buf_new(size_t capacity);
+void whz_buf_free(whz_buf* buf);
+void whz_buf_reset(whz_buf* buf);
+int whz_buf_append(whz_buf* buf, const char* data, size_t len);
+int whz_buf_append_html_escaped(whz_buf* buf, const char* text, size_t len);
+int whz_buf_append_json_string(whz_buf* buf, const char* text, size_t len);
+int whz_buf_append_json_number(whz_buf* buf, double value);
+int whz_buf_append_url_decoded(whz_buf* buf, const char* text, size_t len);
+uint64_t whz_hash64(const char* data, size_t len);
+)cdef";
+    }
+
+    std::string_view whz_LUA_ffi_module() {
+        return R"lua(
+local ffi = require("ffi")
+ffi.cdef(whz_ffi_cdef)
+local C = ffi.C
+
+local M = { C = C }
+local scratch = ffi.gc(C.whz_buf_new(256), C.whz_buf_free)
+
+-- New buffer, freed when the GC collects it
+function M.buffer(capacity)
+  return ffi.gc(C.whz_buf_new(capacity or 256), C.whz_buf_free)
+end
+
+function M.tostring(buf)
+  return ffi.string(buf.data, buf.size)
+end
+
+local function through_scratch(fn, s)
+  C.whz_buf_reset(scratch)
+  if fn(scratch, s, #s) ~= 0 then
+    return nil
+  end
+  return ffi.string(scratch.data, scratch.size)
+end
+
+function M.html_escape(s) return through_scratch(C.whz_buf_append_html_escaped, s) end
+function M.json_string(s) return through_scratch(C.whz_buf_append_json_string, s) end
+function M.url_decode(s) return through_scratch(C.whz_buf_append_url_decoded, s) end
+function M.hash(s) return C.whz_hash64(s, #s) end
+
+return M
+)lua";
+    }
+
+} // whz
@@ -0,0 +1,59 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * C functions for LuaJIT's FFI. Hot Lua code calls them straight through ffi.C, without the stack marshalling of
+ * the sol2 bindings. The declarations below are repeated verbatim in whz_LUA_ffi_cdef(), keep both in sync.
+ *
+ * Strings go in as pointer and length (a Lua string passes as const char*, its length is #s), results are appended
+ * to a whz_buf the script owns. Functions returning int return 0 on success and -1 if memory ran out or the input
+ * was invalid; the buffer is unchanged then.
+ *
+ * From Lua use the "whz.ffi" module, it declares everything and adds small wrappers:
+ *   local wf = require("whz.ffi")
+ *   local buf = wf.buffer()                 -- freed by the GC
+ *   wf.C.whz_buf_append_json_string(buf, s, #s)
+ *   rep:write(wf.tostring(buf))
+ */
+extern "C" {
+
+    /// Growable byte buffer owned by the script
+    typedef struct whz_buf {
+        char* data;
+        size_t size;
+        size_t capacity;
+    } whz_buf;
+
+    /// New buffer with room for capacity bytes, NULL if out of memory
+    whz_buf* whz_buf_new(size_t capacity);
+    void whz_buf_free(whz_buf* buf);
+    /// Empty the buffer, keeps the memory
+    void whz_buf_reset(whz_buf* buf);
+    /// Append raw bytes
+    int whz_buf_append(whz_buf* buf, const char* data, size_t len);
+
+    /// Append the text with & < > " ' replaced by their HTML entities
+    int whz_buf_append_html_escaped(whz_buf* buf, const char* text, size_t len);
+    /// Append the text as JSON string, including the quotes
+    int whz_buf_append_json_string(whz_buf* buf, const char* text, size_t len);
+    /// Append a number in the shortest JSON form, integers without a fraction; NaN and infinity become null
+    int whz_buf_append_json_number(whz_buf* buf, double value);
+    /// Append the URL-decoded text (%XX and '+'), -1 on a malformed escape
+    int whz_buf_append_url_decoded(whz_buf* buf, const char* text, size_t len);
+
+    /// 64 bit hash of the bytes (rapidhash), stable across processes
+    uint64_t whz_hash64(const char* data, size_t len);
+}
+
+namespace whz {
+    /// The ffi.cdef() declarations of the functions above
+    std::string_view whz_LUA_ffi_cdef();
+    /// Source of the "whz.ffi" Lua module, expects the declarations in the local whz_ffi_cdef
+    std::string_view whz_LUA_ffi_module();
+} // whz
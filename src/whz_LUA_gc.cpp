@@ -0,0 +1,82 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_LUA_gc.hpp"
+#include "whz_config.hpp"
+
+namespace whz {
+
+    namespace {
+        std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    void whz_LUA_gc::configure(lua_State* L) {
+#if LUA_VERSION_NUM >= 504
+        lua_gc(L, LUA_GCGEN, 20, 100);  // Minor collection after 20% growth, major after 100%
+#else
+        lua_gc(L, LUA_GCSETPAUSE, 300);     // Next automatic cycle only when the heap tripled
+        lua_gc(L, LUA_GCSETSTEPMUL, 200);
+#endif
+    }
+
+    bool whz_LUA_gc::idle_step(lua_State* L, std::size_t step_kb, std::chrono::microseconds budget,
+                               whz_LUA_gc_stats& stats) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + budget;
+        bool cycle_done = false;
+        std::uint64_t steps = 0;
+        do {
+            cycle_done = lua_gc(L, LUA_GCSTEP, static_cast<int>(step_kb)) != 0;
+            ++steps;
+        } while (!cycle_done && std::chrono::steady_clock::now() < deadline);
+
+        stats.idle_slices.fetch_add(1, std::memory_order_relaxed);
+        stats.steps.fetch_add(steps, std::memory_order_relaxed);
+        if (cycle_done) {
+            stats.cycles.fetch_add(1, std::memory_order_relaxed);
+        }
+        stats.gc_time_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+        return cycle_done;
+    }
+
+    void whz_LUA_gc::full_collect(lua_State* L, whz_LUA_gc_stats& stats) {
+        const auto start = std::chrono::steady_clock::now();
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        stats.full_collections.fetch_add(1, std::memory_order_relaxed);
+        stats.gc_time_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+    }
+
+    whz_LUA_idle_trigger::whz_LUA_idle_trigger(boost::asio::io_context& io, std::function<bool()> work,
+                                               std::chrono::microseconds idle_delay)
+            : _io(io), _work(std::move(work)), _idle_delay(idle_delay) {}
+
+    void whz_LUA_idle_trigger::arm() {
+        this->_armed = true;
+        this->_armed_activity = this->_activity;
+        auto timer = std::make_shared<boost::asio::steady_timer>(this->_io, this->_idle_delay);
+        timer->async_wait([timer, alive = std::weak_ptr(this->_alive)](const boost::system::error_code& ec) {
+            auto trigger = alive.lock();
+            if (ec || !trigger) {
+                return; // Destroyed with the states it collects
+            }
+            whz_LUA_idle_trigger& self = **trigger;
+            self._armed = false;
+            if (self._activity != self._armed_activity || self._work()) {
+                self.arm(); // Busy meanwhile, or a GC cycle left to finish in the next idle period
+            }
+        });
+    }
+
+    std::size_t whz_LUA_gc::step_kb_from_config() {
+        return Config::get<Config::ConfigParameter::LUA_GC_STEPSIZE>();
+    }
+
+    std::chrono::microseconds whz_LUA_gc::idle_budget_from_config() {
+        return std::chrono::microseconds(Config::get<Config::ConfigParameter::LUA_GC_IDLE_BUDGET_US>());
+    }
+
+} // whz
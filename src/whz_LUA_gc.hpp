@@ -0,0 +1,90 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#define SOL_ALL_SAFETIES_ON 1
+#include <sol/sol.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace whz {
+
+    /// GC counters of one Lua state, written by the thread using the state and readable from any thread
+    struct whz_LUA_gc_stats {
+        std::atomic<std::uint64_t> idle_slices{0};      /// Idle slices that did GC work
+        std::atomic<std::uint64_t> steps{0};            /// Incremental steps run in idle slices
+        std::atomic<std::uint64_t> cycles{0};           /// GC cycles finished in idle slices
+        std::atomic<std::uint64_t> full_collections{0}; /// Full collections, e.g. because of the heap limit
+        std::atomic<std::uint64_t> gc_time_ns{0};       /// Time spent in idle slices and full collections
+    };
+
+    /**
+     * @brief Schedules the Lua garbage collector into the idle time between requests. The collector of every state
+     * is set up once with configure(): generational on Lua 5.4, where minor collections are short, and incremental
+     * with a long pause on LuaJIT/5.1, so automatic cycles rarely start while a request runs. The remaining work is
+     * done in idle slices of a fixed time budget.
+     *
+     */
+    class whz_LUA_gc {
+    public:
+        /// Set up the collector of a fresh state
+        static void configure(lua_State* L);
+
+        /**
+         * @brief Run GC steps of step_kb until the time budget is used up or a cycle finished.
+         *
+         * @return True if a GC cycle finished in this slice
+         */
+        static bool idle_step(lua_State* L, std::size_t step_kb, std::chrono::microseconds budget, whz_LUA_gc_stats& stats);
+
+        /// Run a full collection right now, for states above their soft heap limit
+        static void full_collect(lua_State* L, whz_LUA_gc_stats& stats);
+
+        /// LUA_GC_STEPSIZE of the config, 1024 KB if not set
+        static std::size_t step_kb_from_config();
+        /// LUA_GC_IDLE_BUDGET_US of the config, 500us if not set
+        static std::chrono::microseconds idle_budget_from_config();
+    };
+
+    /**
+     * @brief Runs GC work on an io thread once it is idle. Every request calls touch(), which arms a timer if it isn't
+     * armed. When the timer expires and requests came in meanwhile it's armed again, only when the thread had nothing
+     * to do for the whole idle delay the work runs. Timer completions are queued behind the handlers that are ready,
+     * so the work doesn't hold up waiting connections either. Only used by the thread running the io_context.
+     *
+     */
+    class whz_LUA_idle_trigger {
+    public:
+        /// work returns true if it has more to do, it runs again after the next idle delay then
+        whz_LUA_idle_trigger(boost::asio::io_context& io, std::function<bool()> work,
+                             std::chrono::microseconds idle_delay = std::chrono::milliseconds(1));
+        whz_LUA_idle_trigger(const whz_LUA_idle_trigger&) = delete;
+        whz_LUA_idle_trigger& operator=(const whz_LUA_idle_trigger&) = delete;
+
+        /// Note a request, the work waits until the thread was idle for the idle delay after it
+        void touch() {
+            ++_activity;
+            if (!_armed) {
+                arm();
+            }
+        }
+
+    private:
+        void arm();
+
+        boost::asio::io_context& _io;   /// The timers belong to the pending wait, they may outlive the trigger
+        std::function<bool()> _work;
+        std::chrono::microseconds _idle_delay;
+        std::uint64_t _activity = 0;            /// Requests seen, compared with the count when the timer was armed
+        std::uint64_t _armed_activity = 0;
+        bool _armed = false;
+        std::shared_ptr<whz_LUA_idle_trigger*> _alive = std::make_shared<whz_LUA_idle_trigger*>(this);
+    };
+
+} // whz
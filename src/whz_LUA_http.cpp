@@ -0,0 +1,78 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_LUA_http.hpp"
+#include <algorithm>
+#include <cctype>
+#include "whz_utils.hpp"
+
+namespace whz {
+
+    namespace {
+        bool iequals(std::string_view a, std::string_view b) {
+            return std::ranges::equal(a, b, [](unsigned char x, unsigned char y) {
+                return std::tolower(x) == std::tolower(y);
+            });
+        }
+    }
+
+    std::string_view whz_LUA_request::path() const {
+        std::string_view uri = this->_req->uri;
+        return uri.substr(0, uri.find('?'));
+    }
+
+    std::string_view whz_LUA_request::query_string() const {
+        std::string_view uri = this->_req->uri;
+        const auto mark = uri.find('?');
+        return mark == std::string_view::npos ? std::string_view{} : uri.substr(mark + 1);
+    }
+
+    std::optional<std::string_view> whz_LUA_request::header(std::string_view name) const {
+        for (const auto& h : this->_req->headers) {
+            if (iequals(h.name, name)) {
+                return std::string_view(h.value);
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<std::string> whz_LUA_request::query(std::string_view name) const {
+        if (!this->_query_split) {
+            std::string_view rest = query_string();
+            while (!rest.empty()) {
+                const auto amp = rest.find('&');
+                std::string_view pair = rest.substr(0, amp);
+                rest = amp == std::string_view::npos ? std::string_view{} : rest.substr(amp + 1);
+                if (pair.empty()) {
+                    continue;
+                }
+                const auto eq = pair.find('=');
+                this->_query.emplace_back(pair.substr(0, eq),
+                                          eq == std::string_view::npos ? std::string_view{} : pair.substr(eq + 1));
+            }
+            this->_query_split = true;
+        }
+        for (const auto& [raw_name, raw_value] : this->_query) {
+            if (raw_name == name) {
+                return url_decode(std::string(raw_value));
+            }
+        }
+        return std::nullopt;
+    }
+
+    void whz_LUA_reply::set_header(std::string_view name, std::string_view value) {
+        for (auto& h : this->_rep->headers) {
+            if (iequals(h.name, name)) {
+                h.value = value;
+                return;
+            }
+        }
+        this->_rep->headers.push_back({std::string(name), std::string(value)});
+    }
+
+    bool whz_LUA_reply::has_header(std::string_view name) const {
+        return std::ranges::any_of(this->_rep->headers, [name](const header& h) { return iequals(h.name, name); });
+    }
+
+} // whz
@@ -0,0 +1,65 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "whz_common.hpp"
+
+namespace whz {
+
+    /**
+     * @brief Read-only view of a parsed request as LUA sees it (usertype "whz_request"). Nothing is converted up
+     * front: a field becomes a LUA string only when the script reads it, the query string is split on the first
+     * query() call and a value is only decoded when asked for. The request must outlive the view.
+     *
+     */
+    class whz_LUA_request {
+    public:
+        explicit whz_LUA_request(const request& req) : _req(&req) {}
+
+        [[nodiscard]] std::string_view method() const { return _req->method; }
+        /// The URI without the query string, not decoded
+        [[nodiscard]] std::string_view path() const;
+        /// The raw query string after '?', empty if there is none
+        [[nodiscard]] std::string_view query_string() const;
+        /// Value of the first header with this name, compared case-insensitively
+        [[nodiscard]] std::optional<std::string_view> header(std::string_view name) const;
+        /// Decoded value of the first query parameter with this name
+        [[nodiscard]] std::optional<std::string> query(std::string_view name) const;
+        [[nodiscard]] int http_version_major() const { return _req->http_version_major; }
+        [[nodiscard]] int http_version_minor() const { return _req->http_version_minor; }
+
+    private:
+        const request* _req;
+        mutable bool _query_split = false;
+        mutable std::vector<std::pair<std::string_view, std::string_view>> _query;  /// Raw name/value pairs
+    };
+
+    /**
+     * @brief Writable view of the reply for LUA (usertype "whz_reply"). write() appends the LUA string straight to the
+     * reply body, without an intermediate copy. The reply must outlive the view.
+     *
+     */
+    class whz_LUA_reply {
+    public:
+        explicit whz_LUA_reply(reply& rep) : _rep(&rep) {}
+
+        void write(std::string_view chunk) { _rep->content.append(chunk); }
+        void set_status(int status) { _rep->status = static_cast<reply::status_type>(status); }
+        [[nodiscard]] int status() const { return _rep->status; }
+        /// Replace the header with this name, or add it
+        void set_header(std::string_view name, std::string_view value);
+        /// True if the reply has a header with this name, compared case-insensitively
+        [[nodiscard]] bool has_header(std::string_view name) const;
+        [[nodiscard]] std::size_t size() const { return _rep->content.size(); }
+
+    private:
+        reply* _rep;
+    };
+
+} // whz
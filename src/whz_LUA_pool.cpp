@@ -0,0 +1,268 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_LUA_pool.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include "whz_config.hpp"
+#include "whz_LUA_core.hpp"
+#include "whz_LUA_bytecode.hpp"
+#include "whz_metrics.hpp"
+
+namespace whz {
+
+    namespace {
+        // The state this thread got last, per pool. Reusing it keeps the state's caches and JIT traces warm.
+        struct state_affinity {
+            std::uint64_t pool_id = 0;
+            whz_LUA_state* state = nullptr;
+        };
+        thread_local state_affinity tls_affinity;
+    }
+
+    whz_LUA_state::whz_LUA_state(std::size_t memory_limit)
+            : _memory(memory_limit), _lua(sol::default_at_panic, &whz_LUA_state::allocate, &_memory) {
+        whz_LUA_gc::configure(this->_lua.lua_state());
+    }
+
+    /**
+     * @brief The lua_Alloc of the pooled states. For a new block Lua passes the object type in osize, not a size.
+     * Shrinking and freeing always succeed, growing fails above the limit, which Lua turns into a memory error.
+     *
+     */
+    void* whz_LUA_state::allocate(void* ud, void* ptr, std::size_t osize, std::size_t nsize) {
+        auto* memory = static_cast<memory_account*>(ud);
+        const std::size_t old_size = ptr ? osize : 0;
+
+        if (nsize == 0) {
+            std::free(ptr);
+            memory->used.fetch_sub(old_size, std::memory_order_relaxed);
+            return nullptr;
+        }
+        const std::size_t used = memory->used.load(std::memory_order_relaxed);
+        if (memory->limit != 0 && nsize > old_size && used - old_size + nsize > memory->limit) {
+            return nullptr;
+        }
+        void* block = std::realloc(ptr, nsize);
+        if (!block) {
+            return nullptr;
+        }
+        const std::size_t now = memory->used.fetch_add(nsize - old_size, std::memory_order_relaxed) + nsize - old_size;
+        if (now > memory->peak.load(std::memory_order_relaxed)) {
+            memory->peak.store(now, std::memory_order_relaxed); // Only the thread using the state allocates
+        }
+        return block;
+    }
+
+    whz_LUA_pool_options whz_LUA_pool::options_from_config(std::size_t io_threads) {
+        whz_LUA_pool_options options;
+        const auto& script_path = Config::get<Config::ConfigParameter::LUA_SCRIPT_PATH>();
+        const auto& script_name = Config::get<Config::ConfigParameter::LUA_START_SCRIPT_FILENAME>();
+        options.startup_script = script_path.empty() ? std::filesystem::path(script_name)
+                                                     : std::filesystem::path(script_path) / script_name;
+        options.threads = io_threads;
+        options.states_per_thread = Config::get<Config::ConfigParameter::LUA_STATES_PER_THREAD>();
+        options.memory_limit_mb = Config::get<Config::ConfigParameter::LUA_STATE_MEMORY_LIMIT_MB>();
+        options.gc_step_kb = whz_LUA_gc::step_kb_from_config();
+        options.gc_idle_budget = whz_LUA_gc::idle_budget_from_config();
+        return options;
+    }
+
+    /**
+     * @brief Create the pool. The startup script is read once and then run in every state, so all states offer the
+     * same functions and globals. A state that fails to run it fails the whole pool, a half initialized pool would
+     * behave differently depending on which state a request gets.
+     *
+     * @param options The pool settings
+     * @return The pool or an error message
+     */
+    std::expected<std::shared_ptr<whz_LUA_pool>, std::string> whz_LUA_pool::create(const whz_LUA_pool_options& options) {
+        std::ifstream ifs(options.startup_script, std::ios::in | std::ios::binary);
+        if (!ifs) {
+            return std::unexpected("Could not open LUA startup script: " + options.startup_script.string());
+        }
+        const std::string script((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+        const std::size_t state_count = std::max<std::size_t>(1, options.threads) *
+                                        std::max<std::size_t>(1, options.states_per_thread);
+
+        // Parsed once, all states start from the same bytecode
+        const std::string chunk_name = "@" + options.startup_script.string();
+        auto& bytecode_cache = whz_LUA_bytecode_cache::getInstance();
+        if (auto compiled = bytecode_cache.bytecode(script, chunk_name); !compiled) {
+            return std::unexpected("Error compiling the LUA startup script: " + compiled.error());
+        }
+
+        std::shared_ptr<whz_LUA_pool> pool(new whz_LUA_pool());
+        pool->_states_per_thread = std::max<std::size_t>(1, options.states_per_thread);
+        pool->_gc_step_kb = options.gc_step_kb;
+        pool->_gc_idle_budget = options.gc_idle_budget;
+        pool->_gc_full_collect_percent = options.gc_full_collect_percent;
+        pool->_states.reserve(state_count);
+        for (std::size_t i = 0; i < state_count; ++i) {
+            auto state = std::make_unique<whz_LUA_state>(options.memory_limit_mb * 1024 * 1024);
+            try {
+                whz_LUA_core::open_LUA_libraries(state->_lua);
+                if (auto ran = bytecode_cache.run(state->_lua, script, chunk_name); !ran) {
+                    return std::unexpected("Error running the LUA startup script (" + options.startup_script.string() +
+                                           "): " + ran.error());
+                }
+            } catch (const std::exception& e) {
+                return std::unexpected("Error running the LUA startup script (" + options.startup_script.string() +
+                                       "): " + e.what());
+            }
+            pool->_states.push_back(std::move(state));
+        }
+        pool->_free_count = pool->_states.size();
+        return pool;
+    }
+
+    whz_LUA_pool::lease whz_LUA_pool::acquire() {
+        std::unique_lock lock(this->_mutex);
+        whz_LUA_state* state = nullptr;
+
+        if (tls_affinity.pool_id == this->_pool_id && !tls_affinity.state->_in_use) {
+            state = tls_affinity.state;
+        } else {
+            this->_state_returned.wait(lock, [this] { return this->_free_count > 0; });
+            for (const auto& candidate : this->_states) {
+                if (!candidate->_in_use) {
+                    state = candidate.get();
+                    break;
+                }
+            }
+            tls_affinity = {this->_pool_id, state};
+        }
+        state->_in_use = true;
+        --this->_free_count;
+        return lease(*this, state);
+    }
+
+    std::optional<whz_LUA_pool::lease> whz_LUA_pool::try_acquire() {
+        std::lock_guard lock(this->_mutex);
+        for (const auto& candidate : this->_states) {
+            if (!candidate->_in_use) {
+                candidate->_in_use = true;
+                --this->_free_count;
+                return lease(*this, candidate.get());
+            }
+        }
+        return std::nullopt;
+    }
+
+    whz_LUA_state* whz_LUA_pool::thread_state(boost::asio::io_context& io, const std::shared_ptr<whz_db_pool>& db_pool) {
+        if (_thread_binding.pool_id != this->_pool_id) {
+            _thread_binding = {this->_pool_id, bind_thread(io, db_pool)};
+        }
+        thread_binding* binding = _thread_binding.binding;
+        if (binding == nullptr) {
+            return nullptr;
+        }
+        binding->idle_gc->touch();
+        whz_LUA_state* state = *std::ranges::min_element(binding->states, {}, [](whz_LUA_state* candidate) {
+            return candidate->_api.in_flight();
+        });
+        state->_requests.fetch_add(1, std::memory_order_relaxed);
+        return state;
+    }
+
+    whz_LUA_pool::thread_binding* whz_LUA_pool::bind_thread(boost::asio::io_context& io,
+                                                            const std::shared_ptr<whz_db_pool>& db_pool) {
+        auto binding = std::make_unique<thread_binding>();
+        {
+            std::lock_guard lock(this->_mutex);
+            if (this->_free_count < this->_states_per_thread) {
+                return nullptr;
+            }
+            for (const auto& candidate : this->_states) {
+                if (!candidate->_in_use && binding->states.size() < this->_states_per_thread) {
+                    candidate->_in_use = true; // For good, acquire() doesn't hand it out anymore
+                    --this->_free_count;
+                    binding->states.push_back(candidate.get());
+                }
+            }
+        }
+        // Only this thread uses the states from now on, their API and GC run on its io_context
+        for (whz_LUA_state* state : binding->states) {
+            state->_api.init(state->_lua, io, db_pool, false);
+        }
+        binding->idle_gc = std::make_unique<whz_LUA_idle_trigger>(io, [this] { return collect_idle(); });
+
+        std::lock_guard lock(this->_mutex);
+        return this->_bindings.emplace_back(std::move(binding)).get();
+    }
+
+    bool whz_LUA_pool::collect_idle() {
+        if (_thread_binding.pool_id != this->_pool_id || _thread_binding.binding == nullptr) {
+            return false; // No states of this thread
+        }
+        return collect(*_thread_binding.binding);
+    }
+
+    bool whz_LUA_pool::collect(thread_binding& binding) {
+        bool unfinished = false;
+        for (whz_LUA_state* state : binding.states) {
+            const std::size_t limit = state->memory_limit();
+            if (limit != 0 && state->memory_used() > limit / 100 * this->_gc_full_collect_percent) {
+                whz_LUA_gc::full_collect(state->_lua.lua_state(), state->_gc);
+            } else if (!whz_LUA_gc::idle_step(state->_lua.lua_state(), this->_gc_step_kb, this->_gc_idle_budget,
+                                              state->_gc)) {
+                unfinished = true;
+            }
+        }
+        return unfinished;
+    }
+
+    void whz_LUA_pool::release(whz_LUA_state* state) {
+        state->_requests.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard lock(this->_mutex);
+            state->_in_use = false;
+            ++this->_free_count;
+        }
+        this->_state_returned.notify_one();
+    }
+
+    void whz_LUA_pool::register_metrics(const std::shared_ptr<whz_LUA_pool>& pool) {
+        auto& registry = whz_metrics::getInstance();
+        const std::weak_ptr<whz_LUA_pool> weak = pool;
+        // Summed over the states on every scrape, the counters are kept by the states anyway
+        const auto sum = [weak](std::atomic<std::uint64_t> whz_LUA_gc_stats::*counter, double scale = 1.0) {
+            return [weak, counter, scale] {
+                double total = 0;
+                if (auto alive = weak.lock()) {
+                    for (const auto& state : alive->_states) {
+                        total += static_cast<double>((state->_gc.*counter).load(std::memory_order_relaxed));
+                    }
+                }
+                return total * scale;
+            };
+        };
+        registry.counter_callback("whz_lua_gc_idle_slices_total", "Idle slices that did Lua GC work", {},
+                                  sum(&whz_LUA_gc_stats::idle_slices));
+        registry.counter_callback("whz_lua_gc_steps_total", "Incremental Lua GC steps run in idle slices", {},
+                                  sum(&whz_LUA_gc_stats::steps));
+        registry.counter_callback("whz_lua_gc_cycles_total", "Lua GC cycles finished in idle slices", {},
+                                  sum(&whz_LUA_gc_stats::cycles));
+        registry.counter_callback("whz_lua_gc_full_collections_total",
+                                  "Full Lua collections of states above the heap limit share", {},
+                                  sum(&whz_LUA_gc_stats::full_collections));
+        registry.counter_callback("whz_lua_gc_seconds_total", "Time spent in the Lua GC outside of requests", {},
+                                  sum(&whz_LUA_gc_stats::gc_time_ns, 1e-9));
+        registry.gauge_callback("whz_lua_memory_bytes", "Memory allocated by the pooled Lua states", {}, [weak] {
+            auto alive = weak.lock();
+            return alive ? static_cast<double>(alive->memory_used()) : 0.0;
+        });
+    }
+
+    std::size_t whz_LUA_pool::memory_used() const {
+        std::size_t total = 0;
+        for (const auto& state : this->_states) {
+            total += state->memory_used();
+        }
+        return total;
+    }
+
+} // whz
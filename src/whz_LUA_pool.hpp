@@ -0,0 +1,186 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#define SOL_ALL_SAFETIES_ON 1
+#include <sol/sol.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "whz_LUA_api.hpp"
+#include "whz_LUA_gc.hpp"
+
+namespace whz {
+
+    /**
+     * @brief One Lua state of a whz_LUA_pool. The state allocates through its own allocator, which keeps track of the
+     * memory in use and refuses allocations above the limit. Lua then raises a memory error in the script instead of
+     * letting one runaway request take all memory of the process.
+     *
+     */
+    class whz_LUA_state {
+    public:
+        explicit whz_LUA_state(std::size_t memory_limit);
+        whz_LUA_state(const whz_LUA_state&) = delete;
+        whz_LUA_state& operator=(const whz_LUA_state&) = delete;
+
+        sol::state& lua() { return _lua; }
+
+        /// Memory allocated by the state in bytes. Can be read from any thread, e.g. for metrics.
+        [[nodiscard]] std::size_t memory_used() const { return _memory.used.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::size_t memory_peak() const { return _memory.peak.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::size_t memory_limit() const { return _memory.limit; }
+        [[nodiscard]] std::uint64_t requests_served() const { return _requests.load(std::memory_order_relaxed); }
+        [[nodiscard]] const whz_LUA_gc_stats& gc_stats() const { return _gc; }
+
+        /// The API handlers run through, set up once the state is bound to an io thread by whz_LUA_pool::thread_state()
+        whz_LUA_api& api() { return _api; }
+
+    private:
+        friend class whz_LUA_pool;
+
+        struct memory_account {
+            explicit memory_account(std::size_t memory_limit) : limit(memory_limit) {}
+            std::atomic<std::size_t> used{0};
+            std::atomic<std::size_t> peak{0};
+            std::size_t limit = 0;  /// 0 = unlimited
+        };
+
+        // lua_Alloc of the state, ud is the memory_account
+        static void* allocate(void* ud, void* ptr, std::size_t osize, std::size_t nsize);
+
+        memory_account _memory;     /// Before _lua, the state allocates through it until it's closed
+        sol::state _lua;
+        bool _in_use = false;       /// Guarded by the mutex of the owning pool, for good once bound to a thread
+        std::atomic<std::uint64_t> _requests{0};
+        whz_LUA_gc_stats _gc;
+        whz_LUA_api _api;           /// After _lua, it refers to the state
+    };
+
+    /// Settings of a whz_LUA_pool, see whz_LUA_pool::options_from_config() for the matching config parameters
+    struct whz_LUA_pool_options {
+        std::filesystem::path startup_script;   /// Lua script run in every state once, defines the handlers
+        std::size_t threads = 1;                /// Number of io threads using the pool
+        std::size_t states_per_thread = 1;      /// States per io thread, the thread's handlers are spread over them
+        std::size_t memory_limit_mb = 0;        /// Memory limit of each state in MB, 0 = unlimited
+        std::size_t gc_step_kb = 1024;          /// Work of one GC step in an idle slice, in KB of allocation
+        std::chrono::microseconds gc_idle_budget{500};  /// Time one idle slice may spend in the GC of one state
+        unsigned gc_full_collect_percent = 75;  /// A state above this share of its limit gets a full collection
+    };
+
+    /**
+     * @brief A set of Lua states, all initialized from the same startup script. A sol::state can't be used by two
+     * threads at once. Request handlers get the states of their io thread from thread_state(): the thread's share of
+     * the states is bound to it on its first request, and any number of handlers run in them at the same time as
+     * coroutines, a handler waiting in whz.sleep or whz.db_query doesn't hold up the others. Their GC runs once the
+     * thread is idle. The states no thread is bound to can be checked out with acquire() for work outside of the io
+     * threads, like the database pool a thread gets the same state back as long as it's free.
+     *
+     */
+    class whz_LUA_pool {
+    public:
+        /// RAII handle to a checked out state, returns it to the pool on destruction
+        class lease {
+        public:
+            lease(whz_LUA_pool& pool, whz_LUA_state* state) : _pool(&pool), _state(state) {}
+            lease(lease&& other) noexcept : _pool(other._pool), _state(std::exchange(other._state, nullptr)) {}
+            lease(const lease&) = delete;
+            lease& operator=(const lease&) = delete;
+            lease& operator=(lease&&) = delete;
+            ~lease() { if (_state) { _pool->release(_state); } }
+
+            whz_LUA_state* operator->() const { return _state; }
+            whz_LUA_state& operator*() const { return *_state; }
+
+        private:
+            whz_LUA_pool* _pool;
+            whz_LUA_state* _state;
+        };
+
+        /// Creates all states and runs the startup script in each, fails if the script can't be read or fails
+        static std::expected<std::shared_ptr<whz_LUA_pool>, std::string> create(const whz_LUA_pool_options& options);
+        /// The pool settings from the LUA_* parameters of the loaded config, with states for io_threads threads
+        static whz_LUA_pool_options options_from_config(std::size_t io_threads);
+        /// Export the GC counters and the memory of all states of the pool as gauges in whz_metrics
+        static void register_metrics(const std::shared_ptr<whz_LUA_pool>& pool);
+
+        whz_LUA_pool(const whz_LUA_pool&) = delete;
+        whz_LUA_pool& operator=(const whz_LUA_pool&) = delete;
+        ~whz_LUA_pool() = default;
+
+        /**
+         * @brief The state to run a request handler of the calling io thread in. On the first call of a thread
+         * states_per_thread free states are bound to it and to io, from then on only this thread uses them. Of these
+         * the one with the fewest handlers in flight is returned. Every call counts as activity of the thread, their
+         * GC waits until the thread was idle for a moment.
+         *
+         * @return The state, nullptr if there were no free states left to bind to the thread
+         */
+        [[nodiscard]] whz_LUA_state* thread_state(boost::asio::io_context& io, const std::shared_ptr<whz_db_pool>& db_pool);
+
+        /// Check out a state no io thread is bound to, preferably the one of the calling thread. Waits if all are in use.
+        [[nodiscard]] lease acquire();
+        /// Check out a free state no io thread is bound to if there is one, without waiting
+        [[nodiscard]] std::optional<lease> try_acquire();
+
+        /**
+         * @brief Give the GC of the states bound to the calling thread an idle slice each, states above their soft heap
+         * limit get a full collection instead. Run by the idle trigger of the thread, never in the middle of a request
+         * and never for the states of another thread.
+         *
+         * @return True if a GC cycle of one of the states isn't finished yet
+         */
+        bool collect_idle();
+        [[nodiscard]] std::size_t size() const { return _states.size(); }
+        /// Sum of the memory of all states in bytes
+        [[nodiscard]] std::size_t memory_used() const;
+        /// The state at this index, for metrics only, it may be in use by another thread
+        [[nodiscard]] const whz_LUA_state& state_at(std::size_t index) const { return *_states[index]; }
+
+    private:
+        /// The states bound to one io thread, used by that thread only
+        struct thread_binding {
+            std::vector<whz_LUA_state*> states;
+            std::unique_ptr<whz_LUA_idle_trigger> idle_gc;
+        };
+
+        whz_LUA_pool() = default;
+        void release(whz_LUA_state* state);
+
+        // Bind free states to the calling thread, nullptr if there aren't enough
+        thread_binding* bind_thread(boost::asio::io_context& io, const std::shared_ptr<whz_db_pool>& db_pool);
+        // GC slices for the states of the binding, true if a cycle is unfinished
+        bool collect(thread_binding& binding);
+
+        const std::uint64_t _pool_id = _next_pool_id.fetch_add(1);  /// Identifies the pool in the thread affinity
+        std::size_t _states_per_thread = 1;
+        std::size_t _gc_step_kb = 1024;
+        std::chrono::microseconds _gc_idle_budget{500};
+        unsigned _gc_full_collect_percent = 75;
+        std::vector<std::unique_ptr<whz_LUA_state>> _states;
+        std::vector<std::unique_ptr<thread_binding>> _bindings;     /// Under _mutex, one per io thread
+        std::size_t _free_count = 0;
+        std::mutex _mutex;
+        std::condition_variable _state_returned;
+
+        /// The binding of this thread and the pool it belongs to, a null binding if the pool had no states left for it.
+        /// Zero initialized like any thread_local.
+        struct thread_slot {
+            std::uint64_t pool_id;
+            thread_binding* binding;
+        };
+        inline static thread_local thread_slot _thread_binding;
+        inline static std::atomic<std::uint64_t> _next_pool_id{1};
+    };
+
+} // whz
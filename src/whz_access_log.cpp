@@ -0,0 +1,200 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include "whz_access_log.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fmt/format.h"
+#include "whz_config.hpp"
+
+namespace whz {
+
+    whz_access_log::ring::ring(std::size_t capacity)
+            : _records(std::make_unique<access_record[]>(std::bit_ceil(std::max<std::size_t>(capacity, 2)))),
+              _mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1) {}
+
+    bool whz_access_log::ring::push(const access_record& entry) {
+        const std::uint64_t tail = _tail.load(std::memory_order_relaxed);
+        const std::uint64_t used = tail - _head.load(std::memory_order_acquire);
+        if (used > _mask) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _records[tail & _mask] = entry;
+        _tail.store(tail + 1, std::memory_order_release);
+        return used + 1 == (_mask + 1) / 2;
+    }
+
+    whz_access_log::~whz_access_log() {
+        stop();
+    }
+
+    whz_access_log_options whz_access_log::options_from_config() {
+        whz_access_log_options options;
+        options.path = Config::get<Config::ConfigParameter::ACCESS_LOG_PATH>();
+        if (Config::get<Config::ConfigParameter::ACCESS_LOG_FORMAT>() == "clf") {
+            options.format = whz_access_log_options::file_format::clf;
+        }
+        options.rotation_mb = Config::get<Config::ConfigParameter::ACCESS_LOG_ROTATION_MB>();
+        return options;
+    }
+
+    bool whz_access_log::start(const whz_access_log_options& options) {
+        stop();
+        if (options.path.empty()) {
+            return false;
+        }
+        this->_options = options;
+        {
+            std::lock_guard lock(this->_rings_mutex); // Threads that log for the first time read it in thread_ring()
+            this->_ring_records = options.ring_records;
+        }
+        if (!open_file()) {
+            return false;
+        }
+        this->_writer = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+        this->_enabled.store(true, std::memory_order_relaxed);
+        WHZ_LOG_INFO(this->_qlogger, "Access log started: {}", this->_options.path.string());
+        return true;
+    }
+
+    void whz_access_log::stop() {
+        this->_enabled.store(false, std::memory_order_relaxed);
+        if (this->_writer.joinable()) {
+            this->_writer.request_stop();
+            this->_writer.join();   // The writer drains the rings once more before it returns
+        }
+        if (this->_fd >= 0) {
+            ::close(this->_fd);
+            this->_fd = -1;
+        }
+    }
+
+    std::uint64_t whz_access_log::dropped() const {
+        std::lock_guard lock(this->_rings_mutex);
+        std::uint64_t count = 0;
+        for (const auto& r : this->_rings) {
+            count += r->dropped();
+        }
+        return count;
+    }
+
+    whz_access_log::ring& whz_access_log::thread_ring() {
+        if (_thread_ring == nullptr) [[unlikely]] {
+            std::lock_guard lock(this->_rings_mutex);
+            _thread_ring = this->_rings.emplace_back(std::make_unique<ring>(this->_ring_records)).get();
+        }
+        return *_thread_ring;
+    }
+
+    void whz_access_log::run(std::stop_token stop_token) {
+        std::string buffer;
+        while (!stop_token.stop_requested()) {
+            {
+                std::unique_lock lock(this->_wake_mutex);
+                this->_wake.wait_for(lock, stop_token, this->_options.flush_interval, [this] {
+                    return this->_drain_requested.exchange(false, std::memory_order_relaxed);
+                });
+            }
+            if (drain(buffer) > 0) {
+                write_batch(buffer);
+            }
+        }
+        // Records logged until stop() turned the log off
+        if (drain(buffer) > 0) {
+            write_batch(buffer);
+        }
+    }
+
+    std::size_t whz_access_log::drain(std::string& buffer) {
+        std::lock_guard lock(this->_rings_mutex);
+        std::size_t count = 0;
+        for (auto& r : this->_rings) {
+            if (this->_options.format == whz_access_log_options::file_format::clf) {
+                count += r->drain([&buffer](const access_record& entry) { append_clf(buffer, entry); });
+            } else {
+                count += r->drain([&buffer](const access_record& entry) { access_log_binary::append(buffer, entry); });
+            }
+        }
+        this->_written.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    void whz_access_log::write_batch(std::string& buffer) {
+        std::size_t offset = 0;
+        while (offset < buffer.size() && this->_fd >= 0) {
+            const ssize_t n = ::write(this->_fd, buffer.data() + offset, buffer.size() - offset);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                WHZ_LOG_ERROR(this->_qlogger, "Access log write to {} failed: {}", this->_options.path.string(),
+                              std::strerror(errno));
+                break;
+            }
+            offset += static_cast<std::size_t>(n);
+        }
+        this->_file_bytes += offset;
+        buffer.clear();
+
+        if (this->_options.rotation_mb > 0 && this->_file_bytes >= this->_options.rotation_mb * 1024 * 1024) {
+            rotate();
+        }
+    }
+
+    bool whz_access_log::open_file() {
+        this->_fd = ::open(this->_options.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+        if (this->_fd < 0) {
+            WHZ_LOG_ERROR(this->_qlogger, "Access log {} not opened: {}", this->_options.path.string(),
+                          std::strerror(errno));
+            return false;
+        }
+        struct stat st{};
+        this->_file_bytes = ::fstat(this->_fd, &st) == 0 ? static_cast<std::uint64_t>(st.st_size) : 0;
+        if (this->_file_bytes == 0 && this->_options.format == whz_access_log_options::file_format::binary) {
+            const auto& magic = access_log_binary::magic;
+            if (::write(this->_fd, magic.data(), magic.size()) == static_cast<ssize_t>(magic.size())) {
+                this->_file_bytes = magic.size();
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Rename the full file to <path>.<YYYYmmdd-HHMMSS>[-n] and continue in a new one. On failure the log goes on in
+     * the full file.
+     *
+     */
+    void whz_access_log::rotate() {
+        const std::time_t now = std::time(nullptr);
+        std::tm local{};
+        ::localtime_r(&now, &local);
+        char suffix[32];
+        std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &local);
+
+        auto rotated = this->_options.path;
+        rotated += suffix;
+        for (int i = 1; std::filesystem::exists(rotated); ++i) {   // Rotated twice within a second
+            rotated = this->_options.path;
+            rotated += fmt::format("{}-{}", suffix, i);
+        }
+        std::error_code ec;
+        std::filesystem::rename(this->_options.path, rotated, ec);
+        if (ec) {
+            WHZ_LOG_ERROR(this->_qlogger, "Access log rotation of {} failed: {}", this->_options.path.string(),
+                          ec.message());
+            this->_file_bytes = 0;  // Retry after the next rotation_mb
+            return;
+        }
+        ::close(this->_fd);
+        this->_fd = -1;
+        open_file();
+    }
+
+} // whz
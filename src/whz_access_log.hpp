@@ -0,0 +1,130 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "whz_access_log_format.hpp"
+#include "whz_quill_wrapper.hpp"
+
+namespace whz {
+
+    /// Settings of the access log, see whz_access_log::options_from_config() for the matching config parameters
+    struct whz_access_log_options {
+        enum class file_format { binary, clf };
+
+        std::filesystem::path path;             /// The log file, empty turns the access log off
+        file_format format = file_format::binary;
+        std::size_t rotation_mb = 100;          /// Rotate the file when it gets bigger, 0 = never
+        std::size_t ring_records = 4096;        /// Records buffered per thread, rounded up to a power of two
+        std::chrono::milliseconds flush_interval{200};  /// How often the writer drains the buffers
+    };
+
+    /**
+     * @brief Singleton access log, one record per request. Every io thread writes its records into its own lock-free
+     * ring, a request costs a copy of the record and two atomic operations. A writer thread drains all rings every
+     * flush interval, or earlier when a ring is half full, and writes the batch with one write() call, either as compact binary records (see
+     * whz_access_log_format.hpp, decode with whz-accesslog) or as Common Log Format lines.
+     *
+     * A full ring drops the record and counts it, the request is never held up by the log.
+     *
+     */
+    class whz_access_log {
+    public:
+        whz_access_log(const whz_access_log&) = delete;
+        whz_access_log& operator=(const whz_access_log&) = delete;
+
+        static whz_access_log& getInstance() {
+            static whz_access_log instance;
+            return instance;
+        }
+
+        /// The options from ACCESS_LOG_PATH, ACCESS_LOG_FORMAT and ACCESS_LOG_ROTATION_MB of the loaded config
+        static whz_access_log_options options_from_config();
+
+        /// Open the file and start the writer thread, true if the log runs. An empty path leaves it off.
+        bool start(const whz_access_log_options& options);
+        /// Write what's buffered and stop the writer thread
+        void stop();
+
+        [[nodiscard]] bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+        /// Log one request, from any thread. Does nothing if the log is off.
+        void record(const access_record& entry) {
+            if (is_enabled() && thread_ring().push(entry)) {
+                _drain_requested.store(true, std::memory_order_relaxed);
+                _wake.notify_one();
+            }
+        }
+
+        /// Records dropped because the ring of their thread was full
+        [[nodiscard]] std::uint64_t dropped() const;
+        [[nodiscard]] std::uint64_t written() const { return _written.load(std::memory_order_relaxed); }
+
+    private:
+        // Single producer (the owning thread), single consumer (the writer thread) ring of records
+        class ring {
+        public:
+            explicit ring(std::size_t capacity);
+            // Add the record, true when the ring just got half full and the writer should drain it early
+            bool push(const access_record& entry);
+            // Hand all records to the sink, consumer only
+            template <typename Sink>
+            std::size_t drain(Sink&& sink) {
+                const std::uint64_t head = _head.load(std::memory_order_relaxed);
+                const std::uint64_t tail = _tail.load(std::memory_order_acquire);
+                for (std::uint64_t i = head; i != tail; ++i) {
+                    sink(_records[i & _mask]);
+                }
+                _head.store(tail, std::memory_order_release);
+                return static_cast<std::size_t>(tail - head);
+            }
+            [[nodiscard]] std::uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+        private:
+            std::unique_ptr<access_record[]> _records;
+            std::uint64_t _mask;
+            alignas(64) std::atomic<std::uint64_t> _head{0};    /// Next record to read, written by the consumer
+            alignas(64) std::atomic<std::uint64_t> _tail{0};    /// Next slot to write, written by the producer
+            std::atomic<std::uint64_t> _dropped{0};
+        };
+
+        whz_access_log() = default;
+        ~whz_access_log();
+
+        // The ring of the calling thread, created on its first record
+        ring& thread_ring();
+        void run(std::stop_token stop_token);
+        // Move the records of all rings into the buffer in the file format
+        std::size_t drain(std::string& buffer);
+        void write_batch(std::string& buffer);
+        bool open_file();
+        void rotate();
+
+        whz_access_log_options _options;
+        std::atomic<bool> _enabled{false};
+        mutable std::mutex _rings_mutex;            /// Guards _rings and _ring_records, taken once per thread and per drain
+        std::vector<std::unique_ptr<ring>> _rings;  /// Kept until the end, a thread may still hold its ring
+        std::size_t _ring_records = 4096;           /// Size of the rings created from now on
+        int _fd = -1;                               /// Writer thread only while it runs
+        std::uint64_t _file_bytes = 0;
+        std::atomic<std::uint64_t> _written{0};
+        std::mutex _wake_mutex;
+        std::condition_variable_any _wake;
+        std::atomic<bool> _drain_requested{false};  /// A ring got half full, set before _wake is notified
+        std::jthread _writer;
+        whz::whz_qlogger _qlogger{"access_log"};
+
+        inline static thread_local ring* _thread_ring = nullptr;   /// The ring of this thread, the log is a singleton
+    };
+
+} // whz
@@ -0,0 +1,92 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include "whz_access_log_format.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <type_traits>
+#include <arpa/inet.h>
+#include "fmt/format.h"
+
+namespace whz {
+
+    static_assert(std::is_trivially_copyable_v<access_record>, "access_record is copied with memcpy");
+    static_assert(access_log_binary::record_header == 56, "The binary access log format changed");
+
+    namespace {
+        constexpr std::array<std::string_view, 10> MethodNames{
+                "-", "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+    }
+
+    access_method access_method_from(std::string_view method) {
+        for (std::size_t i = 1; i < MethodNames.size(); ++i) {
+            if (MethodNames[i] == method) {
+                return static_cast<access_method>(i);
+            }
+        }
+        return access_method::other;
+    }
+
+    std::string_view access_method_name(access_method method) {
+        const auto index = static_cast<std::size_t>(method);
+        return index < MethodNames.size() ? MethodNames[index] : MethodNames[0];
+    }
+
+    void access_record::set_path(std::string_view request_path) {
+        this->path_length = static_cast<std::uint16_t>(std::min(request_path.size(), max_path));
+        std::memcpy(this->path.data(), request_path.data(), this->path_length);
+    }
+
+    std::string access_record::peer_string() const {
+        static constexpr std::array<std::uint8_t, 12> V4Mapped{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+        char text[INET6_ADDRSTRLEN] = {};
+        if (std::equal(V4Mapped.begin(), V4Mapped.end(), this->peer_address.begin())) {
+            ::inet_ntop(AF_INET, this->peer_address.data() + 12, text, sizeof(text));
+        } else {
+            ::inet_ntop(AF_INET6, this->peer_address.data(), text, sizeof(text));
+        }
+        return text;
+    }
+
+    namespace access_log_binary {
+        void append(std::string &buffer, const access_record &record) {
+            const auto *bytes = reinterpret_cast<const char *>(&record);
+            buffer.append(bytes, record_header);
+            buffer.append(record.path.data(), record.path_length);
+        }
+
+        std::optional<std::pair<access_record, std::size_t>> decode(std::span<const char> data) {
+            if (data.size() < record_header) {
+                return std::nullopt;
+            }
+            access_record record;
+            std::memcpy(static_cast<void *>(&record), data.data(), record_header);
+            if (record.path_length > access_record::max_path || data.size() < record_header + record.path_length) {
+                return std::nullopt;
+            }
+            std::memcpy(record.path.data(), data.data() + record_header, record.path_length);
+            return std::make_pair(record, record_header + record.path_length);
+        }
+    }
+
+    /**
+     * @brief host ident authuser [date] "request" status bytes, followed by the latency in microseconds. The time is
+     * written in UTC, the request line has no protocol version as the record doesn't keep it.
+     *
+     */
+    void append_clf(std::string &buffer, const access_record &record) {
+        static constexpr std::array<std::string_view, 12> Months{
+                "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+        const auto seconds = static_cast<std::time_t>(record.timestamp_ns / 1'000'000'000);
+        std::tm utc{};
+        ::gmtime_r(&seconds, &utc);
+
+        fmt::format_to(std::back_inserter(buffer), "{} - - [{:02}/{}/{:04}:{:02}:{:02}:{:02} +0000] \"{} {}\" {} {} {}\n",
+                       record.peer_string(), utc.tm_mday, Months[utc.tm_mon], utc.tm_year + 1900, utc.tm_hour,
+                       utc.tm_min, utc.tm_sec, access_method_name(record.method), record.path_view(), record.status,
+                       record.bytes_out, record.latency_ns / 1000);
+    }
+
+} // whz
@@ -0,0 +1,71 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace whz {
+
+    /// HTTP method of an access log record, stored as one byte
+    enum class access_method : std::uint8_t {
+        other = 0, get, head, post, put, del, connect, options, trace, patch
+    };
+
+    [[nodiscard]] access_method access_method_from(std::string_view method);
+    [[nodiscard]] std::string_view access_method_name(access_method method);
+
+    /**
+     * @brief One request in the access log. The record has a fixed size so the per-thread rings are plain arrays, the
+     * path is cut at max_path bytes. In the binary file only the used part of the path is written.
+     *
+     */
+    struct access_record {
+        static constexpr std::size_t max_path = 200;
+
+        std::uint64_t timestamp_ns = 0;     /// Time the request started, nanoseconds since the epoch
+        std::uint64_t latency_ns = 0;       /// From the first byte read to the last byte written
+        std::uint64_t bytes_in = 0;         /// Bytes read from the client
+        std::uint64_t bytes_out = 0;        /// Bytes written to the client
+        std::array<std::uint8_t, 16> peer_address{};    /// IPv6, IPv4 peers are stored IPv4-mapped (::ffff:a.b.c.d)
+        std::uint16_t peer_port = 0;
+        std::uint16_t status = 0;
+        access_method method = access_method::other;
+        std::uint8_t reserved = 0;
+        std::uint16_t path_length = 0;
+        std::array<char, max_path> path{};
+
+        void set_path(std::string_view request_path);
+        [[nodiscard]] std::string_view path_view() const { return {path.data(), path_length}; }
+        [[nodiscard]] std::string peer_string() const;
+    };
+
+    /**
+     * @brief The binary access log format. A file starts with the 8 byte magic, followed by the records: the fixed
+     * fields (binary_record_header bytes, in host byte order) and then path_length bytes of path.
+     *
+     */
+    namespace access_log_binary {
+        inline constexpr std::array<char, 8> magic{'W', 'H', 'Z', 'A', 'L', 'O', 'G', '1'};
+        inline constexpr std::size_t record_header = offsetof(access_record, path);
+
+        /// Append the record in binary form to the buffer
+        void append(std::string &buffer, const access_record &record);
+        /**
+         * @brief Decode the record at the start of data.
+         *
+         * @return The record and the number of bytes it used, nullopt if data doesn't hold a complete record
+         */
+        [[nodiscard]] std::optional<std::pair<access_record, std::size_t>> decode(std::span<const char> data);
+    }
+
+    /// Append the record as a line of the Common Log Format, extended with the latency in microseconds
+    void append_clf(std::string &buffer, const access_record &record);
+
+} // whz
@@ -0,0 +1,91 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace whz {
+
+    /**
+     * @brief Log-linear latency histogram as in HdrHistogram: values below 128 ns are exact, above that every power
+     * of two has 64 buckets, so a percentile is off by less than 1.6% at any magnitude. Up to 2^40 ns (18 minutes).
+     *
+     */
+    class latency_histogram {
+    public:
+        static constexpr unsigned sub_bits = 7;
+        static constexpr unsigned max_bits = 40;
+        static constexpr std::size_t linear = std::size_t{1} << sub_bits;
+        static constexpr std::size_t half = linear / 2;
+
+        latency_histogram() : _counts(linear + (max_bits - sub_bits) * half, 0) {}
+
+        void record(std::uint64_t ns) {
+            ++_counts[index_of(ns)];
+            ++_total;
+            _sum += ns;
+            _max = std::max(_max, ns);
+        }
+
+        void merge(const latency_histogram &other) {
+            for (std::size_t i = 0; i < _counts.size(); ++i) {
+                _counts[i] += other._counts[i];
+            }
+            _total += other._total;
+            _sum += other._sum;
+            _max = std::max(_max, other._max);
+        }
+
+        /// The value at or below which percent of the recorded values are, reported as the upper end of its bucket
+        [[nodiscard]] std::uint64_t percentile(double percent) const {
+            if (_total == 0) {
+                return 0;
+            }
+            const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(
+                    static_cast<double>(_total) * percent / 100.0 + 0.5));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < _counts.size(); ++i) {
+                seen += _counts[i];
+                if (seen >= rank) {
+                    return std::min(upper_bound(i), _max);
+                }
+            }
+            return _max;
+        }
+
+        [[nodiscard]] std::uint64_t total() const { return _total; }
+        [[nodiscard]] std::uint64_t max() const { return _max; }
+        [[nodiscard]] double mean() const { return _total == 0 ? 0.0 : static_cast<double>(_sum) / static_cast<double>(_total); }
+
+    private:
+        static std::size_t index_of(std::uint64_t ns) {
+            ns = std::min(ns, (std::uint64_t{1} << max_bits) - 1);
+            if (ns < linear) {
+                return ns;
+            }
+            // Shift the value into [half, linear), the shift says which power of two it's in
+            const unsigned shift = static_cast<unsigned>(std::bit_width(ns)) - sub_bits;
+            return linear + (shift - 1) * half + static_cast<std::size_t>((ns >> shift) - half);
+        }
+
+        static std::uint64_t upper_bound(std::size_t index) {
+            if (index < linear) {
+                return index;
+            }
+            const std::size_t shift = (index - linear) / half + 1;
+            const std::uint64_t mantissa = (index - linear) % half + half;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+        std::vector<std::uint64_t> _counts;
+        std::uint64_t _total = 0;
+        std::uint64_t _sum = 0;
+        std::uint64_t _max = 0;
+    };
+
+} // whz
@@ -212,3 +212,49 @@ std::string whz::reply_to_string(whz::reply::status_type status) {
       return internal_server_error;
   }
 }
+
+namespace whz::mime_types {
+
+namespace {
+struct mapping {
+  std::string_view extension;
+  std::string_view mime_type;
+};
+
+constexpr mapping mappings[] = {
+    {"html", "text/html"},           {"htm", "text/html"},
+    {"css", "text/css"},             {"js", "text/javascript"},
+    {"json", "application/json"},    {"xml", "application/xml"},
+    {"txt", "text/plain"},           {"svg", "image/svg+xml"},
+    {"png", "image/png"},            {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},          {"gif", "image/gif"},
+    {"webp", "image/webp"},          {"ico", "image/x-icon"},
+    {"wasm", "application/wasm"},    {"pdf", "application/pdf"},
+    {"vcf", "text/vcard"},           {"woff2", "font/woff2"},
+};
+} // namespace
+
+auto extension_to_type(std::string_view extension) -> std::string_view {
+  if (extension.starts_with('.')) {
+    extension.remove_prefix(1);
+  }
+  for (const auto& m : mappings) {
+    if (m.extension == extension) {
+      return m.mime_type;
+    }
+  }
+  return "text/plain";
+}
+
+auto path_to_type(const std::filesystem::path& path) -> std::string_view {
+  auto file = path;
+  if (file.extension() == ".whzt") {
+    file = file.stem(); // A template is served as the type before .whzt, page.json.whzt is JSON
+    if (file.extension().empty()) {
+      return "text/html";
+    }
+  }
+  return extension_to_type(file.extension().string());
+}
+
+} // namespace whz::mime_types
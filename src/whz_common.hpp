@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/buffer.hpp>
@@ -53,4 +55,11 @@ auto to_buffer(whz::reply::status_type status) -> boost::asio::const_buffer;
 
 auto reply_to_string(whz::reply::status_type status) -> std::string;
 
+namespace mime_types {
+/// The Content-Type of a file extension, with or without the dot, text/plain if unknown
+auto extension_to_type(std::string_view extension) -> std::string_view;
+/// The Content-Type of a file, templates (.whzt) by the extension before .whzt and text/html without one
+auto path_to_type(const std::filesystem::path& path) -> std::string_view;
+}
+
 }; // namespace whz
@@ -10,11 +10,87 @@
 #include <fstream>
 #include <filesystem>
 #include <cstdint>
+#include <functional>
 #include <any>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "whz_quill_wrapper.hpp"
 
 namespace whz {
 
+    /**
+     * @brief Every ConfigParameter with its member in config_snapshot, its type, its default and whether a reload
+     * applies it to the running server (live) or it's only read at startup (restart). The default is used when the
+     * key is missing from the file. Keep it in the order of the enum.
+     *
+     */
+#define WHZ_CONFIG_PARAMETERS(X) \
+    X(SERVER_HTTP_PORT, server_http_port, std::uint64_t, 0, restart) \
+    X(SERVER_HTTPS_PORT, server_https_port, std::uint64_t, 0, restart) \
+    X(SERVER_ROOTPATH, server_rootpath, std::string, "", restart) \
+    X(SERVER_LOGPATH, server_logpath, std::string, "", restart) \
+    X(CONNECTION_TIMEOUT_MS, connection_timeout_ms, std::uint64_t, 5000, live) \
+    X(SERVER_DOMAINNAME, server_domainname, std::string, "", restart) \
+    X(SERVER_SSL_CERTPATH, server_ssl_certpath, std::string, "", restart) \
+    X(CONNECTION_MAX_IO_CONTEXTS, connection_max_io_context, std::uint64_t, 100, restart) \
+    X(CONNECTION_USE_IOURING, connection_use_iouring, bool, false, restart) \
+    X(THREADPOOL_SIZE, threadpool_size, std::uint64_t, 0, restart) \
+    X(CPU_CORES, cpu_cores, std::uint64_t, 8, restart) \
+    X(REQUESTS_ACTIVE_MAX, requests_active_max, std::uint64_t, 8, restart) \
+    X(REQUESTS_QUEUED_MAX, requests_queued_max, std::uint64_t, 100, restart) \
+    X(AVAILABLE_NODENAMES, available_nodenames, std::string, "", restart) \
+    X(WHZ_CLI_PATH, whz_cli_path, std::string, "", restart) \
+    X(DATABASE_PATH, database_path, std::string, "database.db", restart) \
+    X(DATABASE_NAME, database_name, std::string, "", restart) \
+    X(DATABASE_USER, database_user, std::string, "", restart) \
+    X(DATABASE_PASSWORD, database_password, std::string, "", restart) \
+    X(DATABASE_PORT, database_port, std::uint64_t, 0, restart) \
+    X(DATABASE_HOST, database_host, std::string, "", restart) \
+    X(DATABASE_ENGINE, database_engine, std::string, "", restart) \
+    X(DATABASE_MMAP_SIZE, database_mmap_size, std::uint64_t, 268435456, restart) \
+    X(DATABASE_CACHE_SIZE_KB, database_cache_size_kb, std::uint64_t, 8192, restart) \
+    X(DATABASE_READ_CONNECTIONS, database_read_connections, std::uint64_t, 0, restart) \
+    X(OUTPUT_CACHE_MAX_MB, output_cache_max_mb, std::uint64_t, 64, live) \
+    X(OUTPUT_CACHE_TTL_S, output_cache_ttl_s, std::uint64_t, 60, live) \
+    X(TEMPLATE_PATH, template_path, std::string, "", restart) \
+    X(TEMPLATE_PACK_PATH, template_pack_path, std::string, "", restart) \
+    X(TEMPLATE_MEMORY_MAP, template_memory_map, bool, false, restart) \
+    X(TEMPLATE_WATCH, template_watch, bool, true, restart) \
+    X(LUA_SCRIPT_PATH, lua_script_path, std::string, "", restart) \
+    X(LUA_START_SCRIPT_FILENAME, lua_start_script_filename, std::string, "", restart) \
+    X(LUA_GC_STEPSIZE, lua_gc_stepsize, std::uint64_t, 1024, restart) \
+    X(LUA_GC_IDLE_BUDGET_US, lua_gc_idle_budget_us, std::uint64_t, 500, restart) \
+    X(LUA_STATES_PER_THREAD, lua_states_per_thread, std::uint64_t, 1, restart) \
+    X(LUA_STATE_MEMORY_LIMIT_MB, lua_state_memory_limit_mb, std::uint64_t, 0, restart) \
+    X(LUA_BYTECODE_CACHE_PATH, lua_bytecode_cache_path, std::string, "", live) \
+    X(LUA_ROUTE_PREFIX, lua_route_prefix, std::string, "/lua/", live) \
+    X(ACCESS_LOG_PATH, access_log_path, std::string, "", live) \
+    X(ACCESS_LOG_FORMAT, access_log_format, std::string, "binary", live) \
+    X(ACCESS_LOG_ROTATION_MB, access_log_rotation_mb, std::uint64_t, 100, live) \
+    X(METRICS_PATH, metrics_path, std::string, "/metrics", live) \
+    X(TRACE_SAMPLE_RATE, trace_sample_rate, std::uint64_t, 0, live) \
+    X(TRACE_PATH, trace_path, std::string, "whz_trace.json", live) \
+    X(TRACE_FORMAT, trace_format, std::string, "chrome", live) \
+    X(SHUTDOWN_DRAIN_TIMEOUT_MS, shutdown_drain_timeout_ms, std::uint64_t, 30000, live) \
+    X(UPGRADE_SOCKET_PATH, upgrade_socket_path, std::string, "", restart) \
+    X(LOG_TRACE_L3, log_trace_L3, bool, false, live) \
+    X(LOG_TRACE_L2, log_trace_L2, bool, false, live) \
+    X(LOG_TRACE_L1, log_trace_L1, bool, false, live) \
+    X(LOG_DEBUG, log_debug, bool, false, live) \
+    X(LOG_INFO, log_info, bool, false, live) \
+    X(LOG_WARNING, log_warning, bool, false, live) \
+    X(LOG_ERROR, log_error, bool, false, live) \
+    X(LOG_CRITICAL, log_critical, bool, false, live) \
+    X(LOG_BACKTRACE, log_backtrace, bool, false, live) \
+    X(LOG_FILENAME, log_filename, std::string, "", restart) \
+    X(LOG_ROTATION_DAYS, log_rotation_days, std::uint64_t, 1, restart) \
+    X(LOG_ROTATION_MB, log_rotation_mb, std::uint64_t, 50, restart) \
+    X(LOG_PATH, log_path, std::string, "", restart)
+
+    struct config_snapshot;
+
     class Config final{
     public:
         // Singleton pattern
@@ -26,7 +102,27 @@ namespace whz {
 
         bool read_config(const std::string& sfilepath = {});
         [[nodiscard]] bool is_config_loaded() const { return m_bConfigLoaded; };
-        bool relaod_config() { return read_config(); };
+        /// Read the file of the last successful read_config() again and publish it as a new snapshot
+        bool relaod_config() { return read_config(config_filepath); };
+
+        /// Outcome of reload(), parameters by name
+        struct reload_report {
+            bool loaded = false;                            /// False keeps the running config, see problems
+            std::vector<std::string> problems;              /// Why the file was rejected
+            std::vector<std::string_view> applied;          /// Changed and applied to the running server
+            std::vector<std::string_view> restart_required; /// Changed, but only read at startup
+        };
+        using reload_listener = std::function<void(const config_snapshot& previous, const config_snapshot& current)>;
+
+        /**
+         * @brief Read the config file again while the server runs, e.g. on SIGHUP. Unlike read_config() a file with
+         * a wrong type or an invalid value is rejected as a whole. A valid one is published and handed to the reload
+         * listeners, which apply the live parameters to their component.
+         *
+         */
+        reload_report reload();
+        /// Called after each successful reload() with the previous and the new snapshot, on the reloading thread
+        void on_reload(reload_listener listener);
 
         enum class ConfigParameter: uint8_t {
             UNKNOWN = 0,            /// Reserved, do not use
@@ -43,7 +139,7 @@ namespace whz {
             SERVER_SSL_CERTPATH,    /// Path to the SSL certificate files (PEM)
             CONNECTION_MAX_IO_CONTEXTS, /// Maximum number of I/O contexts to use in the pool
             CONNECTION_USE_IOURING, /// Use io_uring for async I/O, else use epoll
-            THREADPOOL_SIZE,        /// Number of threads in the thread pool for handling requests
+            THREADPOOL_SIZE,        /// Number of threads in the thread pool for handling requests, 0 = one per CPU core
             CPU_CORES,              /// Number of CPU cores found at startup of whz_core
             REQUESTS_ACTIVE_MAX,    /// Maximum number of active requests to prepare to use immediately
             REQUESTS_QUEUED_MAX,    /// Maximum number of queued requests to be pulled from the io_uring buffer
@@ -56,9 +152,32 @@ namespace whz {
             DATABASE_PORT,          /// Port to use for the database
             DATABASE_HOST,          /// Hostname to use for the database
             DATABASE_ENGINE,        /// Currently only SQLite
+            DATABASE_MMAP_SIZE,     /// SQLite mmap_size in bytes for the read connections, 0 turns memory-mapped I/O off
+            DATABASE_CACHE_SIZE_KB, /// SQLite page cache size per connection in KB
+            DATABASE_READ_CONNECTIONS, /// Number of read connections in the pool, 0 = one per io thread of the server
+            OUTPUT_CACHE_MAX_MB,    /// Memory limit of the rendered page/partial cache in MB, 0 turns it off
+            OUTPUT_CACHE_TTL_S,     /// Default time to live of a cached page or partial in seconds
+            TEMPLATE_PATH,          /// Folder of the .whzt templates loaded at startup, empty = the document root
+            TEMPLATE_PACK_PATH,     /// Template pack to map instead of reading TEMPLATE_PATH, e.g. shared by several servers
+            TEMPLATE_MEMORY_MAP,    /// Write the templates read from TEMPLATE_PATH into a pack and serve them from it (true/false)
+            TEMPLATE_WATCH,         /// Reload changed templates below TEMPLATE_PATH as they change (true/false)
             LUA_SCRIPT_PATH,        /// Path to the user Lua scripts
             LUA_START_SCRIPT_FILENAME,  /// Filename of the Lua script to run at startup
-            LUA_GC_STEPSIZE,        /// Number of steps to run the Lua garbage collector in KB
+            LUA_GC_STEPSIZE,        /// Work of one Lua GC step in KB of allocation, steps run in idle slices
+            LUA_GC_IDLE_BUDGET_US,  /// Time in microseconds the Lua GC may use per idle slice between requests
+            LUA_STATES_PER_THREAD,  /// Number of pooled Lua states per io thread of the server
+            LUA_STATE_MEMORY_LIMIT_MB, /// Memory limit of each pooled Lua state in MB, 0 = unlimited
+            LUA_BYTECODE_CACHE_PATH,   /// Folder for the compiled Lua bytecode, empty = keep it in memory only
+            LUA_ROUTE_PREFIX,       /// URL paths below it go to the handlers of the whz_routes table of the start script
+            ACCESS_LOG_PATH,        /// File of the access log, empty turns the access log off
+            ACCESS_LOG_FORMAT,      /// Format of the access log: "binary" (decode with whz-accesslog) or "clf"
+            ACCESS_LOG_ROTATION_MB, /// Size in MB at which the access log is rotated, 0 = never
+            METRICS_PATH,           /// URL path of the Prometheus metrics, empty turns the endpoint off
+            TRACE_SAMPLE_RATE,      /// Trace one in this many requests, 0 turns request tracing off
+            TRACE_PATH,             /// File the request traces are written to
+            TRACE_FORMAT,           /// Format of the trace file: "chrome" (chrome://tracing, Perfetto) or "otlp" (OTLP JSON lines)
+            SHUTDOWN_DRAIN_TIMEOUT_MS, /// Time in-flight requests get to finish on shutdown before the server stops anyway
+            UPGRADE_SOCKET_PATH,    /// Unix socket a new server process takes the listening socket over from, empty = off
             LOG_TRACE_L3,           /// Log level 3 trace on or off (true/false)
             LOG_TRACE_L2,           /// Log level 2 trace on or off (true/false)
             LOG_TRACE_L1,           /// Log level 1 trace on or off (true/false)
@@ -74,65 +193,74 @@ namespace whz {
             LOG_PATH                /// Absolute path to the log files
         };
 
+        /**
+         * @brief The current configuration. A snapshot is never changed after it's published, read_config() swaps in
+         * a new one, so a reader sees either all old or all new values. The reference stays valid for the lifetime of
+         * the process, but hold on to it only as long as the old values are good enough.
+         *
+         */
+        [[nodiscard]] const config_snapshot& snapshot() const {
+            return *_snapshot.load(std::memory_order_acquire);
+        }
+
+        /// Typed value of a parameter of the current snapshot, e.g. Config::get<ConfigParameter::LOG_PATH>()
+        template <ConfigParameter P>
+        [[nodiscard]] static const auto& get();
+
+        /// Untyped access for code that picks the parameter at runtime, prefer get<P>() or snapshot()
         std::any get_config_value(ConfigParameter eParam);
 
         bool createJSON_config(const std::string& output_filepath);
 
     private:
-        whz_qlogger _qlogger;
+        whz_qlogger _qlogger{"config"};
 
         // Declarations to prevent copy and move operations for a singleton
-        Config()  = default;
+        Config();
         ~Config() = default;
         Config(Config const&) = delete;
         Config& operator=(Config const&) = delete;
         Config(Config&&) = delete;
         Config& operator=(Config&&) = delete;
 
+        // Parse the file into a new snapshot, problems gets the values that were wrong and replaced by defaults
+        std::unique_ptr<config_snapshot> parse_config(const std::string& sfilepath, std::vector<std::string>& problems);
+        // Keep the snapshot alive and make it the current one
+        void publish(std::unique_ptr<const config_snapshot> next);
+
         bool m_bConfigLoaded = false;
         std::string config_filepath;
-        std::any server_http_port;
-        std::any server_https_port;
-        std::any server_rootpath;
-        std::any server_logpath;
-        //std::any server_log_level_min;
-        //std::any server_log_filename;
-        //std::any server_log_postfix;
-        //std::any server_log_rotation;
-        std::any connection_timeout_ms;
-        std::any server_domainname;
-        std::any server_ssl_certpath;
-        std::any connection_max_io_context;
-        std::any connection_use_iouring;
-        std::any threadpool_size;
-        std::any cpu_cores;
-        std::any requests_active_max;
-        std::any requests_queued_max;
-        std::any available_nodenames;
-        std::any whz_cli_path;
-        std::any database_path;
-        std::any database_name;
-        std::any database_user;
-        std::any database_password;
-        std::any database_port;
-        std::any database_host;
-        std::any database_engine;
-        std::any lua_script_path;
-        std::any lua_start_script_filename;
-        std::any lua_gc_stepsize;
-        std::any log_trace_L3;
-        std::any log_trace_L2;
-        std::any log_trace_L1;
-        std::any log_debug;
-        std::any log_info;
-        std::any log_warning;
-        std::any log_error;
-        std::any log_critical;
-        std::any log_backtrace;
-        std::any log_filename;
-        std::any log_rotation_days;
-        std::any log_rotation_mb;
-        std::any log_path;
+        std::atomic<const config_snapshot*> _snapshot{nullptr};    /// Never null after the constructor
+        std::mutex _publish_mutex;                                   /// Guards _snapshots
+        std::vector<std::unique_ptr<const config_snapshot>> _snapshots; /// All published ones, readers may still use old ones
+        std::mutex _reload_mutex;                                    /// One reload at a time, guards _reload_listeners
+        std::vector<reload_listener> _reload_listeners;
+    };
+
+    /// The values of all parameters, see WHZ_CONFIG_PARAMETERS
+    struct config_snapshot {
+#define WHZ_CONFIG_FIELD(param, member, type, fallback, reload) type member = fallback;
+        WHZ_CONFIG_PARAMETERS(WHZ_CONFIG_FIELD)
+#undef WHZ_CONFIG_FIELD
     };
 
+    /// Type and member of a parameter. Only defined for the parameters of WHZ_CONFIG_PARAMETERS, so using another
+    /// one, e.g. UNKNOWN, fails to compile.
+    template <Config::ConfigParameter P>
+    struct config_field;
+
+#define WHZ_CONFIG_FIELD(param, member, type, fallback, reload) \
+    template <> \
+    struct config_field<Config::ConfigParameter::param> { \
+        using value_type = type; \
+        static constexpr value_type config_snapshot::*pointer = &config_snapshot::member; \
+    };
+    WHZ_CONFIG_PARAMETERS(WHZ_CONFIG_FIELD)
+#undef WHZ_CONFIG_FIELD
+
+    template <Config::ConfigParameter P>
+    const auto& Config::get() {
+        return get_instance().snapshot().*config_field<P>::pointer;
+    }
+
 } // whz
@@ -2,13 +2,29 @@
 
 #include <system_error>
 #include <boost/asio/impl/write.hpp>
+#include "whz_access_log.hpp"
+#include "whz_config.hpp"
 #include "whz_request_handler.hpp"
 #include "whz_request_parser.hpp"
+#include "whz_trace.hpp"
 
 namespace whz {
 connection::connection(
-    boost::asio::ip::tcp::socket socket, whz::request_handler& handler)
-    : socket_(std::move(socket)), request_handler_(handler) {}
+    boost::asio::ip::tcp::socket socket, whz::request_handler& handler,
+    whz_gauge active_connections, connection_manager* manager)
+    : socket_(std::move(socket)), read_timer_(socket_.get_executor()),
+      request_handler_(handler),
+      active_connections_(active_connections), manager_(manager) {
+  active_connections_.inc();
+  whz_tracer::getInstance().begin(trace_);
+}
+
+connection::~connection() {
+  active_connections_.dec();
+  if (manager_ != nullptr) {
+    manager_->remove(this);
+  }
+}
 
 auto connection::start() -> void {
   do_read();
@@ -16,21 +32,47 @@ auto connection::start() -> void {
 
 auto connection::do_read() -> void {
   auto self(shared_from_this());
+  arm_read_timeout();
 
   socket_.async_read_some(
       boost::asio::buffer(buffer_),
-      [this, self](std::error_code ec, std::size_t /*bytes_transferred*/) {
+      [this, self](std::error_code ec, std::size_t bytes_transferred) {
+        read_timer_.cancel();
         if (!ec) {
+          if (bytes_read_ == 0) {
+            request_start_ = std::chrono::steady_clock::now();
+          }
+          bytes_read_ += bytes_transferred;
+          trace_.mark_once(trace_phase::first_byte_read);
           whz::result_type result;
           std::tie(result, std::ignore) = request_parser_.parse(
               request_,
               buffer_.begin(),
               buffer_.end()); // TODO(bc): This should be thoroughly checked
 
+          if (result != whz::result_type::indeterminate) {
+            trace_.mark(trace_phase::headers_parsed);
+          }
           if (result == whz::result_type::good) {
-            request_handler_.handle_request(request_, reply_);
-            do_write();
+            trace_.mark(trace_phase::handler_start);
+            const auto handler_start = std::chrono::steady_clock::now();
+            auto handler_done = [this, self, handler_start] {
+              whz_server_metrics::get().handler_duration.observe(
+                  std::chrono::steady_clock::now() - handler_start);
+              trace_.mark(trace_phase::handler_end);
+              do_write();
+            };
+            if (request_handler_.is_LUA_request(request_)) {
+              // Finishes asynchronously, the handler may wait for timers or queries on this io_context
+              auto& io = static_cast<boost::asio::io_context&>(
+                  boost::asio::query(socket_.get_executor(), boost::asio::execution::context));
+              request_handler_.handle_LUA_request(request_, reply_, io, std::move(handler_done));
+            } else {
+              request_handler_.handle_request(request_, reply_);
+              handler_done();
+            }
           } else if (result == whz::result_type::bad) {
+            whz_server_metrics::get().parse_errors.inc();
             reply_ = reply::stock_reply(reply::bad_request);
             do_write();
           } else {
@@ -40,13 +82,68 @@ auto connection::do_read() -> void {
       });
 }
 
+auto connection::arm_read_timeout() -> void {
+  // Read per connection, so a config reload changes the timeout of the next read
+  const auto timeout_ms = Config::get<Config::ConfigParameter::CONNECTION_TIMEOUT_MS>();
+  if (timeout_ms == 0) {
+    return;
+  }
+  read_timer_.expires_after(std::chrono::milliseconds(timeout_ms));
+  read_timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+    if (!ec) {
+      boost::system::error_code ignored;
+      self->socket_.close(ignored); // Fails the pending read, which ends the connection
+    }
+  });
+}
+
 auto connection::do_write() -> void {
   auto self(shared_from_this());
+  trace_.mark(trace_phase::write_start);
   boost::asio::async_write(
       socket_,
       reply_.to_buffers(),
-      [this, self](std::error_code /*ec*/, std::size_t /*s*/) -> void {
+      [this, self](std::error_code ec, std::size_t bytes_written) -> void {
+        trace_.mark(trace_phase::write_end);
+        record_request(ec ? 0 : bytes_written);
+        whz_tracer::getInstance().finish(trace_, request_.method, request_.uri, reply_.status);
         socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both);
       });
 }
+
+auto connection::record_request(std::size_t bytes_written) -> void {
+  const auto latency = std::chrono::steady_clock::now() - request_start_;
+  const auto& metrics = whz_server_metrics::get();
+  metrics.bytes_in.inc(bytes_read_);
+  metrics.bytes_out.inc(bytes_written);
+  metrics.count_response(reply_.status);
+  metrics.request_duration.observe(latency);
+
+  auto& access_log = whz_access_log::getInstance();
+  if (!access_log.is_enabled()) {
+    return;
+  }
+  const auto started = std::chrono::system_clock::now() - latency;
+
+  access_record entry;
+  entry.timestamp_ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(started.time_since_epoch()).count());
+  entry.latency_ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  entry.bytes_in = bytes_read_;
+  entry.bytes_out = bytes_written;
+  boost::system::error_code ec;
+  const auto peer = socket_.remote_endpoint(ec);
+  if (!ec) {
+    const auto address = peer.address();
+    entry.peer_address = address.is_v4()
+        ? boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, address.to_v4()).to_bytes()
+        : address.to_v6().to_bytes();
+    entry.peer_port = peer.port();
+  }
+  entry.status = reply_.status;
+  entry.method = access_method_from(request_.method);
+  entry.set_path(request_.uri);
+  access_log.record(entry);
+}
 }; // namespace whz
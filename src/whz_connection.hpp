@@ -1,13 +1,17 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <boost/asio.hpp>
 
 #include "whz_common.hpp"
+#include "whz_connection_manager.hpp"
+#include "whz_metrics.hpp"
 #include "whz_request_handler.hpp"
 #include "whz_request_parser.hpp"
 #include "whz_quill_wrapper.hpp"
+#include "whz_trace.hpp"
 
 namespace whz {
 
@@ -18,24 +22,37 @@ class connection : public std::enable_shared_from_this<connection> {
   connection& operator=(const connection&) = delete;
   connection(const connection&&) = delete;
   connection& operator=(const connection&&) = delete;
-  ~connection() = default;
+  ~connection();
 
+  /// active_connections is the gauge of the io_context the socket runs on, manager the one to remove it from when
+  /// it ends
   explicit connection(
-      boost::asio::ip::tcp::socket socket, request_handler& handler);
+      boost::asio::ip::tcp::socket socket, request_handler& handler,
+      whz_gauge active_connections = {}, connection_manager* manager = nullptr);
 
   auto start() -> void;
 
  private:
   auto do_read() -> void;
+  // Close the connection if the next read doesn't complete within CONNECTION_TIMEOUT_MS
+  auto arm_read_timeout() -> void;
   auto do_write() -> void;
+  // Count the finished request in the metrics and the access log
+  auto record_request(std::size_t bytes_written) -> void;
 
   boost::asio::ip::tcp::socket socket_;
+  boost::asio::steady_timer read_timer_;
   whz::request_handler& request_handler_;
   std::array<std::uint8_t, 8192>
       buffer_{}; // NOTE(bc): Check this. Can we use span?
   request request_;
   whz::request_parser request_parser_;
   whz::reply reply_;
+  whz_gauge active_connections_;
+  connection_manager* manager_ = nullptr;
+  std::chrono::steady_clock::time_point request_start_{}; // First byte of the request read
+  std::size_t bytes_read_ = 0;
+  whz_request_trace trace_; // Phase timestamps when the request is sampled for tracing
 };
 
 using http_connection_ptr = std::shared_ptr<connection>;
@@ -0,0 +1,25 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include "whz_connection_manager.hpp"
+
+#include "whz_connection.hpp"
+
+namespace whz {
+
+auto connection_manager::add(const std::shared_ptr<connection>& c) -> void {
+  std::lock_guard lock(mutex_);
+  connections_.insert(c.get());
+}
+
+auto connection_manager::remove(const connection* c) -> void {
+  std::lock_guard lock(mutex_);
+  connections_.erase(c);
+}
+
+auto connection_manager::size() const -> std::size_t {
+  std::lock_guard lock(mutex_);
+  return connections_.size();
+}
+
+}; // namespace whz
@@ -0,0 +1,34 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace whz {
+
+class connection;
+
+/**
+ * @brief The open connections of a server, so a shutdown can wait for them to finish. Each connection serves one
+ * request, an open one is either reading its request or answering it, none of them is idle and safe to close. The
+ * read timeout and the drain deadline bound how long a shutdown waits. Connections run on different io_contexts, all
+ * members are thread safe.
+ *
+ */
+class connection_manager {
+ public:
+  auto add(const std::shared_ptr<connection>& c) -> void;
+  /// Called by the connection's destructor
+  auto remove(const connection* c) -> void;
+  [[nodiscard]] auto size() const -> std::size_t;
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_set<const connection*> connections_;
+};
+
+}; // namespace whz
@@ -0,0 +1,179 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_database.hpp"
+#include <algorithm>
+#include "whz_config.hpp"
+
+namespace whz {
+
+    namespace {
+        // The connection this thread got last, per pool. Reusing it keeps the thread's prepared statements hot.
+        struct connection_affinity {
+            std::uint64_t pool_id = 0;
+            whz_db_connection* connection = nullptr;
+        };
+        thread_local connection_affinity tls_affinity;
+    }
+
+    whz_db_connection::whz_db_connection(const std::string& db_path, int open_flags)
+            : _db(db_path, open_flags) {}
+
+    SQLite::Statement& whz_db_connection::prepare(const std::string& sql) {
+        auto it = this->_statements.find(sql);
+        if (it == this->_statements.end()) {
+            it = this->_statements.emplace(sql, std::make_unique<SQLite::Statement>(this->_db, sql)).first;
+        } else {
+            it->second->reset();
+            it->second->clearBindings();
+        }
+        return *it->second;
+    }
+
+    whz_db_options whz_db_pool::options_from_config(std::size_t io_threads) {
+        whz_db_options options;
+        options.path = Config::get<Config::ConfigParameter::DATABASE_PATH>();
+        options.read_connections = Config::get<Config::ConfigParameter::DATABASE_READ_CONNECTIONS>();
+        if (options.read_connections == 0) {
+            options.read_connections = io_threads;
+        }
+        options.mmap_size = Config::get<Config::ConfigParameter::DATABASE_MMAP_SIZE>();
+        options.cache_size_kb = Config::get<Config::ConfigParameter::DATABASE_CACHE_SIZE_KB>();
+        return options;
+    }
+
+    std::expected<std::shared_ptr<whz_db_pool>, std::string> whz_db_pool::create(const std::string& db_path,
+                                                                                  std::size_t pool_size) {
+        whz_db_options options;
+        options.path = db_path;
+        options.read_connections = pool_size;
+        options.writable = false;
+        return create(options);
+    }
+
+    /**
+     * @brief Open the pool. The writer connection is opened first since only a read-write connection can switch the
+     * database to WAL mode, the read connections are then opened read-only and tuned with mmap_size and cache_size.
+     *
+     * @param options The pool settings
+     * @return The pool or an error message if the database couldn't be opened
+     */
+    std::expected<std::shared_ptr<whz_db_pool>, std::string> whz_db_pool::create(const whz_db_options& options) {
+        std::shared_ptr<whz_db_pool> pool(new whz_db_pool());
+        const std::size_t read_connections = std::max<std::size_t>(1, options.read_connections);
+
+        try {
+            if (options.writable) {
+                pool->_writer = std::make_unique<whz_db_connection>(options.path,
+                                                                    SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+                pool->_writer->_db.exec("PRAGMA journal_mode=WAL");
+                pool->_writer->_db.exec("PRAGMA synchronous=NORMAL");
+                pool->_writer->_db.exec(fmt::format("PRAGMA cache_size=-{}", options.cache_size_kb));
+                pool->_writer->_db.setBusyTimeout(5000);
+            }
+            for (std::size_t i = 0; i < read_connections; ++i) {
+                auto connection = std::make_unique<whz_db_connection>(options.path, SQLite::OPEN_READONLY);
+                connection->_db.exec(fmt::format("PRAGMA mmap_size={}", options.mmap_size));
+                connection->_db.exec(fmt::format("PRAGMA cache_size=-{}", options.cache_size_kb));
+                connection->_db.setBusyTimeout(5000);
+                pool->_connections.push_back(std::move(connection));
+            }
+        } catch (const SQLite::Exception& e) {
+            // Convert the exception into an error message without throwing
+            return std::unexpected("Failed to open database: " + std::string(e.what()));
+        }
+        pool->_free_count = pool->_connections.size();
+
+        if (pool->_writer) {
+            pool->_writer_thread = std::jthread([raw = pool.get()](std::stop_token stop_token) {
+                raw->run_writer(std::move(stop_token));
+            });
+        }
+        return pool;
+    }
+
+    whz_db_pool::~whz_db_pool() {
+        if (this->_writer_thread.joinable()) {
+            this->_writer_thread.request_stop();
+            this->_writer_thread.join();
+        }
+    }
+
+    whz_db_pool::lease whz_db_pool::acquire() {
+        std::unique_lock lock(this->_mutex);
+        whz_db_connection* connection = nullptr;
+
+        if (tls_affinity.pool_id == this->_pool_id && !tls_affinity.connection->_in_use) {
+            connection = tls_affinity.connection;
+        } else {
+            this->_connection_returned.wait(lock, [this] { return this->_free_count > 0; });
+            for (const auto& candidate : this->_connections) {
+                if (!candidate->_in_use) {
+                    connection = candidate.get();
+                    break;
+                }
+            }
+            tls_affinity = {this->_pool_id, connection};
+        }
+        connection->_in_use = true;
+        --this->_free_count;
+        return lease(*this, connection);
+    }
+
+    void whz_db_pool::release(whz_db_connection* connection) {
+        {
+            std::lock_guard lock(this->_mutex);
+            connection->_in_use = false;
+            ++this->_free_count;
+        }
+        this->_connection_returned.notify_one();
+    }
+
+    std::future<std::expected<void, std::string>> whz_db_pool::submit_write(write_job job) {
+        std::promise<std::expected<void, std::string>> done;
+        auto future = done.get_future();
+        if (!this->_writer) {
+            done.set_value(std::unexpected("Database pool is read-only"));
+            return future;
+        }
+        {
+            std::lock_guard lock(this->_write_mutex);
+            this->_write_queue.push_back({std::move(job), std::move(done)});
+        }
+        this->_write_queued.notify_one();
+        return future;
+    }
+
+    /**
+     * @brief Body of the writer thread, runs the queued write jobs in order until the pool is destroyed. Jobs still
+     * queued at that point are run before the thread ends.
+     *
+     */
+    void whz_db_pool::run_writer(std::stop_token stop_token) {
+        while (true) {
+            std::deque<queued_write> batch;
+            {
+                std::unique_lock lock(this->_write_mutex);
+                this->_write_queued.wait(lock, stop_token, [this] { return !this->_write_queue.empty(); });
+                if (this->_write_queue.empty()) {
+                    return; // Stop requested and nothing left to do
+                }
+                batch.swap(this->_write_queue);
+            }
+
+            for (auto& write : batch) {
+                try {
+                    SQLite::Transaction transaction(this->_writer->_db);
+                    write.job(*this->_writer);
+                    transaction.commit();
+                    write.done.set_value({});
+                } catch (const std::exception& e) {
+                    WHZ_LOG_ERROR(this->_qlogger, "Database write failed: {}", e.what());
+                    write.done.set_value(std::unexpected(std::string(e.what())));
+                }
+            }
+        }
+    }
+
+} // whz
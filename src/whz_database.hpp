@@ -0,0 +1,142 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+#include <expected>
+#include <utility>
+#include <atomic>
+#include <cstdint>
+#include <SQLiteCpp/SQLiteCpp.h>
+#include "whz_quill_wrapper.hpp"
+
+namespace whz {
+
+    /**
+     * @brief One SQLite connection together with its prepared statements. A statement is compiled the first time its
+     * SQL is seen and reused after that. A connection is only ever used by one thread at a time, so the statement
+     * cache needs no locking.
+     *
+     */
+    class whz_db_connection {
+    public:
+        whz_db_connection(const std::string& db_path, int open_flags);
+        whz_db_connection(const whz_db_connection&) = delete;
+        whz_db_connection& operator=(const whz_db_connection&) = delete;
+        ~whz_db_connection() = default;
+
+        /// Get the prepared statement for this SQL, reset and with cleared bindings. Throws SQLite::Exception.
+        SQLite::Statement& prepare(const std::string& sql);
+        SQLite::Database& database() { return _db; }
+        [[nodiscard]] std::size_t cached_statements() const { return _statements.size(); }
+
+    private:
+        friend class whz_db_pool;
+
+        SQLite::Database _db;
+        std::unordered_map<std::string, std::unique_ptr<SQLite::Statement>> _statements;
+        bool _in_use = false;   /// Guarded by the mutex of the owning pool
+    };
+
+    /// Settings of a whz_db_pool, see whz_db_pool::options_from_config() for the matching config parameters
+    struct whz_db_options {
+        std::string path;                   /// Path to the SQLite database file
+        std::size_t read_connections = 1;   /// Number of read connections, one per io thread of the server
+        std::uint64_t mmap_size = 268435456;    /// PRAGMA mmap_size in bytes for the read connections, 0 = off
+        std::uint64_t cache_size_kb = 8192;     /// PRAGMA cache_size per connection in KB
+        bool writable = true;               /// Open a writer connection, switch to WAL mode and accept write jobs
+    };
+
+    /**
+     * @brief Shared SQLite access layer. The database runs in WAL mode, so readers never block the writer and the
+     * other way round. Reads go through a set of read-only connections, one per worker thread: a thread gets the same
+     * connection back on every acquire() as long as it's free, which keeps its statement cache hot. All writes are
+     * serialized through a single writer connection owned by a background thread.
+     *
+     */
+    class whz_db_pool {
+    public:
+        /// RAII handle to a leased read connection, returns it to the pool on destruction
+        class lease {
+        public:
+            lease(whz_db_pool& pool, whz_db_connection* connection) : _pool(&pool), _connection(connection) {}
+            lease(lease&& other) noexcept : _pool(other._pool), _connection(std::exchange(other._connection, nullptr)) {}
+            lease(const lease&) = delete;
+            lease& operator=(const lease&) = delete;
+            lease& operator=(lease&&) = delete;
+            ~lease() { if (_connection) { _pool->release(_connection); } }
+
+            whz_db_connection* operator->() const { return _connection; }
+            whz_db_connection& operator*() const { return *_connection; }
+
+        private:
+            whz_db_pool* _pool;
+            whz_db_connection* _connection;
+        };
+
+        using write_job = std::function<void(whz_db_connection&)>;
+
+        /// Opens the writer (if writable) and all read connections, fails if the database can't be opened
+        static std::expected<std::shared_ptr<whz_db_pool>, std::string> create(const whz_db_options& options);
+        /// Opens pool_size read-only connections to an existing database, no writer
+        static std::expected<std::shared_ptr<whz_db_pool>, std::string> create(const std::string& db_path,
+                                                                                std::size_t pool_size);
+        /// The pool settings from the DATABASE_* parameters of the loaded config, DATABASE_READ_CONNECTIONS = 0 opens
+        /// one read connection per io thread
+        static whz_db_options options_from_config(std::size_t io_threads);
+
+        whz_db_pool(const whz_db_pool&) = delete;
+        whz_db_pool& operator=(const whz_db_pool&) = delete;
+        ~whz_db_pool();
+
+        /// Lease a read connection, preferably the one of the calling thread. Waits if all are in use.
+        [[nodiscard]] lease acquire();
+        [[nodiscard]] std::size_t size() const { return _connections.size(); }
+
+        /**
+         * @brief Queue a write job for the writer thread. Jobs run one after the other, each in its own transaction
+         * that is committed when the job returns and rolled back if it throws.
+         *
+         * @return Future that is set when the job is done, with the error message if it failed
+         */
+        std::future<std::expected<void, std::string>> submit_write(write_job job);
+        [[nodiscard]] bool is_writable() const { return _writer != nullptr; }
+
+    private:
+        whz_db_pool() = default;
+        void release(whz_db_connection* connection);
+        void run_writer(std::stop_token stop_token);
+
+        struct queued_write {
+            write_job job;
+            std::promise<std::expected<void, std::string>> done;
+        };
+
+        const std::uint64_t _pool_id = _next_pool_id.fetch_add(1);  /// Identifies the pool in the thread affinity
+        std::vector<std::unique_ptr<whz_db_connection>> _connections;
+        std::size_t _free_count = 0;
+        std::mutex _mutex;
+        std::condition_variable _connection_returned;
+
+        std::unique_ptr<whz_db_connection> _writer;
+        std::deque<queued_write> _write_queue;
+        std::mutex _write_mutex;
+        std::condition_variable_any _write_queued;
+        std::jthread _writer_thread;    /// Stopped and joined in the destructor, before any other member goes away
+
+        inline static std::atomic<std::uint64_t> _next_pool_id{1};
+        whz::whz_qlogger _qlogger{"database"};
+    };
+
+} // whz
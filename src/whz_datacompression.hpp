@@ -37,7 +37,7 @@ namespace whz {
 
             // check if the path exists
             if (!fs::exists(output.parent_path())) {
-                this->qlogger.error(fmt::format("Compression Error: Output directory does not exist: {}", output.parent_path().string()));
+                WHZ_LOG_ERROR(this->qlogger, "Compression Error: Output directory does not exist: {}", output.parent_path().string());
                 //throw std::runtime_error("Output directory does not exist");
                 //return false;
             }
@@ -58,7 +58,7 @@ namespace whz {
 
             // check if the archive file exists
             if (!fs::exists(archive)) {
-                this->qlogger.error(fmt::format("Compression Error: Output directory does not exist: {}", archive.string()));
+                WHZ_LOG_ERROR(this->qlogger, "Compression Error: Output directory does not exist: {}", archive.string());
                 return false;
             }
 
@@ -76,11 +76,11 @@ namespace whz {
         bool compressDirectory(const fs::path& directory, const fs::path& output, const std::string& format) {
             // Check if the directory and output paths exist
             if (!fs::exists(directory)) {
-                this->qlogger.error(fmt::format("Compression Error: Directory does not exist: {}", directory.string()));
+                WHZ_LOG_ERROR(this->qlogger, "Compression Error: Directory does not exist: {}", directory.string());
                 return false;
             }
             if (!fs::exists(output.parent_path())) {
-                this->qlogger.error(fmt::format("Compression Error: Output directory does not exist: {}", output.parent_path().string()));
+                WHZ_LOG_ERROR(this->qlogger, "Compression Error: Output directory does not exist: {}", output.parent_path().string());
                 return false;
             }
 
@@ -109,7 +109,7 @@ namespace whz {
             int error;
             zip_t* archive = zip_open(output.string().c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
             if (!archive) {
-                this->qlogger.error(fmt::format("Compression Error({}): Failed to create ZIP archive", error));
+                WHZ_LOG_ERROR(this->qlogger, "Compression Error({}): Failed to create ZIP archive", error);
                 return false;
             }
 
@@ -137,7 +137,7 @@ namespace whz {
             int error = 0;
             zip_t* za = zip_open(archive.string().c_str(), 0, &error);
             if (!za) {
-                this->qlogger.error(fmt::format("Decompression Error({}): Failed to open ZIP archive", error));
+                WHZ_LOG_ERROR(this->qlogger, "Decompression Error({}): Failed to open ZIP archive", error);
                 return false;
             }
 
@@ -230,7 +230,7 @@ namespace whz {
             archive_write_disk_set_standard_lookup(ext);
 
             if ((r = archive_read_open_filename(a, archive.string().c_str(), 10240))) {
-                this->qlogger.error(fmt::format("Decompression Error: Failed to open 7z archive: {}", archive.string()));
+                WHZ_LOG_ERROR(this->qlogger, "Decompression Error: Failed to open 7z archive: {}", archive.string());
                 archive_read_free(a);
                 archive_write_free(ext);
                 return false;
@@ -243,7 +243,7 @@ namespace whz {
 
                 r = archive_write_header(ext, entry);
                 if (r != ARCHIVE_OK) {
-                    this->qlogger.error(fmt::format("Decompression Error: Failed to write header for file: {}", currentFile));
+                    WHZ_LOG_ERROR(this->qlogger, "Decompression Error: Failed to write header for file: {}", currentFile);
                 } else {
                     const void* buff;
                     size_t size;
@@ -252,12 +252,12 @@ namespace whz {
                     while ((r = archive_read_data_block(a, &buff, &size, &offset)) == ARCHIVE_OK) {
                         r = archive_write_data_block(ext, buff, size, offset);
                         if (r != ARCHIVE_OK) {
-                            this->qlogger.error(fmt::format("Decompression Error: Failed to write data for file: {}", currentFile));
+                            WHZ_LOG_ERROR(this->qlogger, "Decompression Error: Failed to write data for file: {}", currentFile);
                             break;
                         }
                     }
                     if (r != ARCHIVE_EOF) {
-                        this->qlogger.error(fmt::format("Decompression Error: Failed to read data for file: {}", currentFile));
+                        WHZ_LOG_ERROR(this->qlogger, "Decompression Error: Failed to read data for file: {}", currentFile);
                     }
                 }
                 archive_write_finish_entry(ext);
@@ -113,6 +113,6 @@ namespace whz {
                                         const std::vector<unsigned char>& publicKey);
 
     private:
-        whz::whz_qlogger _qlogger;
+        whz::whz_qlogger _qlogger{"encryption"};
     };
 } // whz namespace
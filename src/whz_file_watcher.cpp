@@ -0,0 +1,196 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_file_watcher.hpp"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+namespace whz {
+
+    namespace {
+        constexpr std::uint32_t kWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                             IN_DELETE_SELF | IN_ONLYDIR;
+    }
+
+    whz_file_watcher::whz_file_watcher(std::string root_path, change_handler on_change, std::string extension,
+                                       std::chrono::milliseconds coalesce, std::chrono::milliseconds max_delay)
+            : _root_path(std::move(root_path)), _on_change(std::move(on_change)), _extension(std::move(extension)),
+              _coalesce(coalesce), _max_delay(std::max(max_delay, coalesce)) {}
+
+    whz_file_watcher::~whz_file_watcher() {
+        stop();
+    }
+
+    bool whz_file_watcher::start() {
+        if (is_running()) {
+            return true;
+        }
+        this->_inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        this->_wakeup_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (this->_inotify_fd < 0 || this->_wakeup_fd < 0) {
+            WHZ_LOG_ERROR(this->_qlogger, "File watcher for {} not started: {}", this->_root_path, std::strerror(errno));
+            stop();
+            return false;
+        }
+        add_watches(this->_root_path, nullptr);
+        if (this->_watches.empty()) {
+            WHZ_LOG_ERROR(this->_qlogger, "File watcher for {} not started: no folder to watch", this->_root_path);
+            stop();
+            return false;
+        }
+        this->_thread = std::jthread([this](std::stop_token stop_token) { run(std::move(stop_token)); });
+        return true;
+    }
+
+    void whz_file_watcher::stop() {
+        if (this->_thread.joinable()) {
+            this->_thread.request_stop();
+            const std::uint64_t one = 1;
+            [[maybe_unused]] auto written = ::write(this->_wakeup_fd, &one, sizeof(one));
+            this->_thread.join();
+        }
+        if (this->_inotify_fd >= 0) {
+            ::close(this->_inotify_fd); // Removes all watches
+            this->_inotify_fd = -1;
+        }
+        if (this->_wakeup_fd >= 0) {
+            ::close(this->_wakeup_fd);
+            this->_wakeup_fd = -1;
+        }
+        this->_watches.clear();
+    }
+
+    void whz_file_watcher::add_watches(const std::filesystem::path& dir, std::vector<std::string>* found) {
+        const int wd = ::inotify_add_watch(this->_inotify_fd, dir.c_str(), kWatchMask);
+        if (wd < 0) {
+            WHZ_LOG_ERROR(this->_qlogger, "Failed to watch {}: {}", dir.string(), std::strerror(errno));
+            return;
+        }
+        this->_watches[wd] = dir;
+
+        std::error_code ec;
+        for (auto it = std::filesystem::directory_iterator(dir, ec);
+             !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            std::error_code type_ec;
+            if (it->is_directory(type_ec)) {
+                add_watches(it->path(), found);
+            } else if (found && it->is_regular_file(type_ec) && is_watched_file(it->path())) {
+                found->push_back(it->path().string()); // Created before the watch was in place
+            }
+        }
+    }
+
+    bool whz_file_watcher::is_watched_file(const std::filesystem::path& path) const {
+        return this->_extension.empty() || path.extension() == this->_extension;
+    }
+
+    bool whz_file_watcher::read_events(std::vector<std::string>& changed) {
+        alignas(inotify_event) char buffer[16 * 1024];
+        while (true) {
+            const ssize_t length = ::read(this->_inotify_fd, buffer, sizeof(buffer));
+            if (length < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // Events were lost, only a full rescan of the root is safe
+                    WHZ_LOG_WARNING(this->_qlogger, "File watcher queue overflow for {}", this->_root_path);
+                    changed.push_back(this->_root_path);
+                    continue;
+                }
+                auto watch = this->_watches.find(event->wd);
+                if (watch == this->_watches.end()) {
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    this->_watches.erase(watch); // Folder removed, the kernel dropped the watch
+                    continue;
+                }
+                if (event->len == 0) {
+                    continue; // Event on the watched folder itself
+                }
+
+                auto path = watch->second / event->name;
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        add_watches(path, &changed);
+                    } else {
+                        changed.push_back(path.string()); // Removed or moved away, reported as a prefix
+                    }
+                } else if (is_watched_file(path)) {
+                    changed.push_back(path.string());
+                }
+            }
+        }
+    }
+
+    void whz_file_watcher::run(std::stop_token stop_token) {
+        using clock = std::chrono::steady_clock;
+        std::vector<std::string> changed;
+        clock::time_point first_pending;
+        clock::time_point last_change;
+        pollfd fds[2] = {{this->_inotify_fd, POLLIN, 0}, {this->_wakeup_fd, POLLIN, 0}};
+        // Quiet for the coalesce interval after the last reported change, but no later than the max delay
+        auto report_at = [&] { return std::min(last_change + this->_coalesce, first_pending + this->_max_delay); };
+
+        while (!stop_token.stop_requested()) {
+            // Block until the first event, then only until the pending changes are due
+            int timeout = -1;
+            if (!changed.empty()) {
+                const auto left = std::chrono::ceil<std::chrono::milliseconds>(report_at() - clock::now());
+                timeout = static_cast<int>(std::max(left, std::chrono::milliseconds(0)).count());
+            }
+            const int ready = ::poll(fds, 2, timeout);
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                WHZ_LOG_ERROR(this->_qlogger, "File watcher for {} stopped: {}", this->_root_path, std::strerror(errno));
+                return;
+            }
+            if (stop_token.stop_requested()) {
+                return;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                const std::size_t before = changed.size();
+                if (!read_events(changed)) {
+                    WHZ_LOG_ERROR(this->_qlogger, "File watcher for {} stopped: {}", this->_root_path,
+                                  std::strerror(errno));
+                    return;
+                }
+                if (changed.size() != before) { // Events for files that aren't reported don't delay the others
+                    last_change = clock::now();
+                    if (before == 0) {
+                        first_pending = last_change;
+                    }
+                }
+            }
+
+            if (!changed.empty() && clock::now() >= report_at()) {
+                std::sort(changed.begin(), changed.end());
+                changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+                try {
+                    this->_on_change(std::exchange(changed, {}));
+                } catch (const std::exception& e) {
+                    WHZ_LOG_ERROR(this->_qlogger, "File change handler for {} failed: {}", this->_root_path, e.what());
+                }
+            }
+        }
+    }
+
+} // whz
@@ -0,0 +1,68 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include "whz_quill_wrapper.hpp"
+
+namespace whz {
+
+    /**
+     * @brief Watches a directory tree with inotify on its own thread. Events are coalesced: after the first change the
+     * watcher waits until the tree has been quiet for the coalesce interval and then reports every path that changed,
+     * was created or removed in one call. A deploy that touches hundreds of files results in one or a few calls. The
+     * wait is capped at the max delay after the first pending change, so a tree that is never quiet is still reported.
+     *
+     * If an extension is given only files with it are reported, other files (editor swap files, logs written into the
+     * tree) don't restart the quiet interval either.
+     *
+     * New subfolders are watched as they appear, the files already in them are reported as changed. Removed folders
+     * are reported with their own path, the handler has to treat it as a prefix.
+     */
+    class whz_file_watcher {
+    public:
+        using change_handler = std::function<void(std::vector<std::string> changed_paths)>;
+
+        whz_file_watcher(std::string root_path, change_handler on_change, std::string extension = {},
+                         std::chrono::milliseconds coalesce = std::chrono::milliseconds(100),
+                         std::chrono::milliseconds max_delay = std::chrono::milliseconds(1000));
+        whz_file_watcher(const whz_file_watcher&) = delete;
+        whz_file_watcher& operator=(const whz_file_watcher&) = delete;
+        ~whz_file_watcher();
+
+        /// Set up the watches and start the watcher thread, false if inotify isn't available for the root path
+        bool start();
+        /// Stop the watcher thread, pending events that weren't reported yet are dropped
+        void stop();
+        [[nodiscard]] bool is_running() const { return _thread.joinable(); }
+
+    private:
+        void run(std::stop_token stop_token);
+        // Watch the folder and all its subfolders, collecting the files in them if found is given
+        void add_watches(const std::filesystem::path& dir, std::vector<std::string>* found);
+        // Read all queued events, returns false on a fatal error
+        bool read_events(std::vector<std::string>& changed);
+        // True if a file with this path is reported
+        [[nodiscard]] bool is_watched_file(const std::filesystem::path& path) const;
+
+        std::string _root_path;
+        change_handler _on_change;
+        std::string _extension;     /// Only files with this extension are reported, all if empty
+        std::chrono::milliseconds _coalesce;
+        std::chrono::milliseconds _max_delay;
+        int _inotify_fd = -1;
+        int _wakeup_fd = -1;    /// eventfd to wake the thread up on stop()
+        std::unordered_map<int, std::filesystem::path> _watches;    /// Watch descriptor -> folder, watcher thread only
+        std::jthread _thread;
+        whz::whz_qlogger _qlogger{"file_watcher"};
+    };
+
+} // whz
@@ -0,0 +1,97 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <rapidhash.h>
+
+namespace whz {
+
+    /**
+     * @brief Immutable open-addressing hash map with string keys, meant to be built once and then read by many threads
+     * without any locking. Lookups take a string_view and don't allocate. Linear probing in a power-of-two table that
+     * is kept at most half full, the full hash is stored per slot so most mismatches don't touch the key.
+     *
+     */
+    template <typename V>
+    class whz_flat_map {
+    public:
+        whz_flat_map() = default;
+
+        /// Build the map from the entries, on duplicate keys the last one wins
+        explicit whz_flat_map(std::vector<std::pair<std::string, V>> entries) {
+            const std::size_t capacity = std::bit_ceil(std::max<std::size_t>(entries.size() * 2, 8));
+            _slots.resize(capacity);
+            _mask = capacity - 1;
+            for (auto& [key, value] : entries) {
+                const std::uint64_t hash = hash_key(key);
+                std::size_t i = hash & _mask;
+                while (_slots[i].used && !(_slots[i].hash == hash && _slots[i].key == key)) {
+                    i = (i + 1) & _mask;
+                }
+                if (!_slots[i].used) {
+                    ++_size;
+                }
+                _slots[i] = slot{hash, std::move(key), std::move(value), true};
+            }
+        }
+
+        [[nodiscard]] const V* find(std::string_view key) const {
+            if (_size == 0) {
+                return nullptr;
+            }
+            const std::uint64_t hash = hash_key(key);
+            for (std::size_t i = hash & _mask; _slots[i].used; i = (i + 1) & _mask) {
+                if (_slots[i].hash == hash && _slots[i].key == key) {
+                    return &_slots[i].value;
+                }
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] bool contains(std::string_view key) const { return find(key) != nullptr; }
+        [[nodiscard]] std::size_t size() const { return _size; }
+        [[nodiscard]] bool empty() const { return _size == 0; }
+
+        /// Call visit(key, value) for every entry, in no particular order
+        template <typename Visitor>
+        void for_each(Visitor&& visit) const {
+            for (const auto& s : _slots) {
+                if (s.used) {
+                    visit(std::string_view(s.key), s.value);
+                }
+            }
+        }
+
+        /// Copy all entries out, e.g. to build the next version of the map
+        [[nodiscard]] std::vector<std::pair<std::string, V>> entries() const {
+            std::vector<std::pair<std::string, V>> result;
+            result.reserve(_size);
+            for_each([&result](std::string_view key, const V& value) { result.emplace_back(std::string(key), value); });
+            return result;
+        }
+
+        static std::uint64_t hash_key(std::string_view key) { return rapidhash(key.data(), key.size()); }
+
+    private:
+        struct slot {
+            std::uint64_t hash = 0;
+            std::string key;
+            V value{};
+            bool used = false;
+        };
+
+        std::vector<slot> _slots;
+        std::size_t _mask = 0;
+        std::size_t _size = 0;
+    };
+
+} // whz
@@ -39,6 +39,12 @@ namespace whz {
     }
 
     auto io_context_pool::get_io_context() -> boost::asio::io_context& {
+        std::size_t index = 0;
+        return get_io_context(index);
+    }
+
+    auto io_context_pool::get_io_context(std::size_t& index) -> boost::asio::io_context& {
+        index = next_io_context;
         boost::asio::io_context&io_context = *io_contexts_[next_io_context];
         ++next_io_context;
         if (next_io_context == io_contexts_.size()) {
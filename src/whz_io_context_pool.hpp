@@ -27,6 +27,10 @@ namespace whz {
         auto stop() -> void;
 
         auto get_io_context() -> boost::asio::io_context&;
+        /// Same as get_io_context(), index is set to the position of the returned io_context in the pool
+        auto get_io_context(std::size_t& index) -> boost::asio::io_context&;
+
+        [[nodiscard]] auto size() const -> std::size_t { return io_contexts_.size(); }
 
     private:
         using io_context_ptr = std::shared_ptr<boost::asio::io_context>;
@@ -38,6 +42,6 @@ namespace whz {
         // NOTE: This looks like it can be held in a different container
         std::list<io_context_work> work_;
         std::size_t next_io_context;
-        whz::whz_qlogger _qlogger;
+        whz::whz_qlogger _qlogger{"io_pool"};
     };
 }; // namespace whz
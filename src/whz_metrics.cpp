@@ -0,0 +1,224 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include "whz_metrics.hpp"
+#include <bit>
+#include <iterator>
+#include <stdexcept>
+#include "fmt/format.h"
+
+namespace whz {
+
+    namespace {
+        constexpr std::string_view TypeNames[] = {"counter", "gauge", "histogram"};
+
+        // name{labels} or name{labels,extra}, without braces if both are empty
+        void AppendSeriesName(std::string &out, std::string_view name, std::string_view labels,
+                              std::string_view extra = {}) {
+            out += name;
+            if (labels.empty() && extra.empty()) {
+                return;
+            }
+            out += '{';
+            out += labels;
+            if (!labels.empty() && !extra.empty()) {
+                out += ',';
+            }
+            out += extra;
+            out += '}';
+        }
+    }
+
+    void whz_histogram::observe_ns(std::uint64_t ns) const {
+        auto &bucket = whz_metrics::local_slot(_slot + static_cast<std::uint32_t>(bucket_of(ns)));
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        auto &sum = whz_metrics::local_slot(_slot + static_cast<std::uint32_t>(buckets));
+        sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    }
+
+    std::size_t whz_histogram::bucket_of(std::uint64_t ns) {
+        if (ns < (std::uint64_t{1} << first_octave)) {
+            return 0;
+        }
+        const auto octave = static_cast<std::size_t>(std::bit_width(ns)) - 1;
+        if (octave >= first_octave + octaves) {
+            return buckets - 1;
+        }
+        const std::size_t upper_half = (ns >> (octave - 1)) & 1;
+        return 1 + (octave - first_octave) * 2 + upper_half;
+    }
+
+    std::uint64_t whz_histogram::upper_bound_ns(std::size_t bucket) {
+        if (bucket == 0) {
+            return std::uint64_t{1} << first_octave;
+        }
+        if (bucket >= buckets - 1) {
+            return 0;
+        }
+        const std::size_t octave = first_octave + (bucket - 1) / 2;
+        const std::uint64_t half = (bucket - 1) % 2;
+        return (std::uint64_t{1} << octave) + (half + 1) * (std::uint64_t{1} << (octave - 1));
+    }
+
+    whz_counter whz_metrics::counter(const std::string &name, const std::string &help, const std::string &labels) {
+        std::lock_guard lock(this->_mutex);
+        return whz_counter(add_series(name, help, metric_type::counter, labels, 1).slot);
+    }
+
+    whz_gauge whz_metrics::gauge(const std::string &name, const std::string &help, const std::string &labels) {
+        std::lock_guard lock(this->_mutex);
+        return whz_gauge(add_series(name, help, metric_type::gauge, labels, 1).slot);
+    }
+
+    whz_histogram whz_metrics::histogram(const std::string &name, const std::string &help, const std::string &labels) {
+        std::lock_guard lock(this->_mutex);
+        return whz_histogram(add_series(name, help, metric_type::histogram, labels, whz_histogram::slots).slot);
+    }
+
+    void whz_metrics::gauge_callback(const std::string &name, const std::string &help, const std::string &labels,
+                                     std::function<double()> read) {
+        std::lock_guard lock(this->_mutex);
+        add_series(name, help, metric_type::gauge, labels, 0, std::move(read));
+    }
+
+    void whz_metrics::counter_callback(const std::string &name, const std::string &help, const std::string &labels,
+                                       std::function<double()> read) {
+        std::lock_guard lock(this->_mutex);
+        add_series(name, help, metric_type::counter, labels, 0, std::move(read));
+    }
+
+    const whz_metrics::series &whz_metrics::add_series(const std::string &name, const std::string &help,
+                                                       metric_type type, const std::string &labels,
+                                                       std::size_t slot_count, std::function<double()> read) {
+        family *found = nullptr;
+        for (auto &f : this->_families) {
+            if (f.name == name) {
+                found = &f;
+                break;
+            }
+        }
+        if (found == nullptr) {
+            found = &this->_families.emplace_back(family{name, help, type, {}});
+        }
+        for (const auto &member : found->members) {
+            if (member.labels == labels) {
+                return member;
+            }
+        }
+        if (this->_next_slot + slot_count > max_slots) {
+            throw std::length_error("whz_metrics: no free slots left for " + name);
+        }
+        const auto slot = static_cast<std::uint32_t>(slot_count > 0 ? this->_next_slot : 0);
+        this->_next_slot += slot_count;
+        return found->members.emplace_back(series{labels, slot, std::move(read)});
+    }
+
+    whz_metrics::shard *whz_metrics::attach_thread() {
+        std::lock_guard lock(this->_mutex);
+        _thread_shard = this->_shards.emplace_back(std::make_unique<shard>()).get();
+        return _thread_shard;
+    }
+
+    std::uint64_t whz_metrics::total(std::uint32_t slot) const {
+        std::uint64_t sum = 0;
+        for (const auto &s : this->_shards) {
+            sum += s->slots[slot].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    std::string whz_metrics::scrape() const {
+        std::string out;
+        out.reserve(16 * 1024);
+        auto it = std::back_inserter(out);
+
+        std::lock_guard lock(this->_mutex);
+        for (const auto &f : this->_families) {
+            fmt::format_to(it, "# HELP {} {}\n# TYPE {} {}\n", f.name, f.help, f.name,
+                           TypeNames[static_cast<std::size_t>(f.type)]);
+            for (const auto &member : f.members) {
+                switch (f.type) {
+                    case metric_type::counter:
+                        AppendSeriesName(out, f.name, member.labels);
+                        if (member.read) {
+                            fmt::format_to(it, " {}\n", member.read());
+                        } else {
+                            fmt::format_to(it, " {}\n", total(member.slot));
+                        }
+                        break;
+                    case metric_type::gauge:
+                        AppendSeriesName(out, f.name, member.labels);
+                        if (member.read) {
+                            fmt::format_to(it, " {}\n", member.read());
+                        } else {
+                            // The shards hold deltas, a connection may be opened on one thread and closed on another
+                            fmt::format_to(it, " {}\n", static_cast<std::int64_t>(total(member.slot)));
+                        }
+                        break;
+                    case metric_type::histogram: {
+                        const std::string bucket_name = f.name + "_bucket";
+                        std::uint64_t cumulative = 0;
+                        for (std::size_t b = 0; b < whz_histogram::buckets; ++b) {
+                            cumulative += total(member.slot + static_cast<std::uint32_t>(b));
+                            const std::uint64_t bound = whz_histogram::upper_bound_ns(b);
+                            const std::string le = bound == 0 ? std::string(R"(le="+Inf")")
+                                                              : fmt::format(R"(le="{}")", bound / 1e9);
+                            AppendSeriesName(out, bucket_name, member.labels, le);
+                            fmt::format_to(it, " {}\n", cumulative);
+                        }
+                        const double sum_seconds =
+                                static_cast<double>(total(member.slot + static_cast<std::uint32_t>(whz_histogram::buckets))) / 1e9;
+                        AppendSeriesName(out, f.name + "_sum", member.labels);
+                        fmt::format_to(it, " {}\n", sum_seconds);
+                        AppendSeriesName(out, f.name + "_count", member.labels);
+                        fmt::format_to(it, " {}\n", cumulative);
+                        break;
+                    }
+                }
+            }
+        }
+        return out;
+    }
+
+    whz_server_metrics::whz_server_metrics() {
+        auto &registry = whz_metrics::getInstance();
+        this->connections_accepted = registry.counter("whz_connections_accepted_total", "Connections accepted");
+        this->parse_errors = registry.counter("whz_http_parse_errors_total", "Requests rejected as malformed");
+        this->bytes_in = registry.counter("whz_http_received_bytes_total", "Bytes read from clients");
+        this->bytes_out = registry.counter("whz_http_sent_bytes_total", "Bytes written to clients");
+        this->request_duration = registry.histogram("whz_http_request_duration_seconds",
+                                                    "Time from the first byte of a request to its reply written");
+        this->handler_duration = registry.histogram("whz_http_handler_duration_seconds",
+                                                    "Time spent in the request handler");
+        this->template_duration = registry.histogram("whz_template_render_duration_seconds",
+                                                     "Time to render a template page");
+        this->lua_handler_duration = registry.histogram("whz_lua_handler_duration_seconds",
+                                                        "Time from the start to the end of a Lua request handler");
+
+        static constexpr std::uint16_t KnownStatus[] = {200, 201, 202, 204, 300, 301, 302, 304,
+                                                        400, 401, 403, 404, 500, 501, 502, 503};
+        const std::string name = "whz_http_responses_total";
+        const std::string help = "Responses by status code";
+        this->_responses.push_back(registry.counter(name, help, R"(code="other")"));
+        for (const auto status : KnownStatus) {
+            this->_status_index[status] = static_cast<std::uint8_t>(this->_responses.size());
+            this->_responses.push_back(registry.counter(name, help, fmt::format(R"(code="{}")", status)));
+        }
+    }
+
+    whz_server_metrics &whz_server_metrics::get() {
+        static whz_server_metrics metrics;
+        return metrics;
+    }
+
+    void whz_server_metrics::count_response(std::uint16_t status) const {
+        const std::size_t index = status < this->_status_index.size() ? this->_status_index[status] : 0;
+        this->_responses[index].inc();
+    }
+
+    whz_gauge whz_server_metrics::active_connections(std::size_t io_context_index) {
+        return whz_metrics::getInstance().gauge("whz_connections_active", "Open connections per io_context",
+                                                fmt::format(R"(io_context="{}")", io_context_index));
+    }
+
+} // whz
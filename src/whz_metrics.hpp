@@ -0,0 +1,200 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace whz {
+
+    class whz_metrics;
+
+    /// Monotonic counter, e.g. requests served. A handle only, copy it freely.
+    class whz_counter {
+    public:
+        whz_counter() = default;
+        void inc(std::uint64_t n = 1) const;
+
+    private:
+        friend class whz_metrics;
+        explicit whz_counter(std::uint32_t slot) : _slot(slot) {}
+        std::uint32_t _slot = 0;
+    };
+
+    /// Value that goes up and down, e.g. open connections. Can be raised on one thread and lowered on another.
+    class whz_gauge {
+    public:
+        whz_gauge() = default;
+        void inc(std::int64_t n = 1) const;
+        void dec(std::int64_t n = 1) const { inc(-n); }
+
+    private:
+        friend class whz_metrics;
+        explicit whz_gauge(std::uint32_t slot) : _slot(slot) {}
+        std::uint32_t _slot = 0;
+    };
+
+    /**
+     * @brief Latency histogram with HDR-style log-linear buckets: two buckets per power of two from 1 µs to 17 s,
+     * which keeps the relative error of a percentile below 25% over the whole range with a fixed set of buckets.
+     * Observing a value is one bucket increment and one sum update on the thread's own shard.
+     *
+     */
+    class whz_histogram {
+    public:
+        static constexpr std::size_t first_octave = 10;     /// Bucket 0 holds everything below 2^10 ns
+        static constexpr std::size_t octaves = 24;
+        static constexpr std::size_t buckets = 1 + octaves * 2 + 1;    /// The last one is +Inf
+        static constexpr std::size_t slots = buckets + 1;   /// The buckets and the sum in ns
+
+        whz_histogram() = default;
+        void observe_ns(std::uint64_t ns) const;
+        void observe(std::chrono::nanoseconds duration) const {
+            observe_ns(duration.count() > 0 ? static_cast<std::uint64_t>(duration.count()) : 0);
+        }
+
+        [[nodiscard]] static std::size_t bucket_of(std::uint64_t ns);
+        /// Upper bound of the bucket in ns, 0 for the +Inf bucket
+        [[nodiscard]] static std::uint64_t upper_bound_ns(std::size_t bucket);
+
+    private:
+        friend class whz_metrics;
+        explicit whz_histogram(std::uint32_t slot) : _slot(slot) {}
+        std::uint32_t _slot = 0;
+    };
+
+    /**
+     * @brief Singleton registry of the server metrics, scraped in the Prometheus text format. Every thread that
+     * updates a metric gets its own shard of slots, so an update is a plain load and store on memory no other thread
+     * writes, without atomic read-modify-write or shared cache lines. The shards are only summed up on a scrape.
+     *
+     * Metrics are registered once, usually at startup, and used through the returned handle. Registering the same
+     * name and labels again returns the same metric.
+     *
+     */
+    class whz_metrics {
+    public:
+        static constexpr std::size_t max_slots = 4096;  /// Per shard, a histogram takes whz_histogram::slots
+
+        whz_metrics(const whz_metrics&) = delete;
+        whz_metrics& operator=(const whz_metrics&) = delete;
+
+        static whz_metrics& getInstance() {
+            static whz_metrics instance;
+            return instance;
+        }
+
+        /**
+         * @brief Register a metric. Throws std::length_error if the shards have no free slots left.
+         *
+         * @param name Metric name, e.g. "whz_http_requests_total"
+         * @param help One line description for the # HELP line
+         * @param labels Label pairs in exposition syntax without braces, e.g. R"(code="200")", may be empty
+         */
+        whz_counter counter(const std::string& name, const std::string& help, const std::string& labels = {});
+        whz_gauge gauge(const std::string& name, const std::string& help, const std::string& labels = {});
+        whz_histogram histogram(const std::string& name, const std::string& help, const std::string& labels = {});
+        /// Gauge read by calling read on every scrape, for values that are kept elsewhere anyway
+        void gauge_callback(const std::string& name, const std::string& help, const std::string& labels,
+                            std::function<double()> read);
+        /// Counter read by calling read on every scrape, read must never go back, e.g. totals kept by a library
+        void counter_callback(const std::string& name, const std::string& help, const std::string& labels,
+                              std::function<double()> read);
+
+        /// All metrics in the Prometheus text exposition format, version 0.0.4
+        [[nodiscard]] std::string scrape() const;
+
+        /// The slot of the calling thread's shard, creates the shard on the first use on a thread
+        static std::atomic<std::uint64_t>& local_slot(std::uint32_t slot) {
+            shard* local = _thread_shard;
+            if (local == nullptr) [[unlikely]] {
+                local = getInstance().attach_thread();
+            }
+            return local->slots[slot];
+        }
+
+    private:
+        enum class metric_type { counter, gauge, histogram };
+
+        struct shard {
+            std::array<std::atomic<std::uint64_t>, max_slots> slots{};
+        };
+
+        struct series {
+            std::string labels;
+            std::uint32_t slot = 0;
+            std::function<double()> read;   /// Set for callback gauges and counters, they have no slot
+        };
+
+        struct family {
+            std::string name;
+            std::string help;
+            metric_type type;
+            std::vector<series> members;
+        };
+
+        whz_metrics() = default;
+
+        shard* attach_thread();
+        // Find or add the series, allocating slot_count slots for a new one, under _mutex
+        const series& add_series(const std::string& name, const std::string& help, metric_type type,
+                                 const std::string& labels, std::size_t slot_count, std::function<double()> read = {});
+        // Sum of the slot over all shards, under _mutex
+        [[nodiscard]] std::uint64_t total(std::uint32_t slot) const;
+
+        mutable std::mutex _mutex;
+        std::vector<std::unique_ptr<shard>> _shards;    /// Kept when their thread ends, counters never go back
+        std::vector<family> _families;                  /// In registration order
+        std::size_t _next_slot = 1;     /// Slot 0 is where default constructed handles write to, it isn't exported
+
+        inline static thread_local shard* _thread_shard = nullptr;
+    };
+
+    inline void whz_counter::inc(std::uint64_t n) const {
+        // Only this thread writes its shard, a relaxed load and store is enough and avoids a locked instruction
+        auto& value = whz_metrics::local_slot(_slot);
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void whz_gauge::inc(std::int64_t n) const {
+        auto& value = whz_metrics::local_slot(_slot);
+        value.store(value.load(std::memory_order_relaxed) + static_cast<std::uint64_t>(n), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The metrics of the server itself, registered on first use. Other components register theirs in the
+     * registry directly.
+     *
+     */
+    class whz_server_metrics {
+    public:
+        whz_counter connections_accepted;
+        whz_counter parse_errors;
+        whz_counter bytes_in;
+        whz_counter bytes_out;
+        whz_histogram request_duration;     /// From the first byte read to the reply written
+        whz_histogram handler_duration;     /// Time in request_handler::handle_request
+        whz_histogram template_duration;    /// Rendering of a .whzt page
+        whz_histogram lua_handler_duration; /// Lua request handler, from its start to its end, suspensions included
+
+        static whz_server_metrics& get();
+        /// Responses by status code
+        void count_response(std::uint16_t status) const;
+        /// Gauge of the open connections of one io_context
+        static whz_gauge active_connections(std::size_t io_context_index);
+
+    private:
+        whz_server_metrics();
+        std::vector<whz_counter> _responses;            /// [0] counts the codes without their own counter
+        std::array<std::uint8_t, 600> _status_index{};  /// Status code -> index in _responses
+    };
+
+} // whz
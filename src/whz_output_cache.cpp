@@ -0,0 +1,206 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_output_cache.hpp"
+#include <algorithm>
+#include <rapidhash.h>
+#include "whz_config.hpp"
+
+namespace whz {
+
+    whz_output_cache::whz_output_cache()
+            : _max_shard_bytes((std::size_t{64} * 1024 * 1024) / kShardCount), _default_ttl_s(60) {
+        if (Config::get_instance().is_config_loaded()) {
+            configure_from_config();
+        }
+    }
+
+    std::uint64_t whz_output_cache::make_key(std::string_view template_name, std::uint64_t data_hash) {
+        return rapidhash(template_name.data(), template_name.size()) ^ (data_hash * 0x9E3779B97F4A7C15ull);
+    }
+
+    std::uint64_t whz_output_cache::mix_pair(std::string_view name, std::string_view value) {
+        std::uint64_t name_hash = rapidhash(name.data(), name.size());
+        std::uint64_t value_hash = rapidhash(value.data(), value.size());
+        return rapidhash_withSeed(&value_hash, sizeof(value_hash), name_hash);
+    }
+
+    void whz_output_cache::configure(std::size_t max_bytes, std::chrono::seconds default_ttl) {
+        this->_max_shard_bytes.store(max_bytes / kShardCount, std::memory_order_relaxed);
+        this->_default_ttl_s.store(default_ttl.count(), std::memory_order_relaxed);
+        this->_enabled.store(max_bytes > 0, std::memory_order_relaxed);
+        if (max_bytes == 0) {
+            clear();
+        }
+    }
+
+    void whz_output_cache::configure_from_config() {
+        const config_snapshot &config = Config::get_instance().snapshot();
+        configure(config.output_cache_max_mb * 1024 * 1024, std::chrono::seconds{config.output_cache_ttl_s});
+    }
+
+    bool whz_output_cache::get(std::uint64_t key, std::string_view template_name, std::string &output,
+                               std::vector<std::string> *tags) {
+        if (!is_enabled()) {
+            return false;
+        }
+        std::shared_ptr<const std::string> content;
+        {
+            shard &s = shard_for(key);
+            std::shared_lock lock(s.mutex);
+            auto it = s.entries.find(key);
+            if (it == s.entries.end() || it->second.template_name != template_name ||
+                it->second.expires_at <= clock::now()) {
+                return false; // Expired entries are removed by the next put() on this shard
+            }
+            content = it->second.content;
+            if (tags != nullptr) {
+                tags->insert(tags->end(), it->second.tags.begin(), it->second.tags.end());
+            }
+        }
+        output.append(*content);
+        return true;
+    }
+
+    void whz_output_cache::put(std::uint64_t key, std::string_view template_name, std::string_view content,
+                               const std::vector<std::string> &tags, std::uint64_t render_epoch,
+                               std::chrono::seconds ttl) {
+        if (!is_enabled()) {
+            return;
+        }
+        if (ttl.count() == 0) {
+            ttl = std::chrono::seconds{this->_default_ttl_s.load(std::memory_order_relaxed)};
+        }
+        const auto now = clock::now();
+        const std::size_t max_shard_bytes = this->_max_shard_bytes.load(std::memory_order_relaxed);
+        if (content.size() > max_shard_bytes) {
+            return;
+        }
+
+        // Copied before any lock is taken, puts to other shards don't wait for it
+        entry e{std::string(template_name), std::make_shared<const std::string>(content), now + ttl, tags};
+        const std::shared_ptr<const std::string> stored = e.content;
+        std::vector<removed_entry> removed;
+        bool cached = false;
+        {
+            shard &s = shard_for(key);
+            std::unique_lock lock(s.mutex);
+            erase_locked(s, key, removed);
+            if (s.bytes + content.size() > max_shard_bytes) {
+                evict_expired_locked(s, now, removed);
+            }
+            if (s.bytes + content.size() <= max_shard_bytes) { // Else full of live entries, don't cache this one
+                s.bytes += content.size();
+                s.entries.emplace(key, std::move(e));
+                cached = true;
+            }
+        }
+
+        // Checked after the insert: an invalidate_tag() either comes later and finds the key in the tag index, or
+        // came earlier and its epoch is seen here
+        std::lock_guard tags_lock(this->_tags_mutex);
+        if (cached) {
+            const bool invalidated = std::ranges::any_of(tags, [&](const std::string &tag) {
+                auto it = this->_tag_epochs.find(tag);
+                return it != this->_tag_epochs.end() && it->second > render_epoch;
+            });
+            shard &s = shard_for(key);
+            std::unique_lock lock(s.mutex);
+            auto it = s.entries.find(key);
+            if (it == s.entries.end() || it->second.content != stored) {
+                cached = false; // Replaced or evicted by another put() meanwhile, which takes care of the index
+            } else if (invalidated) {
+                erase_locked(s, key, removed); // The data this was rendered from got invalidated meanwhile
+                cached = false;
+            }
+        }
+        unindex_locked(removed);
+        if (cached) {
+            for (const auto &tag : tags) {
+                this->_tagged_keys[tag].insert(key);
+            }
+        }
+    }
+
+    void whz_output_cache::invalidate_tag(const std::string &tag) {
+        std::lock_guard tags_lock(this->_tags_mutex);
+        this->_tag_epochs[tag] = this->_epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+        auto it = this->_tagged_keys.find(tag);
+        if (it == this->_tagged_keys.end()) {
+            return;
+        }
+        auto keys = std::move(it->second);
+        this->_tagged_keys.erase(it);
+        std::vector<removed_entry> removed;
+        for (std::uint64_t key : keys) {
+            shard &s = shard_for(key);
+            std::unique_lock lock(s.mutex);
+            erase_locked(s, key, removed);
+        }
+        unindex_locked(removed); // The other tags of the dropped entries
+        WHZ_LOG_DEBUG(this->_qlogger, "Output cache: invalidated tag {}", tag);
+    }
+
+    void whz_output_cache::clear() {
+        std::lock_guard tags_lock(this->_tags_mutex);
+        for (auto &s : this->_shards) {
+            std::unique_lock lock(s.mutex);
+            s.entries.clear();
+            s.bytes = 0;
+        }
+        this->_tagged_keys.clear();
+    }
+
+    // Both helpers expect the unique lock of the shard to be held, the tags of what they remove are left for
+    // unindex_locked()
+    void whz_output_cache::erase_locked(shard &s, std::uint64_t key, std::vector<removed_entry> &removed) {
+        auto it = s.entries.find(key);
+        if (it == s.entries.end()) {
+            return;
+        }
+        s.bytes -= it->second.content->size();
+        if (!it->second.tags.empty()) {
+            removed.push_back(removed_entry{key, std::move(it->second.tags)});
+        }
+        s.entries.erase(it);
+    }
+
+    void whz_output_cache::evict_expired_locked(shard &s, clock::time_point now, std::vector<removed_entry> &removed) {
+        std::vector<std::uint64_t> expired;
+        for (const auto &[key, e] : s.entries) {
+            if (e.expires_at <= now) {
+                expired.push_back(key);
+            }
+        }
+        for (std::uint64_t key : expired) {
+            erase_locked(s, key, removed);
+        }
+    }
+
+    // Expects the tags mutex to be held and no shard lock. A key that was put again meanwhile keeps the tags the new
+    // entry has, that put() indexes them.
+    void whz_output_cache::unindex_locked(std::vector<removed_entry> &removed) {
+        for (const auto &[key, tags] : removed) {
+            shard &s = shard_for(key);
+            std::shared_lock lock(s.mutex);
+            auto current = s.entries.find(key);
+            for (const auto &tag : tags) {
+                if (current != s.entries.end() &&
+                    std::ranges::find(current->second.tags, tag) != current->second.tags.end()) {
+                    continue;
+                }
+                auto tagged = this->_tagged_keys.find(tag);
+                if (tagged != this->_tagged_keys.end()) {
+                    tagged->second.erase(key);
+                    if (tagged->second.empty()) {
+                        this->_tagged_keys.erase(tagged);
+                    }
+                }
+            }
+        }
+        removed.clear();
+    }
+
+} // whz
@@ -0,0 +1,125 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include "whz_quill_wrapper.hpp"
+
+namespace whz {
+
+    /**
+     * @brief Singleton cache of rendered output, for whole pages as well as for single partials. An entry is keyed by
+     * the template (or page) name and the hash of the data it was rendered with, it expires after its TTL and can be
+     * tagged with the things it depends on, e.g. "table:products". Invalidating a tag drops all entries carrying it.
+     *
+     * Lookups only take a shared lock on one of the shards, a put() the unique lock of one shard and the tags lock
+     * only to check the epochs and index the tags. To not cache output rendered from data that was changed while
+     * rendering, take an epoch() before fetching the data and hand it to put(): the entry is dropped if one of its
+     * tags was invalidated since.
+     *
+     */
+    class whz_output_cache {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        whz_output_cache(const whz_output_cache &) = delete;
+        whz_output_cache &operator=(const whz_output_cache &) = delete;
+
+        static whz_output_cache &getInstance() {
+            static whz_output_cache instance;
+            return instance;
+        }
+
+        /// Build the cache key of a template rendered with the given data hash
+        static std::uint64_t make_key(std::string_view template_name, std::uint64_t data_hash);
+        /// Order independent hash of name/value pairs, e.g. the fields of a DataContext
+        template <typename Map>
+        static std::uint64_t hash_data(const Map &data) {
+            std::uint64_t hash = data.size();
+            for (const auto &[name, value] : data) {
+                hash += mix_pair(name, value); // Commutative, the map order doesn't matter
+            }
+            return hash;
+        }
+
+        /// Append the cached output to the buffer, returns false on a miss or an expired entry. The tags the entry was
+        /// stored with are appended to tags if given, output built from the entry depends on them as well.
+        bool get(std::uint64_t key, std::string_view template_name, std::string &output,
+                 std::vector<std::string> *tags = nullptr);
+        /// Store rendered output, ttl 0 uses the default TTL. Skipped if a tag was invalidated after render_epoch.
+        void put(std::uint64_t key, std::string_view template_name, std::string_view content,
+                 const std::vector<std::string> &tags, std::uint64_t render_epoch,
+                 std::chrono::seconds ttl = std::chrono::seconds{0});
+
+        /// Drop all entries tagged with the tag, e.g. invalidate_tag("table:products")
+        void invalidate_tag(const std::string &tag);
+        /// Drop everything
+        void clear();
+
+        /// The current invalidation epoch, take it before fetching the data to render
+        [[nodiscard]] std::uint64_t epoch() const { return _epoch.load(std::memory_order_acquire); }
+        [[nodiscard]] bool is_enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+        /// Set the limits, a max_bytes of 0 turns the cache off
+        void configure(std::size_t max_bytes, std::chrono::seconds default_ttl);
+        /// Set the limits from OUTPUT_CACHE_MAX_MB and OUTPUT_CACHE_TTL_S of the loaded config
+        void configure_from_config();
+
+    private:
+        whz_output_cache();
+
+        static std::uint64_t mix_pair(std::string_view name, std::string_view value);
+
+        struct entry {
+            std::string template_name;
+            std::shared_ptr<const std::string> content;
+            clock::time_point expires_at;
+            std::vector<std::string> tags;
+        };
+
+        struct shard {
+            std::shared_mutex mutex;
+            std::unordered_map<std::uint64_t, entry> entries;
+            std::size_t bytes = 0;
+        };
+
+        static constexpr std::size_t kShardCount = 16;
+
+        /// An entry taken out of its shard whose tags still have to be removed from the tag index
+        struct removed_entry {
+            std::uint64_t key;
+            std::vector<std::string> tags;
+        };
+
+        shard &shard_for(std::uint64_t key) { return _shards[key % kShardCount]; }
+        void erase_locked(shard &s, std::uint64_t key, std::vector<removed_entry> &removed);
+        void evict_expired_locked(shard &s, clock::time_point now, std::vector<removed_entry> &removed);
+        void unindex_locked(std::vector<removed_entry> &removed);
+
+        std::array<shard, kShardCount> _shards;
+
+        std::mutex _tags_mutex;     /// Guards the tag index and the tag epochs, taken before a shard lock if both are
+        std::unordered_map<std::string, std::unordered_set<std::uint64_t>> _tagged_keys;
+        std::unordered_map<std::string, std::uint64_t> _tag_epochs;
+        std::atomic<std::uint64_t> _epoch{1};
+
+        std::atomic<bool> _enabled{true};
+        std::atomic<std::size_t> _max_shard_bytes;
+        std::atomic<std::int64_t> _default_ttl_s;
+        whz::whz_qlogger _qlogger{"output_cache"};
+    };
+
+} // whz
@@ -1,4 +1,7 @@
 #include "whz_quill_wrapper.hpp"
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
 #include "quill/Backend.h"
 #include "quill/Frontend.h"
 #include "quill/LogMacros.h"
@@ -13,175 +16,125 @@
 
 
 namespace whz {
-    whz_qlogger::whz_qlogger() {
-        // TODO - add configurations for the logger
 
-        quill::BackendOptions backend_options;
-        quill::Backend::start(backend_options);
-
-
-        std::shared_ptr<quill::Sink> rotating_file_sink_a =
-                quill::Frontend::create_or_get_sink<quill::RotatingFileSink>("whz_logfile.log",
-                                                     []() {
-                                                         quill::RotatingFileSinkConfig rfh_cfg;
-                                                         rfh_cfg.set_rotation_time_daily("00:00");
-                                                         rfh_cfg.set_open_mode('w');
-                                                         rfh_cfg.set_rotation_max_file_size(1024 * 1024 * 5);
-                                                         rfh_cfg.set_remove_old_files(false);
-                                                         rfh_cfg.set_timezone(quill::Timezone::LocalTime);
-                                                         rfh_cfg.set_rotation_naming_scheme(quill::RotatingFileSinkConfig::RotationNamingScheme::DateAndTime);
-                                                         rfh_cfg.set_filename_append_option( quill::FilenameAppendOption::StartDateTime);
-                                                         return rfh_cfg;
-                                                     }());
-
-        // Create a logger with the rotating file sink and format the output properly
-        this->qlogger = quill::Frontend::create_or_get_logger("logger_user", std::move(rotating_file_sink_a),
-                                                              "%(time) [%(thread_id)] %(short_source_location:<28) "
-                                                              "%(log_level:<9) %(logger:<12) %(message)",
-                                                              "%H:%M:%S.%Qus");
-    }
-
-    whz_qlogger::~whz_qlogger() {
-        if (!this->is_backend_closed) {
-            this->qlogger->flush_log();
+    namespace {
+        // The one log file of the process and the quill loggers handed out for it, by name
+        struct logger_registry {
+            std::once_flag started;
+            std::mutex mutex;
+            std::shared_ptr<quill::Sink> sink;
+            std::unordered_map<std::string, quill::Logger*> loggers;
+        };
+
+        logger_registry& Registry() {
+            static logger_registry registry;
+            return registry;
+        }
+
+        quill::RotatingFileSinkConfig SinkConfigFromConfig() {
+            const auto rotation_mb = Config::get<Config::ConfigParameter::LOG_ROTATION_MB>();
+            const auto rotation_days = Config::get<Config::ConfigParameter::LOG_ROTATION_DAYS>();
+
+            quill::RotatingFileSinkConfig rfh_cfg;
+            if (rotation_days == 1) {
+                rfh_cfg.set_rotation_time_daily("00:00");
+            } else if (rotation_days > 1) {
+                rfh_cfg.set_rotation_frequency_and_interval('H', rotation_days * 24);
+            }
+            rfh_cfg.set_open_mode('w');
+            if (rotation_mb > 0) {
+                rfh_cfg.set_rotation_max_file_size(rotation_mb * 1024 * 1024);
+            }
+            rfh_cfg.set_remove_old_files(false);
+            rfh_cfg.set_timezone(quill::Timezone::LocalTime);
+            rfh_cfg.set_rotation_naming_scheme(quill::RotatingFileSinkConfig::RotationNamingScheme::DateAndTime);
+            rfh_cfg.set_filename_append_option(quill::FilenameAppendOption::StartDateTime);
+            return rfh_cfg;
         }
     }
 
-    void whz_qlogger::trace_L3(const std::string& fmtstr) {
-        bool bLogVal = false;
+    void whz_qlogger::setup() {
+        logger_registry& registry = Registry();
+        std::call_once(registry.started, [&registry] {
+            quill::BackendOptions backend_options;
+            quill::Backend::start(backend_options);
 
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_TRACE_L3).type() == typeid(bool)) {
-            std::cout << "Type of LOG_TRACE_L3 is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_TRACE_L3));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_TRACE_L3(this->qlogger, "{}", fmtstr);
-        }
-    }
-
-    void whz_qlogger::trace_L2(const std::string& fmtstr) {
-        bool bLogVal = false;
+            std::filesystem::path log_file = Config::get<Config::ConfigParameter::LOG_PATH>();
+            const auto& filename = Config::get<Config::ConfigParameter::LOG_FILENAME>();
+            log_file /= filename.empty() ? std::string("whz_logfile.log") : filename;
 
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_TRACE_L2).type() == typeid(bool)) {
-            std::cout << "Type of LOG_TRACE_L2 is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_TRACE_L2));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_TRACE_L2(this->qlogger, "{}", fmtstr);
-        }
+            std::lock_guard lock(registry.mutex);
+            registry.sink = quill::Frontend::create_or_get_sink<quill::RotatingFileSink>(log_file.string(),
+                                                                                        SinkConfigFromConfig());
+        });
     }
 
-    void whz_qlogger::trace_L1(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_TRACE_L1).type() == typeid(bool)) {
-            std::cout << "Type of LOG_TRACE_L1 is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_TRACE_L1));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_TRACE_L1(this->qlogger, "{}", fmtstr);
-        }
+    quill::Logger* whz_qlogger::logger_for(const std::string& name) {
+        setup();
+        logger_registry& registry = Registry();
+        std::lock_guard lock(registry.mutex);
+        auto [it, inserted] = registry.loggers.try_emplace(name, nullptr);
+        if (inserted) {
+            // Create a logger with the rotating file sink and format the output properly
+            it->second = quill::Frontend::create_or_get_logger(name, registry.sink,
+                                                               "%(time) [%(thread_id)] %(short_source_location:<28) "
+                                                               "%(log_level:<9) %(logger:<12) %(message)",
+                                                               "%H:%M:%S.%Qus");
+        }
+        return it->second;
     }
 
-    void whz_qlogger::debug(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_DEBUG).type() == typeid(bool)) {
-            std::cout << "Type of LOG_DEBUG is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_DEBUG));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_DEBUG(this->qlogger, "{}", fmtstr);
-        }
+    void whz_qlogger::refresh_levels() {
+        static constexpr std::pair<bool config_snapshot::*, level> switches[] = {
+                {&config_snapshot::log_trace_L3, level_trace_L3},
+                {&config_snapshot::log_trace_L2, level_trace_L2},
+                {&config_snapshot::log_trace_L1, level_trace_L1},
+                {&config_snapshot::log_debug, level_debug},
+                {&config_snapshot::log_info, level_info},
+                {&config_snapshot::log_warning, level_warning},
+                {&config_snapshot::log_error, level_error},
+                {&config_snapshot::log_critical, level_critical},
+                {&config_snapshot::log_backtrace, level_backtrace},
+        };
+
+        const config_snapshot& config = whz::Config::get_instance().snapshot();
+        std::uint32_t mask = 0;
+        for (const auto& [enabled, lvl] : switches) {
+            if (config.*enabled) {
+                mask |= lvl;
+            }
+        }
+        s_enabled_levels.store(mask, std::memory_order_relaxed);
     }
 
-    void whz_qlogger::info(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        std::cout << "Type of LOG_INFO is: " << whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_INFO).type().name() << std::endl;
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_INFO).type() == typeid(bool)) {
-            std::cout << "Type of LOG_INFO is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_INFO));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_INFO(this->qlogger, "{}", fmtstr);
+    void whz_qlogger::log(level lvl, const std::string& fmtstr) {
+        switch (lvl) {
+            case level_trace_L3: LOG_TRACE_L3(this->quill_logger(), "{}", fmtstr); break;
+            case level_trace_L2: LOG_TRACE_L2(this->quill_logger(), "{}", fmtstr); break;
+            case level_trace_L1: LOG_TRACE_L1(this->quill_logger(), "{}", fmtstr); break;
+            case level_debug: LOG_DEBUG(this->quill_logger(), "{}", fmtstr); break;
+            case level_info: LOG_INFO(this->quill_logger(), "{}", fmtstr); break;
+            case level_warning: LOG_WARNING(this->quill_logger(), "{}", fmtstr); break;
+            case level_error: LOG_ERROR(this->quill_logger(), "{}", fmtstr); break;
+            case level_critical: LOG_CRITICAL(this->quill_logger(), "{}", fmtstr); break;
+            case level_backtrace: LOG_BACKTRACE(this->quill_logger(), "{}", fmtstr); break;
         }
     }
 
-    void whz_qlogger::warning(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_WARNING).type() == typeid(bool)) {
-            std::cout << "Type of LOG_WARNING is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_WARNING));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_WARNING(this->qlogger, "{}", fmtstr);
-        }
-    }
-
-    void whz_qlogger::error(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_ERROR).type() == typeid(bool)) {
-            std::cout << "Type of LOG_ERROR is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_ERROR));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_ERROR(this->qlogger, "{}", fmtstr);
-        }
-    }
-
-    void whz_qlogger::critical(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_CRITICAL).type() == typeid(bool)) {
-            std::cout << "Type of LOG_CRITICAL is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_CRITICAL));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_CRITICAL(this->qlogger, "{}", fmtstr);
-        }
-    }
-
-    void whz_qlogger::backtrace(const std::string& fmtstr) {
-        bool bLogVal = false;
-
-        if (whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_BACKTRACE).type() == typeid(bool)) {
-            std::cout << "Type of LOG_BACKTRACE is bool" << std::endl;
-            bLogVal = std::any_cast<bool>(whz::Config::get_instance().get_config_value(Config::ConfigParameter::LOG_BACKTRACE));
-            std::cout << "Type of bLogVal is: " << bLogVal << std::endl;
-        }
-        // Check if the value from Config is true then log, else do nothing
-        if (bLogVal) {
-            LOG_BACKTRACE(this->qlogger, "{}", fmtstr);
-        }
-    }
-
-    /** Flushes the log and stops the backend process explicitly if this is the last object to close. Has to be called
-     * explicitly to ensure that the log is flushed before the program exits and the backend is closed properly.
+    /** Flushes the log and stops the backend. Has to be called explicitly to ensure that the log is flushed before the
+     * program exits and the backend is closed properly. The loggers stay registered, messages logged later are dropped.
      *
      */
-    void whz_qlogger::stopLogger() {
-        this->qlogger->flush_log();
-        quill::Frontend::remove_logger(this->qlogger);
+    void whz_qlogger::shutdown() {
+        s_enabled_levels.store(0, std::memory_order_relaxed);
+        logger_registry& registry = Registry();
+        std::lock_guard lock(registry.mutex);
+        if (registry.sink == nullptr) {
+            return; // Never started
+        }
+        if (!registry.loggers.empty()) {
+            registry.loggers.begin()->second->flush_log();
+        }
         quill::Backend::stop();
-        this->is_backend_closed = true;
     }
 } // namespace whz
@@ -2,9 +2,13 @@
 
 //#include "quill/Backend.h"
 //#include "quill/Frontend.h"
-//#include "quill/LogMacros.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
 #include "fmt/format.h"
 #include "quill/Logger.h"
+#include "quill/LogMacros.h"
 
 
 //#include "quill/sinks/ConsoleSink.h"
@@ -13,36 +17,116 @@
 namespace whz {
 
     /**
-     * @brief Logger class that offers a rotating file as the target for the log output. Use the trace_L3, trace_L2,
-     * trace_L1, debug, info, warning, error, critical, and backtrace methods to log messages. Prepare the fmtstr with
-     * fmt::format() before calling the log methods so you can easily add variables to the log message. Configure the
-     * details of the rotating file in the configuration file.
+     * @brief Logger class that offers a rotating file as the target for the log output. Log with the WHZ_LOG_* macros
+     * below, e.g. WHZ_LOG_ERROR(this->_qlogger, "Failed to open {}", path), they take the format string and its
+     * arguments and leave the formatting to the quill backend thread. The trace_L3, trace_L2, trace_L1, debug, info,
+     * warning, error, critical, and backtrace methods log a string that is already formatted. Configure the details
+     * of the rotating file in the configuration file.
+     *
+     * All loggers write to one rotating file set up once per process, see setup(). A whz_qlogger is only a named
+     * handle on it: constructing one doesn't call quill, the quill logger of the name is looked up on the first
+     * message, so classes can hold one as member at no cost.
      *
      */
     class whz_qlogger {
     public:
-        whz_qlogger();      /// Initializes the logger, quill backend is a singleton
-        ~whz_qlogger();     /// Flushes the log
-        void stopLogger();
+        /// One bit per log level in the enabled mask, see refresh_levels()
+        enum level : std::uint32_t {
+            level_trace_L3  = 1u << 0,
+            level_trace_L2  = 1u << 1,
+            level_trace_L1  = 1u << 2,
+            level_debug     = 1u << 3,
+            level_info      = 1u << 4,
+            level_warning   = 1u << 5,
+            level_error     = 1u << 6,
+            level_critical  = 1u << 7,
+            level_backtrace = 1u << 8
+        };
+
+        whz_qlogger() : whz_qlogger("whz") {}      /// The logger of the server itself
+        explicit whz_qlogger(std::string_view component) : qlogger_name(component) {}  /// Logger of a component
+        whz_qlogger(const whz_qlogger& other) : qlogger(other.qlogger.load(std::memory_order_acquire)),
+                                                 qlogger_name(other.qlogger_name) {}
+        whz_qlogger& operator=(const whz_qlogger& other) {
+            this->qlogger.store(other.qlogger.load(std::memory_order_acquire), std::memory_order_release);
+            this->qlogger_name = other.qlogger_name;
+            return *this;
+        }
+        ~whz_qlogger() = default;
+
+        /**
+         * @brief Start the quill backend and open the rotating log file from LOG_PATH, LOG_FILENAME, LOG_ROTATION_MB
+         * and LOG_ROTATION_DAYS of the loaded config. Done once per process, later calls return right away. Call it
+         * after reading the config, otherwise the first logged message does it.
+         */
+        static void setup();
+        /// Flush the log and stop the backend, has to be called before the program exits
+        static void shutdown();
+        void stopLogger() { shutdown(); }
+
+        /// Re-read the LOG_* switches from the config into the enabled mask, done by Config::read_config()
+        static void refresh_levels();
+        /// True if messages of this level are logged, a single load and branch
+        [[nodiscard]] static bool is_enabled(level lvl) {
+            return (s_enabled_levels.load(std::memory_order_relaxed) & lvl) != 0;
+        }
 
         /// Log APIs to use, output is defined in the configuration file
-        void trace_L3(const std::string& fmtstr);  /// Enter a fmt-formatted string
-        void trace_L2(const std::string& fmtstr);  /// Enter a fmt-formatted string
-        void trace_L1(const std::string& fmtstr);  /// Enter a fmt-formatted string
-        void debug(const std::string& fmtstr);      /// Enter a fmt-formatted string
-        void info(const std::string& fmtstr);       /// Enter a fmt-formatted string
-        void warning(const std::string& fmtstr);    /// Enter a fmt-formatted string
-        void error(const std::string& fmtstr);      /// Enter a fmt-formatted string
-        void critical(const std::string& fmtstr);   /// Enter a fmt-formatted string
-        void backtrace(const std::string& fmtstr);  /// Enter a fmt-formatted string
+        void trace_L3(const std::string& fmtstr) { if (is_enabled(level_trace_L3)) log(level_trace_L3, fmtstr); }  /// Enter a fmt-formatted string
+        void trace_L2(const std::string& fmtstr) { if (is_enabled(level_trace_L2)) log(level_trace_L2, fmtstr); }  /// Enter a fmt-formatted string
+        void trace_L1(const std::string& fmtstr) { if (is_enabled(level_trace_L1)) log(level_trace_L1, fmtstr); }  /// Enter a fmt-formatted string
+        void debug(const std::string& fmtstr) { if (is_enabled(level_debug)) log(level_debug, fmtstr); }            /// Enter a fmt-formatted string
+        void info(const std::string& fmtstr) { if (is_enabled(level_info)) log(level_info, fmtstr); }               /// Enter a fmt-formatted string
+        void warning(const std::string& fmtstr) { if (is_enabled(level_warning)) log(level_warning, fmtstr); }      /// Enter a fmt-formatted string
+        void error(const std::string& fmtstr) { if (is_enabled(level_error)) log(level_error, fmtstr); }            /// Enter a fmt-formatted string
+        void critical(const std::string& fmtstr) { if (is_enabled(level_critical)) log(level_critical, fmtstr); }   /// Enter a fmt-formatted string
+        void backtrace(const std::string& fmtstr) { if (is_enabled(level_backtrace)) log(level_backtrace, fmtstr); } /// Enter a fmt-formatted string
+
+        /// The quill logger the WHZ_LOG_* macros write to
+        [[nodiscard]] quill::Logger* quill_logger() const {
+            quill::Logger* logger = this->qlogger.load(std::memory_order_acquire);
+            if (logger == nullptr) [[unlikely]] {
+                logger = logger_for(this->qlogger_name);
+                this->qlogger.store(logger, std::memory_order_release);
+            }
+            return logger;
+        }
 
     private:
-        bool is_backend_closed = false;
-        quill::Logger* qlogger;
+        void log(level lvl, const std::string& fmtstr);   /// Hands the message to quill, the level is enabled
+        // The quill logger of this name writing to the shared file, created on the first call for a name
+        static quill::Logger* logger_for(const std::string& name);
+
+        inline static std::atomic<std::uint32_t> s_enabled_levels{0};  /// Nothing is logged before the config is read
+        mutable std::atomic<quill::Logger*> qlogger{nullptr};   /// Resolved on the first message
         std::string qlogger_name;
     };
 }
 
+/**
+ * Format-deferred logging. The format string must be a string literal, it's checked against the arguments at compile
+ * time. If the level is enabled the arguments are copied into the queue of the calling thread and formatted and written
+ * by the quill backend thread, if not they aren't even evaluated. Arguments must be types quill can copy: numbers,
+ * strings, string_views and C strings, convert anything else (e.g. path.string()) in the call.
+ */
+#define WHZ_LOG_AT(logger, lvl, quill_macro, fmt, ...)                                          \
+    do {                                                                                         \
+        if (whz::whz_qlogger::is_enabled(whz::whz_qlogger::lvl)) {                               \
+            quill_macro((logger).quill_logger(), fmt __VA_OPT__(,) __VA_ARGS__);                 \
+        }                                                                                        \
+    } while (0)
+
+#define WHZ_LOG_TRACE_L3(logger, fmt, ...) WHZ_LOG_AT(logger, level_trace_L3, LOG_TRACE_L3, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_TRACE_L2(logger, fmt, ...) WHZ_LOG_AT(logger, level_trace_L2, LOG_TRACE_L2, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_TRACE_L1(logger, fmt, ...) WHZ_LOG_AT(logger, level_trace_L1, LOG_TRACE_L1, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_DEBUG(logger, fmt, ...) WHZ_LOG_AT(logger, level_debug, LOG_DEBUG, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_INFO(logger, fmt, ...) WHZ_LOG_AT(logger, level_info, LOG_INFO, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_WARNING(logger, fmt, ...) WHZ_LOG_AT(logger, level_warning, LOG_WARNING, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_ERROR(logger, fmt, ...) WHZ_LOG_AT(logger, level_error, LOG_ERROR, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_CRITICAL(logger, fmt, ...) WHZ_LOG_AT(logger, level_critical, LOG_CRITICAL, fmt __VA_OPT__(,) __VA_ARGS__)
+#define WHZ_LOG_BACKTRACE(logger, fmt, ...) WHZ_LOG_AT(logger, level_backtrace, LOG_BACKTRACE, fmt __VA_OPT__(,) __VA_ARGS__)
+
+
 /*
 LOG_TRACE_L3(logger, fmt, ...)
 LOG_TRACE_L2(logger, fmt, ...)
@@ -3,6 +3,71 @@
 //
 
 #include "whz_renderer.hpp"
+#include <algorithm>
 
 namespace whz {
-} // whz
\ No newline at end of file
+
+    bool whz_renderer::render_page(whz::MMPathlist& page_to_render, std::vector<std::string>& page_partials) {
+        return render_page(page_to_render, page_partials, DataContext{});
+    }
+
+    bool whz_renderer::render_page(whz::MMPathlist& page_to_render, std::vector<std::string>& page_partials,
+                                   const DataContext& data, const std::vector<std::string>& cache_tags) {
+        auto& output_cache = whz_output_cache::getInstance();
+        const auto render_epoch = output_cache.epoch();
+        const auto data_hash = whz_output_cache::hash_data(data.data);
+
+        std::vector<std::string> partial_paths;
+        partial_paths.reserve(page_partials.size());
+        std::string page_name = "page:";
+        for (const auto& partial : page_partials) {
+            auto it = page_to_render.find(partial);
+            partial_paths.push_back(it != page_to_render.end() ? it->second : partial);
+            page_name += partial_paths.back() + '|';
+        }
+
+        this->_rendered_page_content.clear();
+        const auto page_key = whz_output_cache::make_key(page_name, data_hash);
+        if (output_cache.get(page_key, page_name, this->_rendered_page_content)) {
+            return true;
+        }
+
+        std::vector<std::string> page_tags = cache_tags;
+        for (const auto& path : partial_paths) {
+            std::vector<std::string> partial_tags = cache_tags;
+            partial_tags.push_back("template:" + path);
+            page_tags.push_back(partial_tags.back());
+
+            const auto partial_key = whz_output_cache::make_key(path, data_hash);
+            if (output_cache.get(partial_key, path, this->_rendered_page_content, &page_tags)) {
+                continue; // Its tags include the ones of the partials it uses, the page depends on them as well
+            }
+
+            auto compiled_exp = whz_templateCache::getInstance().getCompiledTemplate(path);
+            if (!compiled_exp) {
+                WHZ_LOG_ERROR(this->_qlogger, "Rendering page failed: {}", compiled_exp.error());
+                return false;
+            }
+            const auto partial_start = this->_rendered_page_content.size();
+            std::vector<std::string> used_partials;
+            auto rendered = TemplateProcessor::RenderTemplate(**compiled_exp, path, data, this->_rendered_page_content,
+                                                              &used_partials);
+            if (!rendered) {
+                WHZ_LOG_ERROR(this->_qlogger, "Rendering page failed for {}: {}", path, rendered.error());
+                return false;
+            }
+            for (const auto& used : used_partials) {
+                partial_tags.push_back("template:" + used);
+                page_tags.push_back(partial_tags.back());
+            }
+            output_cache.put(partial_key, path, std::string_view(this->_rendered_page_content).substr(partial_start),
+                             partial_tags, render_epoch);
+        }
+
+        std::ranges::sort(page_tags);
+        page_tags.erase(std::unique(page_tags.begin(), page_tags.end()), page_tags.end());
+        output_cache.put(page_key, page_name, this->_rendered_page_content, page_tags, render_epoch);
+        return true;
+    }
+
+} // whz
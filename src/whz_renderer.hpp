@@ -7,6 +7,8 @@
 #include <vector>
 #include <string>
 #include "whz_http_routing.hpp"
+#include "whz_templating.hpp"
+#include "whz_output_cache.hpp"
 #include "whz_quill_wrapper.hpp"
 
 
@@ -17,17 +19,30 @@ namespace whz {
      * substitution is done by user scripts/code like getting data from the DB. The users code has to call the renderer
      * when the page is ready to be served.
      *
+     * The rendered partials and the composed page are kept in the whz_output_cache, keyed by the template and the hash
+     * of the data. As long as neither the data nor the templates change, a page is composed from the cache only.
+     *
      */
     class whz_renderer {
     public:
         whz_renderer() = default;
         ~whz_renderer() = default;
 
+        /// Compose the page from its partials without any data
         bool render_page(whz::MMPathlist& page_to_render, std::vector<std::string>& page_partials);
+        /** Compose the page from its partials in the given order. A partial is looked up by name in page_to_render to
+         * get its template path, or used as path itself if it's not in there.
+         *
+         * @param data The data for all partials
+         * @param cache_tags What the page depends on besides its templates, e.g. "table:products" for invalidation
+         */
+        bool render_page(whz::MMPathlist& page_to_render, std::vector<std::string>& page_partials,
+                         const DataContext& data, const std::vector<std::string>& cache_tags = {});
         std::string getRenderedPageContent() const { return _rendered_page_content; };
 
     private:
         std::string _rendered_page_content;
+        whz::whz_qlogger _qlogger{"renderer"};
     };
 
 
@@ -1,11 +1,16 @@
 #include "whz_request_handler.hpp"
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include "whz_config.hpp"
+#include "whz_LUA_pool.hpp"
+#include "whz_metrics.hpp"
 
 namespace whz {
     request_handler::request_handler(std::filesystem::path document_root)
-            : document_root(std::move(document_root)) {}
+            : document_root(std::move(document_root)) {
+    }
 
     auto request_handler::handle_request(const request& req, reply& rep) -> void {
         auto request_path = url_decode(req.uri);
@@ -16,6 +21,12 @@ namespace whz {
         }
 
         std::string_view req_path = request_path.value();
+        // Read per request, a config reload can move or turn off the endpoint
+        const auto& metrics_path = Config::get<Config::ConfigParameter::METRICS_PATH>();
+        if (!metrics_path.empty() && req_path == metrics_path) {
+            handle_metrics_request(rep);
+            return;
+        }
 
         if (req_path.empty() || !req_path.starts_with("/") ||
             req_path.contains("..")) {
@@ -31,6 +42,11 @@ namespace whz {
         // Here be dragons
 
         std::string full_path = std::string{document_root} + request_path.value();
+        if (template_processor_ && std::filesystem::path(full_path).extension() == ".whzt") {
+            handle_template_request(full_path, rep);
+            return;
+        }
+
         std::ifstream is(full_path, std::ios::in | std::ios::binary);
 
         if (!is) {
@@ -48,8 +64,100 @@ namespace whz {
         rep.headers[0].name = "Content-Length";
         rep.headers[0].value = std::to_string(rep.content.size());
         rep.headers[1].name = "Content-Type";
-        rep.headers[1].value = "text/html"; // TODO(bc): Support other mime_types by
-        // reading the extension of request
+        rep.headers[1].value = mime_types::path_to_type(full_path);
+    }
+
+    auto request_handler::set_template_processor(std::shared_ptr<TemplateProcessor> processor) -> void {
+        template_processor_ = std::move(processor);
+    }
+
+    auto request_handler::handle_template_request(const std::string& full_path, reply& rep) -> void {
+        // Render straight into the reply body, it's the buffer that gets written to the socket
+        rep.content.clear();
+        const auto render_start = std::chrono::steady_clock::now();
+        auto result = template_processor_->ProcessTemplate(full_path, rep.content);
+        whz_server_metrics::get().template_duration.observe(std::chrono::steady_clock::now() - render_start);
+        if (!result) {
+            rep = reply::stock_reply(std::filesystem::exists(full_path) ? reply::internal_server_error : reply::not_found);
+            return;
+        }
+
+        rep.status = reply::ok;
+        rep.headers.resize(2);
+        rep.headers[0].name = "Content-Length";
+        rep.headers[0].value = std::to_string(rep.content.size());
+        rep.headers[1].name = "Content-Type";
+        rep.headers[1].value = mime_types::path_to_type(full_path);
+    }
+
+    auto request_handler::set_LUA_pool(std::shared_ptr<whz_LUA_pool> pool, std::shared_ptr<whz_db_pool> db_pool) -> void {
+        lua_pool_ = std::move(pool);
+        db_pool_ = std::move(db_pool);
+    }
+
+    auto request_handler::is_LUA_request(const request& req) const -> bool {
+        if (!lua_pool_) {
+            return false;
+        }
+        // Read per request, a config reload can move the Lua routes
+        const auto& prefix = Config::get<Config::ConfigParameter::LUA_ROUTE_PREFIX>();
+        return !prefix.empty() && req.uri.starts_with(prefix);
+    }
+
+    /**
+     * @brief The handler is the function the startup script stored under the request path in its global whz_routes
+     * table. Every request runs as its own coroutine on one of the states bound to the io thread, so a handler waiting
+     * on a timer or a query doesn't hold up the other requests of the thread. A thread the pool had no states left
+     * for answers 503.
+     *
+     */
+    auto request_handler::handle_LUA_request(const request& req, reply& rep, boost::asio::io_context& io,
+                                             std::function<void()> done) -> void {
+        whz_LUA_state* state = lua_pool_->thread_state(io, db_pool_);
+        if (state == nullptr) {
+            rep = reply::stock_reply(reply::service_unavailable);
+            done();
+            return;
+        }
+
+        const std::string path(whz_LUA_request(req).path());
+        sol::object handler = sol::lua_nil;
+        if (sol::optional<sol::table> routes = state->lua()["whz_routes"]) {
+            handler = (*routes)[path];
+        }
+        if (handler.get_type() != sol::type::function) {
+            rep = reply::stock_reply(reply::not_found);
+            done();
+            return;
+        }
+
+        rep.status = reply::ok;
+        rep.content.clear();
+        rep.headers.clear();
+        state->api().handle_request(handler.as<sol::protected_function>(), req, rep,
+                                    [done = std::move(done), &rep](std::expected<std::string, std::string> result) {
+            if (!result) {
+                rep = reply::stock_reply(reply::internal_server_error);
+            } else {
+                whz_LUA_reply view(rep);
+                view.set_header("Content-Length", std::to_string(rep.content.size()));
+                if (!view.has_header("Content-Type")) {
+                    view.set_header("Content-Type", "text/html");
+                }
+            }
+            done();
+        });
+    }
+
+    /// Prometheus scrape, the metrics are summed up over all threads here and only here
+    auto request_handler::handle_metrics_request(reply& rep) -> void {
+        rep.status = reply::ok;
+        rep.content = whz_metrics::getInstance().scrape();
+        rep.headers.resize(2);
+        rep.headers[0].name = "Content-Length";
+        rep.headers[0].value = std::to_string(rep.content.size());
+        rep.headers[1].name = "Content-Type";
+        rep.headers[1].value = "text/plain; version=0.0.4";
     }
 
 }; // namespace whz
\ No newline at end of file
@@ -1,19 +1,44 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <boost/asio/io_context.hpp>
 #include "whz_common.hpp"
 #include "whz_utils.hpp"
+#include "whz_templating.hpp"
 #include "whz_quill_wrapper.hpp"
 
 
 namespace whz {
+    class whz_db_pool;
+    class whz_LUA_pool;
+
     class request_handler {
     public:
         explicit request_handler(std::filesystem::path document_root);
 
         auto handle_request(const whz::request& req, whz::reply& rep) -> void;
 
+        /// Requests for .whzt files are rendered by this processor instead of being served as files
+        auto set_template_processor(std::shared_ptr<TemplateProcessor> processor) -> void;
+        /// Requests below LUA_ROUTE_PREFIX are answered by the Lua handlers of the pool's states, db_pool serves
+        /// whz.db_query() and may be nullptr
+        auto set_LUA_pool(std::shared_ptr<whz_LUA_pool> pool, std::shared_ptr<whz_db_pool> db_pool) -> void;
+
+        /// True if the request goes to a Lua handler, it's answered by handle_LUA_request() then
+        auto is_LUA_request(const whz::request& req) const -> bool;
+        /// Run the Lua handler of the request as coroutine on io, done is called on io's thread once rep is complete
+        auto handle_LUA_request(const whz::request& req, whz::reply& rep, boost::asio::io_context& io,
+                                std::function<void()> done) -> void;
+
     private:
+        auto handle_template_request(const std::string& full_path, whz::reply& rep) -> void;
+        auto handle_metrics_request(whz::reply& rep) -> void;
+
         std::filesystem::path document_root;
+        std::shared_ptr<TemplateProcessor> template_processor_;
+        std::shared_ptr<whz_LUA_pool> lua_pool_;
+        std::shared_ptr<whz_db_pool> db_pool_;
     };
 }; // namespace whz
\ No newline at end of file
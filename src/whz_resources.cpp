@@ -27,7 +27,7 @@ bool resources::loadResource(const std::string& sfilepath) {
   if (bFileExists) {
     std::ifstream ifs(sfilepath, std::ios::in); // Open the file for reading
     if (!ifs.is_open()) {
-        this->_qlogger.error(fmt::format("Failed to open the file {}", sfilepath));
+        WHZ_LOG_ERROR(this->_qlogger, "Failed to open the file {}", sfilepath);
         //std::cout << "ERROR: Failed to open the file" << sfilepath << '\n';
     }
     else {
@@ -174,7 +174,7 @@ bool resources::checkResourceFileExists(std::filesystem::path fpath) {
       _resourceType = resource_type::IMAGE_JPG;
     } else {
       _resourceType = resource_type::UNKNOWN;
-      this->_qlogger.error(fmt::format("Failed to open the file {}, file extension is unknown/unsupported.", fpath.string()));
+      WHZ_LOG_ERROR(this->_qlogger, "Failed to open the file {}, file extension is unknown/unsupported.", fpath.string());
       //std::cout << "ERROR: Failed to open the file" << fpath << ", file extension is unknown/unsupported.\n";
     }
   }
@@ -80,6 +80,6 @@ namespace whz {
         whz::resource_type _resourceType; /// Enum Class on lower architectural level
         char *_resourceContentByte; /// The content of the resource file as a byte
         /// buffer for images
-        whz::whz_qlogger _qlogger; /// The logger for this class
+        whz::whz_qlogger _qlogger{"resources"}; /// The logger for this class
     };
 } // namespace WHZ
@@ -1,10 +1,14 @@
 #include "whz_server.hpp"
 #include <optional>
 #include <string>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <boost/asio/ip/basic_resolver_query.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/system/detail/error_code.hpp>
+#include "whz_config.hpp"
 #include "whz_connection.hpp"
+#include "whz_connection_manager.hpp"
 #include "whz_io_context_pool.hpp"
 #include "whz_ssl_connection.hpp"
 #include "whz_quill_wrapper.hpp"
@@ -22,6 +26,8 @@ server::server(
       io_pool_size_(io_pool_size),
       io_context_pool_(io_pool_size_),
       signals_(io_context_pool_.get_io_context()),
+      drain_timer_(signals_.get_executor()),
+      upgrade_acceptor_(signals_.get_executor()),
       acceptor_(io_context_pool_.get_io_context()),
       request_handler_(std::move(documents_root)) {
   signals_.add(SIGINT);
@@ -29,6 +35,13 @@ server::server(
 #if defined(SIGQUIT)
   signals_.add(SIGQUIT);
 #endif
+#if defined(SIGHUP)
+  signals_.add(SIGHUP); // Reload the config, see do_await_stop()
+#endif
+
+  for (std::size_t i = 0; i < io_context_pool_.size(); ++i) {
+    active_connections_.push_back(whz_server_metrics::active_connections(i));
+  }
 
   this->_qlogger.info("WHZ Server is running");
   //LOG_INFO(whz_qlogger::getInstance().getLogger(), "WHZ Server is running");
@@ -50,16 +63,60 @@ auto server::listen_and_serve(boost::asio::ssl::context& tls_context)
 }
 
 auto server::listen_and_serve() -> std::optional<std::error_code> {
-  if (bind_and_listen_http()) {
+  if (handoff_ ? adopt_listen_socket() : bind_and_listen_http()) {
     return std::make_error_code(std::errc::io_error);
   }
 
   start_accept_http();
+  start_upgrade_listener();
+  if (handoff_) {
+    // The accept is queued, connections wait in the shared backlog until the pool runs
+    if (!handoff_->confirm()) {
+      WHZ_LOG_WARNING(this->_qlogger, "Upgrade: the old server didn't get the confirmation, it keeps accepting too");
+    }
+    handoff_.reset();
+  }
 
   io_context_pool_.run();
   return std::nullopt;
 }
 
+auto server::adopt_listener(whz_handoff_receiver receiver) -> void {
+  handoff_.emplace(std::move(receiver));
+}
+
+auto server::set_template_processor(std::shared_ptr<TemplateProcessor> processor) -> void {
+  request_handler_.set_template_processor(std::move(processor));
+}
+
+auto server::set_LUA_pool(std::shared_ptr<whz_LUA_pool> pool, std::shared_ptr<whz_db_pool> db_pool) -> void {
+  request_handler_.set_LUA_pool(std::move(pool), std::move(db_pool));
+}
+
+auto server::adopt_listen_socket() -> std::optional<std::error_code> {
+  auto sockets = handoff_->take_sockets();
+  const int fd = sockets.front();
+  for (std::size_t i = 1; i < sockets.size(); ++i) {
+    ::close(sockets[i]); // Only the HTTP listener is served, a newer old server may send more
+  }
+
+  sockaddr_storage address{};
+  socklen_t length = sizeof(address);
+  if (::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    ::close(fd);
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  boost::system::error_code ec;
+  acceptor_.assign(address.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), fd, ec);
+  if (ec) {
+    ::close(fd);
+    return std::make_error_code(std::errc::bad_file_descriptor);
+  }
+  WHZ_LOG_INFO(this->_qlogger, "Upgrade: serving on the listening socket of the previous server");
+  do_accept_http();
+  return std::nullopt;
+}
+
 auto server::bind_and_listen_http() -> std::optional<std::error_code> {
   boost::asio::ip::tcp::resolver resolver(acceptor_.get_executor());
   tcp::endpoint endpoint =
@@ -91,16 +148,17 @@ auto server::bind_and_listen() -> std::optional<std::error_code> {
 }
 
 auto server::do_accept_http() -> void {
+  std::size_t io_index = 0;
+  auto& io_context = io_context_pool_.get_io_context(io_index);
   acceptor_.async_accept(
-      io_context_pool_.get_io_context(),
-      [this](
+      io_context,
+      [this, io_index](
           boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
         if (!acceptor_.is_open()) {
           return;
         }
         if (!ec) {
-          std::make_shared<whz::connection>(std::move(socket), request_handler_)
-              ->start();
+          start_connection(std::move(socket), io_index);
         }
         do_accept_http();
       });
@@ -108,39 +166,171 @@ auto server::do_accept_http() -> void {
 
 auto server::do_accept() -> void {
   // NOTE(bc): prefer not to use error_code from boost here
+  std::size_t io_index = 0;
+  auto& io_context = io_context_pool_.get_io_context(io_index);
   acceptor_.async_accept(
-      io_context_pool_.get_io_context(),
-      [this](
+      io_context,
+      [this, io_index](
           boost::system::error_code /*ec*/,
           boost::asio::ip::tcp::socket socket) -> void {
         if (!acceptor_.is_open())
           return;
 
-        std::make_shared<whz::connection>(std::move(socket), request_handler_)
-            ->start();
+        start_connection(std::move(socket), io_index);
         do_accept();
       });
 }
 
 auto server::do_await_stop() -> void {
-  signals_.async_wait([this](boost::system::error_code /*ec*/, int /*signo*/) {
+  signals_.async_wait([this](boost::system::error_code ec, int signo) {
+    if (ec) {
+      return;
+    }
+#if defined(SIGHUP)
+    if (signo == SIGHUP) {
+      // Applies what can change live and logs the rest, the server keeps running either way
+      Config::get_instance().reload();
+      do_await_stop();
+      return;
+    }
+#endif
+    if (draining_) {
+      // A second stop signal doesn't wait for the in-flight requests
+      io_context_pool_.stop();
+      return;
+    }
+    drain();
+    do_await_stop();
+  });
+}
+
+auto server::start_connection(tcp::socket socket, std::size_t io_index) -> void {
+  whz_server_metrics::get().connections_accepted.inc();
+  auto c = std::make_shared<whz::connection>(
+      std::move(socket), request_handler_, active_connections_[io_index], &connections_);
+  connections_.add(c);
+  c->start();
+}
+
+auto server::drain() -> void {
+  if (draining_) {
+    return;
+  }
+  draining_ = true;
+  // The acceptor runs on its own io_context
+  boost::asio::post(acceptor_.get_executor(), [this] {
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+  });
+  if (upgrade_acceptor_.is_open()) {
+    boost::system::error_code ignored;
+    upgrade_acceptor_.close(ignored);
+    if (!handed_over_) {
+      // After a hand over the path belongs to the new server
+      ::unlink(Config::get<Config::ConfigParameter::UPGRADE_SOCKET_PATH>().c_str());
+    }
+  }
+  // Accepted connections still get their answer, the read timeout bounds the ones whose request doesn't arrive
+
+  const auto timeout_ms = Config::get<Config::ConfigParameter::SHUTDOWN_DRAIN_TIMEOUT_MS>();
+  drain_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  WHZ_LOG_INFO(this->_qlogger, "Draining {} connections, at most {} ms", connections_.size(), timeout_ms);
+  await_drained();
+}
+
+auto server::await_drained() -> void {
+  const std::size_t open = connections_.size();
+  if (open == 0 || std::chrono::steady_clock::now() >= drain_deadline_) {
+    if (open > 0) {
+      WHZ_LOG_WARNING(this->_qlogger, "Drain deadline passed, closing {} connections", open);
+    }
     io_context_pool_.stop();
+    return;
+  }
+  drain_timer_.expires_after(std::chrono::milliseconds(50));
+  drain_timer_.async_wait([this](boost::system::error_code ec) {
+    if (!ec) {
+      await_drained();
+    }
   });
 }
 
+auto server::start_upgrade_listener() -> void {
+  const auto& path = Config::get<Config::ConfigParameter::UPGRADE_SOCKET_PATH>();
+  if (path.empty()) {
+    return;
+  }
+  // A left over file of a crashed server, or the one of the server this one replaces, which doesn't need it anymore
+  ::unlink(path.c_str());
+  boost::system::error_code ec;
+  upgrade_acceptor_.open(boost::asio::local::stream_protocol(), ec);
+  if (!ec) {
+    upgrade_acceptor_.bind(boost::asio::local::stream_protocol::endpoint(path), ec);
+  }
+  if (!ec) {
+    upgrade_acceptor_.listen(1, ec);
+  }
+  if (ec) {
+    WHZ_LOG_ERROR(this->_qlogger, "Upgrade socket {} not available: {}", path, ec.message());
+    upgrade_acceptor_.close(ec);
+    return;
+  }
+  do_accept_upgrade();
+}
+
+auto server::do_accept_upgrade() -> void {
+  upgrade_acceptor_.async_accept(
+      [this](boost::system::error_code ec, boost::asio::local::stream_protocol::socket peer) {
+        if (!upgrade_acceptor_.is_open()) {
+          return;
+        }
+        if (!ec) {
+          hand_over(std::move(peer));
+        }
+        do_accept_upgrade();
+      });
+}
+
+auto server::hand_over(boost::asio::local::stream_protocol::socket peer) -> void {
+  if (draining_) {
+    return;
+  }
+  const int listen_fd = acceptor_.native_handle();
+  if (!socket_handoff::send_sockets(peer.native_handle(), std::span<const int>(&listen_fd, 1))) {
+    WHZ_LOG_ERROR(this->_qlogger, "Upgrade: sending the listening socket failed");
+    return;
+  }
+  WHZ_LOG_INFO(this->_qlogger, "Upgrade: listening socket sent, waiting for the new server to accept");
+
+  auto connection = std::make_shared<boost::asio::local::stream_protocol::socket>(std::move(peer));
+  auto reply = std::make_shared<char>(0);
+  boost::asio::async_read(*connection, boost::asio::buffer(reply.get(), 1),
+      [this, connection, reply](boost::system::error_code ec, std::size_t /*bytes*/) {
+        if (ec || *reply != socket_handoff::confirm_byte) {
+          // The new server failed before it accepted, this one keeps serving
+          WHZ_LOG_WARNING(this->_qlogger, "Upgrade: the new server didn't confirm, still serving");
+          return;
+        }
+        WHZ_LOG_INFO(this->_qlogger, "Upgrade: the new server accepts, draining this one");
+        handed_over_ = true;
+        drain();
+      });
+}
+
 auto server::start_accept_http() -> void {
   // Is the acceptor listening for new connections?
   if (!acceptor_.is_open()) {
     return;
   }
 
+  std::size_t io_index = 0;
+  auto& io_context = io_context_pool_.get_io_context(io_index);
   acceptor_.async_accept(
-      io_context_pool_.get_io_context(),
-      [this](
+      io_context,
+      [this, io_index](
           boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
         if (!ec) {
-          std::make_shared<whz::connection>(std::move(socket), request_handler_)
-              ->start();
+          start_connection(std::move(socket), io_index);
         }
         do_accept_http();
       });
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <filesystem>
 #include <optional>
@@ -8,9 +9,12 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/ssl/context.hpp>
 
+#include "whz_connection_manager.hpp"
 #include "whz_io_context_pool.hpp"
+#include "whz_metrics.hpp"
 #include "whz_request_handler.hpp"
 #include "whz_quill_wrapper.hpp"
+#include "whz_socket_handoff.hpp"
 
 namespace whz {
 
@@ -44,6 +48,15 @@ class server {
 
   auto run() -> void;
 
+  /// Serve on the listening socket of the running server instead of binding one, used by --upgrade. The old
+  /// server is told to drain once this one accepts, in listen_and_serve().
+  auto adopt_listener(whz_handoff_receiver receiver) -> void;
+
+  /// Render requests for .whzt files with this processor, set before listen_and_serve()
+  auto set_template_processor(std::shared_ptr<TemplateProcessor> processor) -> void;
+  /// Answer the requests below LUA_ROUTE_PREFIX with the Lua handlers of pool, set before listen_and_serve()
+  auto set_LUA_pool(std::shared_ptr<whz_LUA_pool> pool, std::shared_ptr<whz_db_pool> db_pool) -> void;
+
  private:
   [[nodiscard]] auto bind_and_listen() -> std::optional<std::error_code>;
   [[nodiscard]] auto bind_and_listen_http() -> std::optional<std::error_code>;
@@ -53,14 +66,32 @@ class server {
   auto do_accept() -> void;
   auto do_accept_http() -> void;
   auto do_await_stop() -> void;
+  auto start_connection(tcp::socket socket, std::size_t io_index) -> void;
+
+  [[nodiscard]] auto adopt_listen_socket() -> std::optional<std::error_code>;
+  // Stop accepting, close the idle connections and stop once the in-flight requests are done or the deadline passed
+  auto drain() -> void;
+  auto await_drained() -> void;
+  // Hand the listening socket over to a new process connecting on UPGRADE_SOCKET_PATH
+  auto start_upgrade_listener() -> void;
+  auto do_accept_upgrade() -> void;
+  auto hand_over(boost::asio::local::stream_protocol::socket peer) -> void;
 
   std::string_view address_;
   std::uint32_t port_;
   // std::filesystem::path documents_root_;
   std::size_t io_pool_size_;
+  connection_manager connections_; // Before the pool, the connections remove themselves when the pool ends
   io_context_pool io_context_pool_;
 
   boost::asio::signal_set signals_;
+  // Shutdown and upgrade run on the executor of signals_, which keeps their state single threaded
+  boost::asio::steady_timer drain_timer_;
+  boost::asio::local::stream_protocol::acceptor upgrade_acceptor_;
+  std::optional<whz_handoff_receiver> handoff_; // Set by adopt_listener()
+  std::chrono::steady_clock::time_point drain_deadline_{};
+  bool draining_ = false;
+  bool handed_over_ = false;
 
   // boost::asio::signal_set signals;
   boost::asio::ip::tcp::acceptor acceptor_;
@@ -69,7 +100,8 @@ class server {
   // std::chrono::milliseconds tls_handshake_timeout_;
   // std::chrono::milliseconds read_timeout_;
   whz::request_handler request_handler_;
-  whz::whz_qlogger _qlogger;
+  std::vector<whz_gauge> active_connections_; // One per io_context of the pool
+  whz::whz_qlogger _qlogger{"server"};
 };
 
 }; // namespace whz
@@ -0,0 +1,164 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include "whz_socket_handoff.hpp"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+namespace whz {
+
+    namespace {
+        // Sent with the descriptors, so a wrong peer on the socket path isn't mistaken for a server
+        constexpr std::array<char, 4> Magic{'W', 'H', 'Z', 'H'};
+
+        std::string ErrnoMessage(std::string_view what) {
+            return std::string(what) + ": " + std::strerror(errno);
+        }
+    }
+
+    namespace socket_handoff {
+        bool send_sockets(int unix_fd, std::span<const int> sockets) {
+            if (sockets.empty() || sockets.size() > max_sockets) {
+                return false;
+            }
+            std::array<char, Magic.size()> payload = Magic;
+            iovec iov{payload.data(), payload.size()};
+
+            alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * max_sockets)> control{};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * sockets.size());
+
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+            std::memcpy(CMSG_DATA(cmsg), sockets.data(), sizeof(int) * sockets.size());
+
+            ssize_t sent;
+            do {
+                sent = ::sendmsg(unix_fd, &msg, MSG_NOSIGNAL);
+            } while (sent < 0 && errno == EINTR);
+            return sent == static_cast<ssize_t>(payload.size());
+        }
+
+        std::expected<std::vector<int>, std::string> receive_sockets(int unix_fd) {
+            std::array<char, Magic.size()> payload{};
+            iovec iov{payload.data(), payload.size()};
+
+            alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * max_sockets)> control{};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+
+            ssize_t received;
+            do {
+                received = ::recvmsg(unix_fd, &msg, MSG_CMSG_CLOEXEC);
+            } while (received < 0 && errno == EINTR);
+            if (received < 0) {
+                return std::unexpected(ErrnoMessage("Receiving the sockets failed"));
+            }
+
+            std::vector<int> sockets;
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                    const std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                    const std::size_t offset = sockets.size();
+                    sockets.resize(offset + count);
+                    std::memcpy(sockets.data() + offset, CMSG_DATA(cmsg), sizeof(int) * count);
+                }
+            }
+            if (received != static_cast<ssize_t>(payload.size()) || payload != Magic ||
+                (msg.msg_flags & MSG_CTRUNC) != 0 || sockets.empty()) {
+                for (int fd : sockets) {
+                    ::close(fd);
+                }
+                return std::unexpected("The peer is not a whz server handing over its sockets");
+            }
+            return sockets;
+        }
+    }
+
+    whz_handoff_receiver::whz_handoff_receiver(whz_handoff_receiver&& other) noexcept
+            : _fd(std::exchange(other._fd, -1)), _sockets(std::move(other._sockets)) {
+        other._sockets.clear();
+    }
+
+    whz_handoff_receiver& whz_handoff_receiver::operator=(whz_handoff_receiver&& other) noexcept {
+        if (this != &other) {
+            close_all();
+            this->_fd = std::exchange(other._fd, -1);
+            this->_sockets = std::move(other._sockets);
+            other._sockets.clear();
+        }
+        return *this;
+    }
+
+    whz_handoff_receiver::~whz_handoff_receiver() {
+        close_all();
+    }
+
+    void whz_handoff_receiver::close_all() {
+        for (int fd : this->_sockets) {
+            ::close(fd);
+        }
+        this->_sockets.clear();
+        if (this->_fd >= 0) {
+            ::close(this->_fd);
+            this->_fd = -1;
+        }
+    }
+
+    std::expected<whz_handoff_receiver, std::string> whz_handoff_receiver::connect(
+            const std::filesystem::path& socket_path, std::chrono::milliseconds timeout) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        const std::string path = socket_path.string();
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            return std::unexpected("Invalid upgrade socket path: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return std::unexpected(ErrnoMessage("Creating the upgrade socket failed"));
+        }
+        timeval tv{};
+        tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+        tv.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            auto error = ErrnoMessage("Connecting to " + path + " failed, is the server running");
+            ::close(fd);
+            return std::unexpected(std::move(error));
+        }
+        auto sockets = socket_handoff::receive_sockets(fd);
+        if (!sockets) {
+            ::close(fd);
+            return std::unexpected(std::move(sockets.error()));
+        }
+        return whz_handoff_receiver(fd, std::move(*sockets));
+    }
+
+    bool whz_handoff_receiver::confirm() {
+        if (this->_fd < 0) {
+            return false;
+        }
+        const char byte = socket_handoff::confirm_byte;
+        const bool sent = ::send(this->_fd, &byte, 1, MSG_NOSIGNAL) == 1;
+        ::close(this->_fd);
+        this->_fd = -1;
+        return sent;
+    }
+
+} // whz
@@ -0,0 +1,59 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <chrono>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace whz {
+
+    /**
+     * @brief Passing listening sockets from a running server to its replacement over a Unix socket (SCM_RIGHTS).
+     * The old process listens on UPGRADE_SOCKET_PATH. A new one started with --upgrade connects, receives the
+     * sockets and accepts on them, then confirms. Only then does the old process stop accepting and drain, so the
+     * listening socket and its backlog never close and no connection is refused. If the new process fails before
+     * confirming, the old one keeps serving.
+     *
+     */
+    namespace socket_handoff {
+        constexpr char confirm_byte = 'K';
+        constexpr std::size_t max_sockets = 16;
+
+        /// Send the file descriptors over the connected Unix socket, the old process' side
+        bool send_sockets(int unix_fd, std::span<const int> sockets);
+        /// Receive the file descriptors sent by send_sockets(), the caller owns them
+        std::expected<std::vector<int>, std::string> receive_sockets(int unix_fd);
+    }
+
+    /// The new process' end of an upgrade
+    class whz_handoff_receiver {
+    public:
+        whz_handoff_receiver(const whz_handoff_receiver&) = delete;
+        whz_handoff_receiver& operator=(const whz_handoff_receiver&) = delete;
+        whz_handoff_receiver(whz_handoff_receiver&& other) noexcept;
+        whz_handoff_receiver& operator=(whz_handoff_receiver&& other) noexcept;
+        ~whz_handoff_receiver();
+
+        /// Connect to the running server and receive its listening sockets, waits at most timeout for them
+        static std::expected<whz_handoff_receiver, std::string> connect(const std::filesystem::path& socket_path,
+                                                                         std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+        /// The received listening sockets, ownership moves to the caller
+        [[nodiscard]] std::vector<int> take_sockets() { return std::move(_sockets); }
+        /// Tell the old process that this one accepts now, it then drains and exits
+        bool confirm();
+
+    private:
+        whz_handoff_receiver(int unix_fd, std::vector<int> sockets) : _fd(unix_fd), _sockets(std::move(sockets)) {}
+        void close_all();
+
+        int _fd = -1;
+        std::vector<int> _sockets;  /// Closed by the destructor unless taken
+    };
+
+} // whz
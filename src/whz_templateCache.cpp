@@ -4,64 +4,500 @@
 
 #include "whz_templateCache.hpp"
 #include "whz_quill_wrapper.hpp"
-#include <cstring>
-#include <sys/mman.h>
+#include "whz_output_cache.hpp"
+#include <cerrno>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
+#include <taskflow/taskflow.hpp>
 
 namespace whz {
 
-    void whz_templateCache::memoryMapTemplates(const std::string &target_filePath) {
-        int fd = open(target_filePath.c_str(), O_RDWR | O_CREAT, 0666);
-        if (fd == -1) {
-            this->_qlogger.error(fmt::format("Failed to open file for memory mapping: {}", target_filePath));
-            //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Failed to open file for memory mapping: {}", target_filePath);
-            std::cerr << "Failed to open file for memory mapping: " << target_filePath << std::endl;
-            return;
+    namespace {
+        tf::Executor &LoadExecutor() {
+            static tf::Executor executor;
+            return executor;
         }
 
-        size_t size = 0;
-        for (const auto &pair : whz_templates) {
-            size += pair.first.size() + pair.second.size() + 2; // +2 for null terminators
+        // Read a whole file with a single read() of its size, looping only on short reads
+        std::expected<std::string, std::string> ReadWholeFile(const std::string &path) {
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return std::unexpected("Failed to open template file: " + path);
+            }
+            struct stat st{};
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                return std::unexpected("Failed to stat template file: " + path);
+            }
+            std::string content(static_cast<std::size_t>(st.st_size), '\0');
+            std::size_t done = 0;
+            while (done < content.size()) {
+                const ssize_t n = ::read(fd, content.data() + done, content.size() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break; // Error, or the file got shorter since fstat()
+                }
+                done += static_cast<std::size_t>(n);
+            }
+            ::close(fd);
+            content.resize(done);
+            return content;
         }
 
-        if (ftruncate(fd, size) == -1) {
-            this->_qlogger.error(fmt::format("Failed to set the size of the file: {}", target_filePath));
-            //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Failed to set the size of the file: {}", target_filePath);
-            std::cerr << "Failed to set the size of the file: " << target_filePath << std::endl;
-            close(fd);
-            return;
+        // List one directory, queue its .whzt files and walk its subfolders as further subflow tasks
+        void WalkDirectory(const std::filesystem::path &dir, tf::Subflow &subflow, std::mutex &found_mutex,
+                           std::vector<std::pair<std::string, std::filesystem::file_time_type>> &found) {
+            std::vector<std::pair<std::string, std::filesystem::file_time_type>> local;
+            std::error_code ec;
+            for (auto it = std::filesystem::directory_iterator(dir, ec);
+                 !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+                const auto &entry = *it;
+                std::error_code type_ec;
+                if (entry.is_directory(type_ec)) {
+                    subflow.emplace([path = entry.path(), &found_mutex, &found](tf::Subflow &sub) {
+                        WalkDirectory(path, sub, found_mutex, found);
+                    });
+                } else if (entry.is_regular_file(type_ec) && entry.path().extension() == ".whzt") {
+                    local.emplace_back(entry.path().string(), entry.last_write_time(type_ec));
+                }
+            }
+            std::lock_guard lock(found_mutex);
+            found.insert(found.end(), std::make_move_iterator(local.begin()), std::make_move_iterator(local.end()));
+        }
+
+        // True if the path is one of the given files or folders, or lies below one of the folders
+        bool IsBelowAny(std::string_view path, std::span<const std::string> prefixes) {
+            return std::ranges::any_of(prefixes, [path](const std::string &prefix) {
+                return path.starts_with(prefix) &&
+                       (path.size() == prefix.size() || prefix.ends_with('/') || path[prefix.size()] == '/');
+            });
+        }
+    }
+
+    std::vector<whz_templateCache::pending_template> whz_templateCache::readTemplateDirectory(const std::string &directoryPath) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(directoryPath, ec)) {
+            WHZ_LOG_ERROR(this->_qlogger, "Failed to read template directory {}", directoryPath);
+            std::cerr << "Failed to read template directory " << directoryPath << std::endl;
+            return {};
+        }
+
+        std::mutex found_mutex;
+        std::vector<std::pair<std::string, std::filesystem::file_time_type>> found;
+        {
+            tf::Taskflow walk;
+            walk.emplace([&directoryPath, &found_mutex, &found](tf::Subflow &subflow) {
+                WalkDirectory(directoryPath, subflow, found_mutex, found);
+            });
+            LoadExecutor().run(walk).wait();
+        }
+
+        std::vector<pending_template> pending(found.size());
+        std::vector<std::string> errors(found.size());
+        {
+            tf::Taskflow read;
+            read.for_each_index(std::size_t{0}, found.size(), std::size_t{1}, [&](std::size_t i) {
+                auto content = ReadWholeFile(found[i].first);
+                if (!content) {
+                    errors[i] = std::move(content.error());
+                    return;
+                }
+                pending[i] = {std::move(found[i].first), std::move(*content), found[i].second, nullptr, nullptr};
+            });
+            LoadExecutor().run(read).wait();
         }
 
-        void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-        if (map == MAP_FAILED) {
-            this->_qlogger.error(fmt::format("Failed to memory-map the file: {}", target_filePath));
-            //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Failed to memory-map the file: {}", target_filePath);
-            std::cerr << "Failed to memory-map the file: " << target_filePath << std::endl;
-            close(fd);
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            if (!errors[i].empty()) {
+                WHZ_LOG_ERROR(this->_qlogger, "{}", errors[i]);
+                std::cerr << errors[i] << std::endl;
+                continue;
+            }
+            if (kept != i) {
+                pending[kept] = std::move(pending[i]);
+            }
+            ++kept;
+        }
+        pending.resize(kept);
+        return pending;
+    }
+
+    void whz_templateCache::publishSnapshot(const std::vector<pending_template> &templates,
+                                            std::span<const std::string> replaced_paths,
+                                            std::shared_ptr<const whz_template_pack> pack) {
+        std::lock_guard lock(this->_snapshot_mutex);
+
+        auto current = this->_snapshot.load(std::memory_order_acquire);
+        if (!pack) {
+            pack = current->pack;
+        }
+        std::vector<std::pair<std::string, std::string>> entries;
+        entries.reserve(current->templates.size() + templates.size());
+        current->templates.for_each([&](std::string_view path, const std::string &content) {
+            // The heap is looked up first, an old copy of a template that is now in the new pack would hide it
+            if (!IsBelowAny(path, replaced_paths) && !(pack != current->pack && pack->find(path))) {
+                entries.emplace_back(std::string(path), content);
+            }
+        });
+        for (const auto &tmpl : templates) {
+            if (!tmpl.pack) {
+                entries.emplace_back(tmpl.path, tmpl.content); // Newer content wins over the old one
+            }
+        }
+        this->_snapshot.store(std::make_shared<const template_snapshot>(
+                                      whz_flat_map<std::string>(std::move(entries)), std::move(pack)),
+                              std::memory_order_release);
+    }
+
+    void whz_templateCache::loadTemplates(const std::string &directoryPath, bool domemorymap, bool precompile) {
+        std::lock_guard lock(this->_reload_mutex);
+
+        auto pending = readTemplateDirectory(directoryPath);
+        std::shared_ptr<const whz_template_pack> pack;
+        if (domemorymap && !pending.empty()) {
+            pack = memoryMapTemplates(directoryPath + "/whz_mmtemplates/whz_mmtemplates_001.mmf", pending); // default memory map location
+        }
+        publishSnapshot(pending, {}, std::move(pack));
+        if (precompile) {
+            compileTemplates(std::move(pending));
+        }
+    }
+
+    void whz_templateCache::reloadTemplates(const std::string &directoryPath) {
+        std::lock_guard lock(this->_reload_mutex);
+
+        // Everything is read and compiled next to the live templates, which stay served until the swaps below
+        auto pending = readTemplateDirectory(directoryPath);
+        const std::string replaced[] = {directoryPath};
+        publishSnapshot(pending, replaced);
+        compileTemplates(std::move(pending), replaced);
+        WHZ_LOG_INFO(this->_qlogger, "Templates reloaded from {}", directoryPath);
+    }
+
+    std::future<void> whz_templateCache::reloadTemplatesAsync(const std::string &directoryPath) {
+        return std::async(std::launch::async, [this, directoryPath] { reloadTemplates(directoryPath); });
+    }
+
+    void whz_templateCache::updateTemplates(const std::vector<std::string> &paths) {
+        std::lock_guard lock(this->_reload_mutex);
+
+        // Existing folders are read again as a whole, everything else that is gone is dropped with all below it
+        std::vector<pending_template> pending;
+        std::vector<std::string> replaced;
+        for (const auto &path : paths) {
+            std::error_code ec;
+            const auto status = std::filesystem::status(path, ec);
+            if (std::filesystem::is_directory(status)) {
+                auto in_folder = readTemplateDirectory(path);
+                pending.insert(pending.end(), std::make_move_iterator(in_folder.begin()),
+                               std::make_move_iterator(in_folder.end()));
+                replaced.push_back(path);
+            } else if (std::filesystem::is_regular_file(status)) {
+                if (std::filesystem::path(path).extension() != ".whzt") {
+                    continue;
+                }
+                auto content = ReadWholeFile(path);
+                auto write_time = std::filesystem::last_write_time(path, ec);
+                if (!content || ec) {
+                    continue; // Removed again meanwhile, a following event reports that
+                }
+                pending.push_back({path, std::move(*content), write_time, nullptr, nullptr});
+                replaced.push_back(path);
+            } else if (!std::filesystem::exists(status)) {
+                replaced.push_back(path);
+            }
+        }
+        if (replaced.empty()) {
             return;
         }
 
-        char *ptr = static_cast<char *>(map);
-        for (const auto &pair : whz_templates) {
-            memcpy(ptr, pair.first.c_str(), pair.first.size() + 1);
-            ptr += pair.first.size() + 1;
-            memcpy(ptr, pair.second.c_str(), pair.second.size() + 1);
-            ptr += pair.second.size() + 1;
+        publishSnapshot(pending, replaced);
+        compileTemplates(std::move(pending), replaced);
+
+        // Partials are resolved when rendering, so templates including a changed partial stay compiled as they are.
+        // Only their cached output is outdated, also when the partial didn't exist before.
+        const auto dependents = dependentTemplates(replaced);
+        for (const auto &path : dependents) {
+            whz_output_cache::getInstance().invalidate_tag("template:" + path);
         }
+        WHZ_LOG_INFO(this->_qlogger, "Templates updated: {} changed or removed, {} dependent",
+                     replaced.size(), dependents.size());
+    }
+
+    std::vector<std::string> whz_templateCache::dependentTemplates(const std::vector<std::string> &paths) const {
+        // A partial is resolved like in TemplateProcessor::RenderTemplate(): next to the template, then by its name
+        auto snapshot = this->_compiled_templates.load(std::memory_order_acquire);
+        std::vector<std::string> affected(paths.begin(), paths.end());
+        std::vector<std::string> dependents;
+        bool grew = true;
+        while (grew) {  // Until no more templates include an affected one, partials can include partials
+            grew = false;
+            snapshot->for_each([&](std::string_view path, const compiled_template_ptr &compiled) {
+                if (IsBelowAny(path, affected)) {
+                    return;
+                }
+                const auto dir = std::filesystem::path(path).parent_path();
+                for (const auto &name : compiled->partials) {
+                    if (IsBelowAny((dir / (name + ".whzt")).string(), affected) || IsBelowAny(name, affected)) {
+                        affected.emplace_back(path);
+                        dependents.emplace_back(path);
+                        grew = true;
+                        return;
+                    }
+                }
+            });
+        }
+        return dependents;
+    }
 
-        if (msync(map, size, MS_SYNC) == -1) {
-            this->_qlogger.error(fmt::format("Failed to sync the memory-mapped file: {}", target_filePath));
-            //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Failed to sync the memory-mapped file: {}", target_filePath);
-            std::cerr << "Failed to sync the memory-mapped file: " << target_filePath << std::endl;
+    bool whz_templateCache::watchTemplates(const std::string &directoryPath) {
+        auto watcher = std::make_unique<whz_file_watcher>(directoryPath, [this](std::vector<std::string> paths) {
+            updateTemplates(paths);
+        }, ".whzt");
+        if (!watcher->start()) {
+            return false;
         }
+        std::lock_guard lock(this->_watch_mutex);
+        this->_watchers.push_back(std::move(watcher));
+        return true;
+    }
 
-        if (munmap(map, size) == -1) {
-            this->_qlogger.error(fmt::format("Failed to unmap the memory-mapped file: {}", target_filePath));
-            //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Failed to unmap the memory-mapped file: {}", target_filePath);
-            std::cerr << "Failed to unmap the memory-mapped file: " << target_filePath << std::endl;
+    void whz_templateCache::stopWatching() {
+        std::vector<std::unique_ptr<whz_file_watcher>> watchers;
+        {
+            std::lock_guard lock(this->_watch_mutex);
+            watchers.swap(this->_watchers);
         }
+        watchers.clear(); // Joins the watcher threads, outside the lock
+    }
 
-        close(fd);
+    whz_template_ref whz_templateCache::getTemplate(std::string_view path) const {
+        auto snapshot = this->_snapshot.load(std::memory_order_acquire);
+        if (const auto *content = snapshot->templates.find(path)) {
+            return {snapshot, *content};
+        }
+        if (snapshot->pack) {
+            if (auto content = snapshot->pack->find(path)) {
+                return {snapshot->pack, *content};
+            }
+        }
+        return {};
+    }
+
+    std::expected<compiled_template_ptr, std::string> whz_templateCache::getCompiledTemplate(const std::string &path) {
+        {
+            auto snapshot = this->_compiled_templates.load(std::memory_order_acquire);
+            if (auto compiled = snapshot->find(path)) {
+                return *compiled;
+            }
+        }
+
+        // Miss: compile from the mapped pack if it has the template, else read the file once. Concurrent misses on
+        // the same path are resolved in publishTemplate().
+        if (auto pack = this->_snapshot.load(std::memory_order_acquire)->pack) {
+            if (auto content = pack->find(path)) {
+                return compileTemplate(path, *content, std::move(pack));
+            }
+        }
+        std::error_code ec;
+        auto write_time = std::filesystem::last_write_time(path, ec);
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (ec || !file) {
+            return std::unexpected("Failed to open template file: " + path);
+        }
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return compileTemplate(path, std::move(content), write_time);
+    }
+
+    std::expected<compiled_template_ptr, std::string> whz_templateCache::compileTemplate(const std::string &path,
+                                                                                          std::string content,
+                                                                                          std::filesystem::file_time_type write_time) {
+        compiled_template_ptr compiled;
+        try {
+            compiled = std::make_shared<const whz_compiled_template>(std::move(content), write_time);
+        } catch (const std::exception &e) {
+            WHZ_LOG_ERROR(this->_qlogger, "Template compilation failed for {}: {}", path, e.what());
+            return std::unexpected("Template compilation failed: " + std::string(e.what()));
+        }
+        return publishTemplate(path, std::move(compiled));
+    }
+
+    std::expected<compiled_template_ptr, std::string> whz_templateCache::compileTemplate(const std::string &path,
+                                                                                          std::string_view content,
+                                                                                          std::shared_ptr<const whz_template_pack> pack) {
+        compiled_template_ptr compiled;
+        try {
+            // Templates from a pack have no file time of their own
+            compiled = std::make_shared<const whz_compiled_template>(content, std::move(pack),
+                                                                     std::filesystem::file_time_type::min());
+        } catch (const std::exception &e) {
+            WHZ_LOG_ERROR(this->_qlogger, "Template compilation failed for {}: {}", path, e.what());
+            return std::unexpected("Template compilation failed: " + std::string(e.what()));
+        }
+        return publishTemplate(path, std::move(compiled));
+    }
+
+    compiled_template_ptr whz_templateCache::publishTemplate(const std::string &path, compiled_template_ptr compiled) {
+        std::lock_guard lock(this->_compile_mutex);
+
+        auto current = this->_compiled_templates.load(std::memory_order_acquire);
+        const auto *existing = current->find(path);
+        if (existing && (*existing)->last_write_time == compiled->last_write_time) {
+            return *existing; // Unchanged or compiled by another thread in the meantime
+        }
+
+        auto entries = current->entries();
+        entries.emplace_back(path, compiled); // Replaces the old version, the last duplicate wins
+        this->_compiled_templates.store(std::make_shared<const compiled_template_map>(std::move(entries)),
+                                        std::memory_order_release);
+        if (existing) {
+            whz_output_cache::getInstance().invalidate_tag("template:" + path); // Output of the old version
+        }
+        return compiled;
+    }
+
+    bool whz_templateCache::loadTemplatePack(const std::string &pack_path) {
+        auto pack = whz_template_pack::open(pack_path);
+        if (!pack) {
+            WHZ_LOG_ERROR(this->_qlogger, "{}", pack.error());
+            std::cerr << pack.error() << std::endl;
+            return false;
+        }
+        std::lock_guard lock(this->_snapshot_mutex);
+        auto current = this->_snapshot.load(std::memory_order_acquire);
+        this->_snapshot.store(std::make_shared<const template_snapshot>(current->templates, std::move(*pack)),
+                              std::memory_order_release);
+        return true;
+    }
+
+    void whz_templateCache::compileTemplates(std::vector<pending_template> pending,
+                                             std::span<const std::string> replaced_paths) {
+        // Compile the new and changed templates in parallel, before taking the lock
+        {
+            auto current = this->_compiled_templates.load(std::memory_order_acquire);
+            std::vector<std::string> errors(pending.size());
+            tf::Taskflow compile;
+            compile.for_each_index(std::size_t{0}, pending.size(), std::size_t{1}, [&](std::size_t i) {
+                auto &tmpl = pending[i];
+                const auto *existing = current->find(tmpl.path);
+                if (existing && (*existing)->last_write_time == tmpl.write_time &&
+                    (!tmpl.pack || (*existing)->source_owner == tmpl.pack)) {
+                    tmpl.compiled = *existing; // File didn't change, keep the compiled version
+                    return;
+                }
+                try {
+                    if (tmpl.pack) {
+                        // Parsed straight from the mapped pages, the compiled template keeps the pack alive
+                        tmpl.compiled = std::make_shared<const whz_compiled_template>(*tmpl.pack->find(tmpl.path),
+                                                                                      tmpl.pack, tmpl.write_time);
+                    } else {
+                        tmpl.compiled = std::make_shared<const whz_compiled_template>(std::move(tmpl.content), tmpl.write_time);
+                    }
+                } catch (const std::exception &e) {
+                    errors[i] = e.what();
+                }
+            });
+            LoadExecutor().run(compile).wait();
+            for (std::size_t i = 0; i < pending.size(); ++i) {
+                if (!errors[i].empty()) {
+                    WHZ_LOG_ERROR(this->_qlogger, "Template compilation failed for {}: {}", pending[i].path, errors[i]);
+                    std::cerr << "Template compilation failed for " << pending[i].path << ": " << errors[i] << std::endl;
+                }
+            }
+        }
+
+        std::lock_guard lock(this->_compile_mutex);
+
+        auto current = this->_compiled_templates.load(std::memory_order_acquire);
+        std::vector<std::pair<std::string, compiled_template_ptr>> entries;
+        entries.reserve(current->size() + pending.size());
+        std::vector<std::string> changed;
+        current->for_each([&](std::string_view path, const compiled_template_ptr &compiled) {
+            if (IsBelowAny(path, replaced_paths)) {
+                changed.emplace_back(path); // Added back below if the file still exists, else dropped
+                return;
+            }
+            entries.emplace_back(std::string(path), compiled);
+        });
+
+        for (auto &tmpl : pending) {
+            const auto *existing = current->find(tmpl.path);
+            const bool replaced = IsBelowAny(tmpl.path, replaced_paths);
+            if (existing && *existing == tmpl.compiled) {
+                std::erase(changed, tmpl.path);
+                if (replaced) {
+                    entries.emplace_back(tmpl.path, *existing);
+                }
+                continue;
+            }
+            if (existing && !replaced) {
+                changed.push_back(tmpl.path);
+            }
+            if (tmpl.compiled) {
+                entries.emplace_back(tmpl.path, std::move(tmpl.compiled)); // The last duplicate wins
+            } else {
+                std::erase_if(entries, [&tmpl](const auto &entry) { return entry.first == tmpl.path; });
+            }
+        }
+        this->_compiled_templates.store(std::make_shared<const compiled_template_map>(std::move(entries)),
+                                        std::memory_order_release);
+        // Only after publishing, so nothing renders the old version into the cache again
+        for (const auto &path : changed) {
+            whz_output_cache::getInstance().invalidate_tag("template:" + path);
+        }
+    }
+
+    void whz_templateCache::invalidateTemplate(const std::string &path) {
+        std::lock_guard lock(this->_compile_mutex);
+
+        auto current = this->_compiled_templates.load(std::memory_order_acquire);
+        if (!current->contains(path)) {
+            return;
+        }
+        auto entries = current->entries();
+        std::erase_if(entries, [&path](const auto &entry) { return entry.first == path; });
+        this->_compiled_templates.store(std::make_shared<const compiled_template_map>(std::move(entries)),
+                                        std::memory_order_release);
+        whz_output_cache::getInstance().invalidate_tag("template:" + path);
+    }
+
+    /**
+     * @brief Write the templates into a template pack file and map it, see whz_template_pack for the format. Other
+     * processes can map the same pack with loadTemplatePack() and share its pages.
+     *
+     * @param target_filePath Path of the pack file, the directory is created if needed
+     * @param templates The templates to write, on success their content is released and they refer to the pack
+     * @return The mapped pack or nullptr if it couldn't be written or mapped
+     */
+    std::shared_ptr<const whz_template_pack> whz_templateCache::memoryMapTemplates(const std::string &target_filePath,
+                                                                                   std::vector<pending_template> &templates) {
+        std::vector<std::pair<std::string_view, std::string_view>> entries;
+        entries.reserve(templates.size());
+        for (const auto &tmpl : templates) {
+            entries.emplace_back(tmpl.path, tmpl.content);
+        }
+
+        auto written = whz_template_pack::write(target_filePath, std::move(entries));
+        if (!written) {
+            WHZ_LOG_ERROR(this->_qlogger, "{}", written.error());
+            std::cerr << written.error() << std::endl;
+            return nullptr;
+        }
+        auto pack = whz_template_pack::open(target_filePath);
+        if (!pack) {
+            WHZ_LOG_ERROR(this->_qlogger, "{}", pack.error());
+            std::cerr << pack.error() << std::endl;
+            return nullptr;
+        }
+        for (auto &tmpl : templates) {
+            tmpl.pack = *pack;
+            std::string().swap(tmpl.content);
+        }
+        return std::move(*pack);
     }
-} // whz
\ No newline at end of file
+} // whz
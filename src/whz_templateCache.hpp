@@ -6,15 +6,82 @@
 
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <span>
+#include <atomic>
+#include <mutex>
+#include <expected>
+#include <future>
+#include <bustache/format.hpp>
+#include "whz_template_parser.hpp"
+#include "whz_template_pack.hpp"
+#include "whz_flat_map.hpp"
+#include "whz_file_watcher.hpp"
 #include "whz_quill_wrapper.hpp"
 
 namespace whz {
+    /** A template that has been parsed once into a bustache::format. The format refers into the source text, so both
+     *  live together in this object which is only ever handed out as a shared_ptr to const and never copied or moved.
+     *  The source is either owned or a view into memory kept alive by source_owner, e.g. a mapped whz_template_pack.
+     */
+    struct whz_compiled_template {
+        whz_compiled_template(std::string template_source, std::filesystem::file_time_type write_time)
+                : owned_source(std::move(template_source)), source(owned_source), format(source),
+                  last_write_time(write_time),
+                  variables(whz_template_parser::extract_variables(source)),
+                  partials(whz_template_parser::extract_partials(source)) {}
+
+        whz_compiled_template(std::string_view template_source, std::shared_ptr<const void> owner,
+                              std::filesystem::file_time_type write_time)
+                : source_owner(std::move(owner)), source(template_source), format(source),
+                  last_write_time(write_time),
+                  variables(whz_template_parser::extract_variables(source)),
+                  partials(whz_template_parser::extract_partials(source)) {}
+
+        whz_compiled_template(const whz_compiled_template &) = delete;
+        whz_compiled_template &operator=(const whz_compiled_template &) = delete;
+
+        const std::string owned_source;                         /// The template text if it's owned by this object
+        const std::shared_ptr<const void> source_owner;         /// Keeps the memory of a non-owned source alive
+        const std::string_view source;                          /// The raw template text as read from the .whzt file
+        const bustache::format format;                          /// The parsed template, ready to render
+        const std::filesystem::file_time_type last_write_time;  /// Modification time of the file when it was compiled
+        const std::vector<std::string> variables;               /// Variables and sections used, see whz_template_parser
+        const std::vector<std::string> partials;                /// Names of the partials the template includes
+    };
+
+    using compiled_template_ptr = std::shared_ptr<const whz_compiled_template>;
+
+    /** Reference to the content of a cached template. It keeps the cache snapshot (or the mapped pack) the content
+     *  lives in alive, so the view stays valid even if the templates are reloaded meanwhile.
+     */
+    class whz_template_ref {
+    public:
+        whz_template_ref() = default;
+        whz_template_ref(std::shared_ptr<const void> owner, std::string_view content)
+                : _owner(std::move(owner)), _content(content) {}
+
+        [[nodiscard]] std::string_view content() const { return _content; }
+        [[nodiscard]] bool empty() const { return _content.empty(); }
+        explicit operator bool() const { return _owner != nullptr; }
+
+    private:
+        std::shared_ptr<const void> _owner;
+        std::string_view _content;
+    };
+
     /** Singleton class to cache the content of the templates files with the extension ".whzt". Those files can contain
      *  HTML code with placeholders that will be replaced by the data of the page. But can actually contain any kind of
      *  text content with placeholders. Mustache must be used to use the built-in template engine.
+     *
+     *  All templates live in immutable snapshots. Readers load the current snapshot atomically and never take a lock,
+     *  loading or reloading templates builds a new snapshot next to the current one and swaps it in when complete.
+     *  Readers still holding the old snapshot keep it alive until they are done.
      */
     class whz_templateCache {
     public:
@@ -33,55 +100,124 @@ namespace whz {
          * at the startup.
          *
          *  @param directoryPath The path to the directory containing the .whzt files, including subfolders
-         *  @param domemorymap If true, the content of the templates will be memory-mapped into /whz_mmtemplates
+         *  @param domemorymap If true, the templates are also written into a template pack in /whz_mmtemplates and
+         *  served from the mapped pack from then on, see loadTemplatePack()
+         *  @param precompile If true, all templates are compiled right away, else on their first getCompiledTemplate()
+         *
+         *  The directory tree is walked, read and compiled in parallel on a Taskflow executor.
          */
-        void loadTemplates(const std::string &directoryPath, bool domemorymap = false) {
-            for (const auto &entry: std::filesystem::recursive_directory_iterator(directoryPath)) {
-                if (entry.is_regular_file() && entry.path().extension() == ".whzt") {
-                    std::ifstream file(entry.path());
-                    if (file) {
-                        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-                        whz_templates.emplace(entry.path().string(), content);
-                    } else {
-                        this->_qlogger.error(fmt::format("Failed to open template file: {}", entry.path().string()));
-                        //LOG_ERROR(whz_qlogger::getInstance().getLogger(), "Failed to open template file: {}", entry.path().string());
-                        std::cerr << "Failed to open template file: " << entry.path() << std::endl;
-                    }
-                }
-            }
-            if (!this->whz_templates.empty() && domemorymap) {
-                memoryMapTemplates(directoryPath + "/whz_mmtemplates/whz_mmtemplates_001.mmf"); // default memory map location
-            }
-        }
+        void loadTemplates(const std::string &directoryPath, bool domemorymap = false, bool precompile = true);
 
-        // Get the content of a template by its path
-        std::string getTemplate(const std::string &path) const {
-            auto range = whz_templates.equal_range(path);
-            if (range.first != range.second) {
-                return range.first->second;
-            }
-            return "";
-        }
+        /** Map a template pack (see whz_template_pack) read-only, its templates are served without reading or copying
+         * them. Templates loaded with loadTemplates() take precedence over the ones in the pack.
+         *
+         *  @param pack_path Path of the pack file, e.g. written by loadTemplates(path, true)
+         *  @return True if the pack was mapped and is valid
+         */
+        bool loadTemplatePack(const std::string &pack_path);
+
+        // Get the content of a template by its path, an empty reference if unknown
+        [[nodiscard]] whz_template_ref getTemplate(std::string_view path) const;
 
-        /** Method to reload all .whzt files from the given directory. Call this when the templates have been updated,
-         * during runtime at your own risk!
+        /** Get the compiled template for the given path. The lookup doesn't take a lock, all io threads can read
+         * concurrently. On a miss the file is read and compiled once, and published for all following lookups.
          *
+         *  @param path The path of the .whzt file, the same as used in loadTemplates()
+         *  @return The compiled template or an error message if the file couldn't be read or parsed
          */
-        void reloadTemplates(const std::string &directoryPath) {
-            whz_templates.clear();
-            loadTemplates(directoryPath);
-        }
+        [[nodiscard]] std::expected<compiled_template_ptr, std::string> getCompiledTemplate(const std::string &path);
+
+        /// Drop the compiled template of this path, the next getCompiledTemplate() call compiles it again
+        void invalidateTemplate(const std::string &path);
+
+        /** Method to reload all .whzt files from the given directory. Call this when the templates have been updated.
+         * The new templates are swapped in at once when all are loaded, readers are never blocked and never see a
+         * half loaded state. Compiled templates whose file didn't change since are kept as they are, templates whose
+         * file was removed are dropped.
+         *
+         */
+        void reloadTemplates(const std::string &directoryPath);
 
+        /// Same as reloadTemplates() but on a separate thread, the future is ready when the new templates are live
+        std::future<void> reloadTemplatesAsync(const std::string &directoryPath);
 
+        /** Re-read only the given files or folders: changed ones are recompiled, removed ones dropped. The cached
+         * output of the templates including them as partial, directly or indirectly, is invalidated.
+         *
+         *  @param paths Paths of .whzt files or folders as reported by whz_file_watcher, other files are ignored
+         */
+        void updateTemplates(const std::vector<std::string> &paths);
+
+        /** Watch the directory with inotify and update the changed templates as they change, see updateTemplates().
+         * Changes are coalesced, a deploy of many files results in one or a few updates.
+         *
+         *  @return False if the directory can't be watched
+         */
+        bool watchTemplates(const std::string &directoryPath);
+
+        /// Stop all watchers started by watchTemplates()
+        void stopWatching();
 
     private:
         // Private constructor to prevent instantiation
         whz_templateCache() = default;
 
-        // Method to memory-map the whz_templates variable
-        void memoryMapTemplates(const std::string &target_filePath);
+        struct pending_template {
+            std::string path;
+            std::string content;
+            std::filesystem::file_time_type write_time;
+            compiled_template_ptr compiled;  /// Set by compileTemplates() unless the compilation failed
+            std::shared_ptr<const whz_template_pack> pack;  /// Set if served from this mapped pack, content is then empty
+        };
+
+        /// Immutable set of raw templates, optionally backed by a mapped pack for the names it doesn't contain. The
+        /// templates of a pack written by loadTemplates() are only in the pack, no copy of them is kept here.
+        struct template_snapshot {
+            whz_flat_map<std::string> templates;
+            std::shared_ptr<const whz_template_pack> pack;
+        };
+
+        using compiled_template_map = whz_flat_map<compiled_template_ptr>;
+
+        // Read all .whzt files below the directory, walking the subfolders and reading the files in parallel
+        std::vector<pending_template> readTemplateDirectory(const std::string &directoryPath);
+
+        // Build and swap in a new raw snapshot, the old templates at or below the replaced paths are dropped first.
+        // A new pack replaces the mapped one, the templates served from it are not copied into the snapshot.
+        void publishSnapshot(const std::vector<pending_template> &templates, std::span<const std::string> replaced_paths,
+                             std::shared_ptr<const whz_template_pack> pack = nullptr);
+
+        // Write the templates into a template pack and map it, the templates are then served from the pack and their
+        // heap copy is released. Nullptr if the pack couldn't be written or mapped, the templates are left as they are.
+        std::shared_ptr<const whz_template_pack> memoryMapTemplates(const std::string &target_filePath,
+                                                                    std::vector<pending_template> &templates);
+
+        // Compile a whole batch of templates and publish them with a single snapshot swap, the compiled templates at or
+        // below the replaced paths that are not in the batch are dropped
+        void compileTemplates(std::vector<pending_template> pending, std::span<const std::string> replaced_paths = {});
+
+        // All compiled templates including one of the paths as partial, directly or through other partials
+        [[nodiscard]] std::vector<std::string> dependentTemplates(const std::vector<std::string> &paths) const;
+
+        // Compile the content and publish it, unless the same file version is already compiled
+        std::expected<compiled_template_ptr, std::string> compileTemplate(const std::string &path, std::string content,
+                                                                          std::filesystem::file_time_type write_time);
+        // Compile a template straight from the mapped pack, no copy of the source
+        std::expected<compiled_template_ptr, std::string> compileTemplate(const std::string &path, std::string_view content,
+                                                                          std::shared_ptr<const whz_template_pack> pack);
+        // Publish a compiled template, unless the same file version is already published
+        compiled_template_ptr publishTemplate(const std::string &path, compiled_template_ptr compiled);
 
-        std::unordered_multimap<std::string, std::string> whz_templates;
-        whz::whz_qlogger _qlogger;
+        /// Current raw templates, readers load it atomically, writers build a new one and swap it
+        std::atomic<std::shared_ptr<const template_snapshot>> _snapshot{std::make_shared<const template_snapshot>()};
+        std::mutex _snapshot_mutex; /// Serializes the writers of _snapshot, never taken by readers
+        /// Immutable snapshot of all compiled templates, readers load it atomically, writers copy and swap it
+        std::atomic<std::shared_ptr<const compiled_template_map>> _compiled_templates{
+                std::make_shared<const compiled_template_map>()};
+        std::mutex _compile_mutex;  /// Serializes the writers of _compiled_templates, never taken by readers
+        std::mutex _reload_mutex;   /// Only one load or reload at a time
+        whz::whz_qlogger _qlogger{"templates"};
+        std::mutex _watch_mutex;
+        std::vector<std::unique_ptr<whz_file_watcher>> _watchers;   /// Last, so destroyed first: they call updateTemplates()
     };
 } // namespace whz
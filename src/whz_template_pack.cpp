@@ -0,0 +1,179 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#include "whz_template_pack.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <rapidhash.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace whz {
+
+    namespace {
+        // Write the whole buffer, retrying on short writes
+        bool write_all(int fd, const void* data, std::size_t length) {
+            const char* ptr = static_cast<const char*>(data);
+            while (length > 0) {
+                ssize_t written = ::write(fd, ptr, length);
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                ptr += written;
+                length -= static_cast<std::size_t>(written);
+            }
+            return true;
+        }
+
+        bool entry_less(const whz_template_pack::index_entry& entry, std::string_view entry_name,
+                        std::uint64_t hash, std::string_view name) {
+            return entry.name_hash != hash ? entry.name_hash < hash : entry_name < name;
+        }
+    }
+
+    std::uint64_t whz_template_pack::hash(std::string_view data) {
+        return rapidhash(data.data(), data.size());
+    }
+
+    std::expected<void, std::string> whz_template_pack::write(const std::string& pack_path,
+                                                            std::vector<std::pair<std::string_view, std::string_view>> templates) {
+        std::sort(templates.begin(), templates.end(), [](const auto& a, const auto& b) {
+            auto ha = hash(a.first), hb = hash(b.first);
+            return ha != hb ? ha < hb : a.first < b.first;
+        });
+        templates.erase(std::unique(templates.begin(), templates.end(),
+                                    [](const auto& a, const auto& b) { return a.first == b.first; }),
+                        templates.end());
+
+        header hdr{};
+        std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+        hdr.version = kVersion;
+        hdr.count = static_cast<std::uint32_t>(templates.size());
+        hdr.index_offset = sizeof(header);
+        hdr.blob_offset = hdr.index_offset + templates.size() * sizeof(index_entry);
+
+        std::vector<index_entry> index(templates.size());
+        std::uint64_t offset = hdr.blob_offset;
+        for (std::size_t i = 0; i < templates.size(); ++i) {
+            const auto& [name, content] = templates[i];
+            index[i] = index_entry{hash(name), hash(content), offset, offset + name.size(),
+                                   static_cast<std::uint32_t>(name.size()), 0, content.size()};
+            offset += name.size() + content.size();
+        }
+        hdr.file_size = offset;
+
+        // Write into a temporary file and rename it, processes that have the old pack mapped keep their old pages
+        std::filesystem::path target(pack_path);
+        std::error_code ec;
+        if (target.has_parent_path()) {
+            std::filesystem::create_directories(target.parent_path(), ec);
+        }
+        // Unique per writer, two processes writing the same pack (old and new server during an upgrade) don't
+        // truncate each other's file, the last rename wins with a complete pack
+        const std::string tmp_path = pack_path + "." + std::to_string(::getpid()) + "." +
+                                     std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+        int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return std::unexpected("Failed to create template pack: " + tmp_path);
+        }
+        bool ok = write_all(fd, &hdr, sizeof(hdr)) && write_all(fd, index.data(), index.size() * sizeof(index_entry));
+        for (const auto& [name, content] : templates) {
+            ok = ok && write_all(fd, name.data(), name.size()) && write_all(fd, content.data(), content.size());
+        }
+        ok = ok && ::fsync(fd) == 0;
+        ::close(fd);
+        if (!ok || ::rename(tmp_path.c_str(), pack_path.c_str()) != 0) {
+            ::unlink(tmp_path.c_str());
+            return std::unexpected("Failed to write template pack: " + pack_path);
+        }
+        return {};
+    }
+
+    std::expected<std::shared_ptr<const whz_template_pack>, std::string> whz_template_pack::open(const std::string& pack_path) {
+        int fd = ::open(pack_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return std::unexpected("Failed to open template pack: " + pack_path);
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+            ::close(fd);
+            return std::unexpected("Template pack is too small: " + pack_path);
+        }
+        const auto length = static_cast<std::size_t>(st.st_size);
+        void* map = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // The mapping stays valid without the descriptor
+        if (map == MAP_FAILED) {
+            return std::unexpected("Failed to memory-map the template pack: " + pack_path);
+        }
+        std::shared_ptr<const whz_template_pack> pack(new whz_template_pack(static_cast<const char*>(map), length));
+
+        const auto* hdr = reinterpret_cast<const header*>(pack->_base);
+        if (std::memcmp(hdr->magic, kMagic, sizeof(kMagic)) != 0 || hdr->version != kVersion ||
+            hdr->file_size != length || hdr->index_offset != sizeof(header) ||
+            hdr->blob_offset != hdr->index_offset + std::uint64_t{hdr->count} * sizeof(index_entry) ||
+            hdr->blob_offset > length) {
+            return std::unexpected("Invalid template pack header: " + pack_path);
+        }
+        auto* mutable_pack = const_cast<whz_template_pack*>(pack.get());
+        mutable_pack->_index = reinterpret_cast<const index_entry*>(pack->_base + hdr->index_offset);
+        mutable_pack->_count = hdr->count;
+        for (std::size_t i = 0; i < pack->_count; ++i) {
+            // Compared as lengths left after the offset, a sum of corrupt values could wrap around and pass
+            const auto& entry = pack->_index[i];
+            if (entry.name_offset < hdr->blob_offset || entry.name_offset > length ||
+                length - entry.name_offset < entry.name_length ||
+                entry.content_offset < hdr->blob_offset || entry.content_offset > length ||
+                length - entry.content_offset < entry.content_length) {
+                return std::unexpected("Corrupt template pack index: " + pack_path);
+            }
+            // find() relies on the hashes and the order, the content hash catches blobs changed after the write
+            const std::string_view name = pack->name_at(i);
+            if (hash(name) != entry.name_hash || hash(pack->content_at(i)) != entry.content_hash ||
+                (i > 0 && !entry_less(pack->_index[i - 1], pack->name_at(i - 1), entry.name_hash, name))) {
+                return std::unexpected("Corrupt template pack entry " + std::to_string(i) + ": " + pack_path);
+            }
+        }
+        ::madvise(map, length, MADV_WILLNEED);
+        return pack;
+    }
+
+    whz_template_pack::whz_template_pack(const char* base, std::size_t length)
+            : _base(base), _length(length), _index(nullptr), _count(0) {}
+
+    whz_template_pack::~whz_template_pack() {
+        ::munmap(const_cast<char*>(_base), _length);
+    }
+
+    std::string_view whz_template_pack::name_at(std::size_t i) const {
+        return {_base + _index[i].name_offset, _index[i].name_length};
+    }
+
+    std::string_view whz_template_pack::content_at(std::size_t i) const {
+        return {_base + _index[i].content_offset, _index[i].content_length};
+    }
+
+    std::optional<std::string_view> whz_template_pack::find(std::string_view name) const {
+        const std::uint64_t name_hash = hash(name);
+        std::size_t lo = 0, hi = _count;
+        while (lo < hi) {
+            std::size_t mid = lo + (hi - lo) / 2;
+            if (entry_less(_index[mid], name_at(mid), name_hash, name)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < _count && _index[lo].name_hash == name_hash && name_at(lo) == name) {
+            return content_at(lo);
+        }
+        return std::nullopt;
+    }
+
+} // whz
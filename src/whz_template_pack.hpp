@@ -0,0 +1,81 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <expected>
+#include <utility>
+
+namespace whz {
+
+    /**
+     * @brief Read-only, memory-mapped pack of templates. The file is written once with write() and then mapped by any
+     * number of processes, they all share the same pages through the page cache. Lookups hand out string_views into
+     * the mapping, nothing is copied. Layout (native byte order, all offsets from the start of the file):
+     *
+     *   header   : magic "WHZTPACK", version, template count, offsets of the index and the blob, total file size
+     *   index    : one entry per template sorted by (name hash, name): name hash, content hash, name and content
+     *              offset/length
+     *   blob     : all names and contents back to back
+     *
+     */
+    class whz_template_pack {
+    public:
+        static constexpr char kMagic[8] = {'W', 'H', 'Z', 'T', 'P', 'A', 'C', 'K'};
+        static constexpr std::uint32_t kVersion = 1;
+
+        struct header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t count;
+            std::uint64_t index_offset;
+            std::uint64_t blob_offset;
+            std::uint64_t file_size;
+        };
+
+        struct index_entry {
+            std::uint64_t name_hash;
+            std::uint64_t content_hash;
+            std::uint64_t name_offset;
+            std::uint64_t content_offset;
+            std::uint32_t name_length;
+            std::uint32_t reserved;
+            std::uint64_t content_length;
+        };
+
+        /// Write the templates (name, content) into a new pack file, replaces an existing file atomically
+        static std::expected<void, std::string> write(const std::string& pack_path,
+                                                      std::vector<std::pair<std::string_view, std::string_view>> templates);
+        /// Map an existing pack file read-only and validate its header, its index and the hashes of all entries
+        static std::expected<std::shared_ptr<const whz_template_pack>, std::string> open(const std::string& pack_path);
+
+        whz_template_pack(const whz_template_pack&) = delete;
+        whz_template_pack& operator=(const whz_template_pack&) = delete;
+        ~whz_template_pack();
+
+        /// The content of the template, the view stays valid as long as this pack object lives
+        [[nodiscard]] std::optional<std::string_view> find(std::string_view name) const;
+        [[nodiscard]] std::size_t size() const { return _count; }
+        [[nodiscard]] std::string_view name_at(std::size_t i) const;
+        [[nodiscard]] std::string_view content_at(std::size_t i) const;
+        [[nodiscard]] std::uint64_t content_hash_at(std::size_t i) const { return _index[i].content_hash; }
+
+        static std::uint64_t hash(std::string_view data);
+
+    private:
+        whz_template_pack(const char* base, std::size_t length);
+
+        const char* _base;
+        std::size_t _length;
+        const index_entry* _index;
+        std::size_t _count;
+    };
+
+} // whz
@@ -3,6 +3,91 @@
 //
 
 #include "whz_template_parser.hpp"
+#include <algorithm>
 
 namespace whz {
-} // whz
\ No newline at end of file
+
+    namespace {
+        std::string_view trim(std::string_view sv) {
+            while (!sv.empty() && (sv.front() == ' ' || sv.front() == '\t')) sv.remove_prefix(1);
+            while (!sv.empty() && (sv.back() == ' ' || sv.back() == '\t')) sv.remove_suffix(1);
+            return sv;
+        }
+
+        void add_unique(std::vector<std::string>& names, std::string_view name) {
+            if (!name.empty() && std::find(names.begin(), names.end(), name) == names.end()) {
+                names.emplace_back(name);
+            }
+        }
+    }
+
+    /**
+     * @brief Walk over all {{...}} tags of the template and call visit(kind, name) for each of them. Set-delimiter
+     * tags are not supported and reported as tag_kind::other, WHZ templates use the default delimiters.
+     *
+     */
+    template <typename Visitor>
+    void whz_template_parser::for_each_tag(std::string_view template_source, Visitor&& visit) {
+        std::size_t pos = 0;
+        while ((pos = template_source.find("{{", pos)) != std::string_view::npos) {
+            pos += 2;
+            bool triple = pos < template_source.size() && template_source[pos] == '{';
+            std::string_view closing = triple ? "}}}" : "}}";
+            std::size_t end = template_source.find(closing, pos);
+            if (end == std::string_view::npos) {
+                return;
+            }
+            std::string_view tag = template_source.substr(pos, end - pos);
+            pos = end + closing.size();
+            if (triple) {
+                visit(tag_kind::variable, trim(tag.substr(1)));
+                continue;
+            }
+            tag = trim(tag);
+            if (tag.empty()) {
+                continue;
+            }
+            switch (tag.front()) {
+                case '#':
+                case '^':
+                    visit(tag_kind::section, trim(tag.substr(1)));
+                    break;
+                case '&':
+                    visit(tag_kind::variable, trim(tag.substr(1)));
+                    break;
+                case '>':
+                    visit(tag_kind::partial, trim(tag.substr(1)));
+                    break;
+                case '!':
+                case '/':
+                case '=':
+                    visit(tag_kind::other, tag);
+                    break;
+                default:
+                    visit(tag_kind::variable, tag);
+                    break;
+            }
+        }
+    }
+
+    std::vector<std::string> whz_template_parser::extract_variables(std::string_view template_source) {
+        std::vector<std::string> names;
+        for_each_tag(template_source, [&names](tag_kind kind, std::string_view name) {
+            if (kind == tag_kind::variable || kind == tag_kind::section) {
+                add_unique(names, name);
+            }
+        });
+        return names;
+    }
+
+    std::vector<std::string> whz_template_parser::extract_partials(std::string_view template_source) {
+        std::vector<std::string> names;
+        for_each_tag(template_source, [&names](tag_kind kind, std::string_view name) {
+            if (kind == tag_kind::partial) {
+                add_unique(names, name);
+            }
+        });
+        return names;
+    }
+
+} // whz
@@ -4,10 +4,29 @@
 
 #pragma once
 
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace whz {
 
+    /**
+     * @brief Lightweight scanner for the mustache tags of a .whzt template. It doesn't build a full AST (bustache does
+     * that for rendering), it only collects the information the server needs up front, like which variables and
+     * partials a template references.
+     *
+     */
     class whz_template_parser {
+    public:
+        /// Names of all variables and sections used in the template, in order of first appearance, without duplicates
+        static std::vector<std::string> extract_variables(std::string_view template_source);
+        /// Names of all partials ({{> name}}) referenced by the template, without duplicates
+        static std::vector<std::string> extract_partials(std::string_view template_source);
 
+    private:
+        enum class tag_kind : char { variable, section, partial, other };
+        template <typename Visitor>
+        static void for_each_tag(std::string_view template_source, Visitor&& visit);
     };
 
 } // whz
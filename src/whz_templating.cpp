@@ -3,45 +3,150 @@
 //
 
 #include "whz_templating.hpp"
+#include <algorithm>
+#include <map>
+#include <taskflow/taskflow.hpp>
 
 namespace whz {
-// FIXME
-    std::vector<std::string> TemplateDefiner::GetTemplateVariables(const std::string& template_file) { std::terminate(); }
-    std::string TemplateDefiner::GetSQLForVariable(const std::string& variable_name) { std::terminate(); }
 
-    std::expected<TemplateProcessor, std::string> TemplateProcessor::Create(const std::string& db_path) {
-        try {
-            auto db = std::make_unique<SQLite::Database>(db_path, SQLite::OPEN_READONLY);
-            return TemplateProcessor(std::move(db));
-        } catch (const SQLite::Exception& e) {
-            // Convert the exception into an error message without throwing
-            return std::unexpected("Failed to open database: " + std::string(e.what()));
+    namespace {
+        // Fetches with fewer queries than this run sequentially, the hand-off to the executor would cost more
+        constexpr std::size_t kParallelFetchMinQueries = 4;
+
+        tf::Executor& FetchExecutor() {
+            static tf::Executor executor;
+            return executor;
+        }
+
+        // Quote an SQL identifier, doubling embedded quotes
+        std::string QuoteIdentifier(const std::string& identifier) {
+            std::string quoted = "\"";
+            for (char c : identifier) {
+                if (c == '"') quoted += '"';
+                quoted += c;
+            }
+            return quoted + "\"";
         }
     }
 
-    TemplateProcessor::TemplateProcessor(std::unique_ptr<SQLite::Database> db)
-            : db_(std::move(db)) {}
+    std::vector<std::string> TemplateDefiner::GetTemplateVariables(const std::string& template_file) {
+        auto compiled_exp = whz_templateCache::getInstance().getCompiledTemplate(template_file);
+        if (!compiled_exp) {
+            return {};
+        }
+        return (*compiled_exp)->variables;
+    }
+
+    std::string TemplateDefiner::GetSQLForVariable(const std::string& variable_name) {
+        auto it = variable_sql_.find(variable_name);
+        return it != variable_sql_.end() ? it->second : std::string{};
+    }
+
+    void TemplateDefiner::SetSQLForVariable(const std::string& variable_name, const std::string& sql) {
+        variable_sql_[variable_name] = sql;
+    }
+
+    void TemplateDefiner::SetColumnForVariable(const std::string& variable_name, const std::string& table,
+                                               const std::string& column, const std::string& where) {
+        variable_column_[variable_name] = ColumnBinding{table, column, where};
+    }
+
+    std::optional<TemplateDefiner::ColumnBinding> TemplateDefiner::GetColumnForVariable(const std::string& variable_name) const {
+        auto it = variable_column_.find(variable_name);
+        if (it == variable_column_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    std::expected<TemplateProcessor, std::string> TemplateProcessor::Create(const std::string& db_path,
+                                                                            std::size_t read_connections) {
+        auto pool_exp = whz_db_pool::create(db_path, read_connections);
+        if (!pool_exp) {
+            return std::unexpected(pool_exp.error());
+        }
+        return TemplateProcessor(std::move(*pool_exp));
+    }
+
+    std::expected<TemplateProcessor, std::string> TemplateProcessor::Create(std::shared_ptr<whz_db_pool> db_pool) {
+        if (!db_pool) {
+            return std::unexpected("No database pool given.");
+        }
+        return TemplateProcessor(std::move(db_pool));
+    }
+
+    TemplateProcessor::TemplateProcessor(std::shared_ptr<whz_db_pool> db_pool)
+            : db_pool_(std::move(db_pool)) {}
 
     void TemplateProcessor::SetTemplateDefiner(std::shared_ptr<TemplateDefiner> definer) {
         template_definer_ = definer;
     }
 
-    [[nodiscard]] std::expected<std::string, std::string> TemplateProcessor::ReadTemplateFile(const std::string& template_file) {
-        std::ifstream file(template_file);
-        if (!file) {
-            return std::unexpected("Failed to open template file: " + template_file);
+    /**
+     * Group the variables into as few queries as possible: all column bound variables of the same table and filter
+     * share one SELECT, free SQL variables get a query each. The generated SQL only depends on the variable set of
+     * the template, so the prepared statements are reused on every render of it.
+     */
+    std::vector<TemplateProcessor::FetchQuery> TemplateProcessor::PlanFetchQueries(const std::vector<std::string>& variables) const {
+        std::vector<FetchQuery> queries;
+        std::map<std::pair<std::string, std::string>, std::size_t> column_queries; // (table, where) -> index in queries
+        std::vector<std::vector<std::string>> query_columns;
+
+        for (const auto& var : variables) {
+            if (auto binding = template_definer_->GetColumnForVariable(var)) {
+                auto [it, inserted] = column_queries.try_emplace({binding->table, binding->where}, queries.size());
+                if (inserted) {
+                    queries.emplace_back();
+                    query_columns.emplace_back();
+                }
+                queries[it->second].variables.push_back(var);
+                query_columns[it->second].push_back(QuoteIdentifier(binding->column));
+                continue;
+            }
+            auto sql = template_definer_->GetSQLForVariable(var);
+            if (!sql.empty()) {
+                queries.push_back(FetchQuery{std::move(sql), {var}});
+                query_columns.emplace_back();
+            }
+            // Otherwise not bound to the database, e.g. a section or a value provided otherwise
         }
 
-        return std::string{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        for (const auto& [key, index] : column_queries) {
+            std::string sql = "SELECT ";
+            for (std::size_t i = 0; i < query_columns[index].size(); ++i) {
+                sql += (i == 0 ? "" : ", ") + query_columns[index][i];
+            }
+            sql += " FROM " + QuoteIdentifier(key.first);
+            if (!key.second.empty()) {
+                sql += " WHERE " + key.second;
+            }
+            queries[index].sql = sql + " LIMIT 1";
+        }
+        return queries;
     }
 
-    [[nodiscard]] std::expected<bustache::format, std::string> TemplateProcessor::CompileTemplate(const std::string& template_content) {
+    std::expected<std::vector<std::string>, std::string> TemplateProcessor::RunFetchQuery(whz_db_connection& connection,
+                                                                                         const FetchQuery& query) {
+        std::vector<std::string> values(query.variables.size());
         try {
-            bustache::format format{template_content};
-            return format;
-        } catch (const std::exception& e) {
-            return std::unexpected("Template compilation failed: " + std::string(e.what()));
+            SQLite::Statement& statement = connection.prepare(query.sql);
+            if (statement.executeStep()) {
+                const int columns = statement.getColumnCount();
+                for (std::size_t i = 0; i < values.size() && static_cast<int>(i) < columns; ++i) {
+                    values[i] = statement.getColumn(static_cast<int>(i)).getString();
+                }
+            }
+            statement.reset();
+        } catch (const SQLite::Exception& e) {
+            // Convert the exception into an error message without throwing, naming every variable of the batch
+            std::string names;
+            for (const auto& var : query.variables) {
+                names += (names.empty() ? "'" : ", '") + var + "'";
+            }
+            return std::unexpected("SQL execution error for variable" + std::string(query.variables.size() > 1 ? "s " : " ") +
+                                   names + ": " + e.what());
         }
+        return values;
     }
 
     [[nodiscard]] std::expected<DataContext, std::string> TemplateProcessor::FetchData(const std::string& template_file) {
@@ -49,54 +154,135 @@ namespace whz {
             return std::unexpected("Template definer not set.");
         }
 
-        auto variables = template_definer_->GetTemplateVariables(template_file);
-        DataContext context;
-
-        for (const auto& var : variables) {
-            auto sql = template_definer_->GetSQLForVariable(var);
+        auto queries = PlanFetchQueries(template_definer_->GetTemplateVariables(template_file));
+        std::vector<std::expected<std::vector<std::string>, std::string>> results(queries.size());
 
-            try {
-                SQLite::Statement query(*db_, sql);
-
-                if (query.executeStep()) {
-                    context.data[var] = query.getColumn(0).getString();
-                } else {
-                    context.data[var] = "";
-                }
-            } catch (const SQLite::Exception& e) {
-                // Convert the exception into an error message without throwing
-                return std::unexpected("SQL execution error for variable '" + var + "': " + e.what());
+        if (queries.size() >= kParallelFetchMinQueries && db_pool_->size() > 1) {
+            // Independent queries, each task leases its own read connection
+            tf::Taskflow taskflow;
+            for (std::size_t i = 0; i < queries.size(); ++i) {
+                taskflow.emplace([this, &queries, &results, i] {
+                    auto connection = db_pool_->acquire();
+                    results[i] = RunFetchQuery(*connection, queries[i]);
+                });
+            }
+            FetchExecutor().run(taskflow).wait();
+        } else if (!queries.empty()) {
+            auto connection = db_pool_->acquire();
+            for (std::size_t i = 0; i < queries.size(); ++i) {
+                results[i] = RunFetchQuery(*connection, queries[i]);
             }
         }
 
+        DataContext context;
+        for (std::size_t i = 0; i < queries.size(); ++i) {
+            if (!results[i]) {
+                return std::unexpected(results[i].error());
+            }
+            for (std::size_t v = 0; v < queries[i].variables.size(); ++v) {
+                context.data[queries[i].variables[v]] = std::move((*results[i])[v]);
+            }
+        }
         return context;
     }
 
-    [[nodiscard]] std::expected<std::string, std::string> TemplateProcessor::ProcessTemplate(const std::string& template_file) {
-        auto template_content_exp = ReadTemplateFile(template_file);
-        if (!template_content_exp) {
-            return std::unexpected(template_content_exp.error());
+    [[nodiscard]] std::expected<void, std::string> TemplateProcessor::RenderTemplate(const whz_compiled_template& compiled,
+                                                                                   const std::filesystem::path& template_file,
+                                                                                   const DataContext& data,
+                                                                                   std::string& output,
+                                                                                   std::vector<std::string>* used_partials) {
+        // Partials are looked up next to the including template first, then by their name as path. The compiled
+        // partials are pinned here so the cache can't drop them while rendering.
+        std::vector<compiled_template_ptr> partials_in_use;
+        const auto template_dir = template_file.parent_path();
+        auto context = [&](std::string const& name) -> bustache::format const* {
+            for (const auto& candidate : {template_dir / (name + ".whzt"), std::filesystem::path(name)}) {
+                auto partial_exp = whz_templateCache::getInstance().getCompiledTemplate(candidate.string());
+                if (partial_exp) {
+                    if (used_partials) {
+                        used_partials->push_back(candidate.string());
+                    }
+                    partials_in_use.push_back(*partial_exp);
+                    return &partials_in_use.back()->format;
+                }
+            }
+            return nullptr;
+        };
+        // Write straight into the output buffer, no intermediate strings
+        auto sink = [&output](char const* data, std::size_t count) { output.append(data, count); };
+
+        const auto output_size = output.size();
+        try {
+            bustache::render(sink, compiled.format, data, context, bustache::escape_html);
+        } catch (const std::exception& e) {
+            output.resize(output_size);
+            return std::unexpected("Template rendering failed: " + std::string(e.what()));
         }
-        auto template_content = *template_content_exp;
+        return {};
+    }
 
-        auto format_exp = CompileTemplate(template_content);
-        if (!format_exp) {
-            return std::unexpected(format_exp.error());
+    [[nodiscard]] std::expected<void, std::string> TemplateProcessor::ProcessTemplate(const std::string& template_file,
+                                                                                    std::string& output) {
+        // The template is parsed only once, after that it's a lookup in the cache
+        auto compiled_exp = whz_templateCache::getInstance().getCompiledTemplate(template_file);
+        if (!compiled_exp) {
+            return std::unexpected(compiled_exp.error());
         }
-        auto format = *format_exp;
+        compiled_template_ptr compiled = *compiled_exp; // Keeps the format alive even if the cache drops it meanwhile
+
+        auto& output_cache = whz_output_cache::getInstance();
+        const auto render_epoch = output_cache.epoch(); // Before the fetch, see whz_output_cache::put()
 
         auto data_exp = FetchData(template_file);
         if (!data_exp) {
             return std::unexpected(data_exp.error());
         }
-        auto data = *data_exp;
 
-        try {
-            return std::unexpected("FIXME");
-            // FIXME: return bustache::render_string(format, data, nullptr);
-        } catch (const std::exception& e) {
-            return std::unexpected("Template rendering failed: " + std::string(e.what()));
+        const auto cache_key = whz_output_cache::make_key(template_file, whz_output_cache::hash_data(data_exp->data));
+        if (output_cache.get(cache_key, template_file, output)) {
+            return {};
+        }
+
+        const auto output_start = output.size();
+        std::vector<std::string> used_partials;
+        auto rendered = RenderTemplate(*compiled, template_file, *data_exp, output, &used_partials);
+        if (rendered && output_cache.is_enabled()) {
+            auto tags = OutputCacheTags(*compiled, template_file);
+            for (const auto& partial : used_partials) {
+                tags.push_back("template:" + partial);
+            }
+            output_cache.put(cache_key, template_file, std::string_view(output).substr(output_start), tags, render_epoch);
+        }
+        return rendered;
+    }
+
+    /**
+     * The rendered page depends on its template file and on every table a variable of it is bound to. Variables with
+     * free SQL can't be tagged, their pages only expire by TTL.
+     */
+    std::vector<std::string> TemplateProcessor::OutputCacheTags(const whz_compiled_template& compiled,
+                                                                const std::string& template_file) const {
+        std::vector<std::string> tags{"template:" + template_file};
+        if (template_definer_) {
+            for (const auto& var : compiled.variables) {
+                if (auto binding = template_definer_->GetColumnForVariable(var)) {
+                    std::string tag = "table:" + binding->table;
+                    if (std::find(tags.begin(), tags.end(), tag) == tags.end()) {
+                        tags.push_back(std::move(tag));
+                    }
+                }
+            }
+        }
+        return tags;
+    }
+
+    [[nodiscard]] std::expected<std::string, std::string> TemplateProcessor::ProcessTemplate(const std::string& template_file) {
+        std::string output;
+        auto result = ProcessTemplate(template_file, output);
+        if (!result) {
+            return std::unexpected(result.error());
         }
+        return output;
     }
 
 } // whz
\ No newline at end of file
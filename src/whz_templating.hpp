@@ -11,10 +11,14 @@
 #include <vector>
 #include <expected>
 #include <unordered_map>
+#include <optional>
 #include <bustache/model.hpp>
 #include <bustache/format.hpp>
-#include <bustache/render/string.hpp>
+#include <bustache/render.hpp>
 #include <SQLiteCpp/SQLiteCpp.h>
+#include "whz_templateCache.hpp"
+#include "whz_database.hpp"
+#include "whz_output_cache.hpp"
 
 namespace whz {
 
@@ -22,14 +26,35 @@ namespace whz {
 
     };
 
-// Placeholder for the TemplateDefiner class
+// TemplateDefiner class, binds the template variables to the SQL delivering their values
     class TemplateDefiner {
     public:
         // Returns the list of variables required by the template
         std::vector<std::string> GetTemplateVariables(const std::string& template_file);
 
-        // Returns the SQL query for a given variable
+        // Returns the SQL query for a given variable, empty if the variable isn't bound to the database
         std::string GetSQLForVariable(const std::string& variable_name);
+
+        // Binds a variable to a query, the first column of the first row is the value. Call this during setup only.
+        void SetSQLForVariable(const std::string& variable_name, const std::string& sql);
+
+        // A variable bound to a column, all variables of the same table and filter are fetched with a single query
+        struct ColumnBinding {
+            std::string table;
+            std::string column;
+            std::string where;  // Optional SQL filter without the WHERE keyword
+        };
+
+        // Binds a variable to a table column, the value is taken from the first matching row. Call this during setup only.
+        void SetColumnForVariable(const std::string& variable_name, const std::string& table, const std::string& column,
+                                  const std::string& where = {});
+
+        // Returns the column binding of a variable, if it has one
+        [[nodiscard]] std::optional<ColumnBinding> GetColumnForVariable(const std::string& variable_name) const;
+
+    private:
+        std::unordered_map<std::string, std::string> variable_sql_;
+        std::unordered_map<std::string, ColumnBinding> variable_column_;
     };
 
 // Custom Data Model
@@ -43,31 +68,54 @@ namespace whz {
 // TemplateProcessor class
     class TemplateProcessor {
     public:
-        // Factory method to create a TemplateProcessor instance
-        static std::expected<TemplateProcessor, std::string> Create(const std::string& db_path);
+        // Factory method to create a TemplateProcessor instance on its own read-only pool, without a writer
+        static std::expected<TemplateProcessor, std::string> Create(const std::string& db_path,
+                                                                    std::size_t read_connections = 1);
+
+        // Factory method to create a TemplateProcessor on the shared database pool of the server
+        static std::expected<TemplateProcessor, std::string> Create(std::shared_ptr<whz_db_pool> db_pool);
 
         TemplateProcessor(TemplateProcessor&&) = default;
         TemplateProcessor& operator=(TemplateProcessor&&) = default;
         ~TemplateProcessor() = default;
 
+        // Processes the template file and appends the rendered output to the given buffer (e.g. reply::content).
+        // On error the buffer is left as it was before the call.
+        [[nodiscard]] std::expected<void, std::string> ProcessTemplate(const std::string& template_file, std::string& output);
+
         // Processes the template file and returns the rendered string or an error message
         [[nodiscard]] std::expected<std::string, std::string> ProcessTemplate(const std::string& template_file);
 
         // Sets the TemplateDefiner instance
         void SetTemplateDefiner(std::shared_ptr<TemplateDefiner> definer);
 
+        // Renders a compiled template with the data into the output buffer, partials are resolved relative to
+        // template_file. The paths of the partials used are appended to used_partials if given.
+        [[nodiscard]] static std::expected<void, std::string> RenderTemplate(const whz_compiled_template& compiled,
+                                                                             const std::filesystem::path& template_file,
+                                                                             const DataContext& data, std::string& output,
+                                                                             std::vector<std::string>* used_partials = nullptr);
+
     private:
-        std::unique_ptr<SQLite::Database> db_;
+        // One SQL query of a page fetch, column i of the first row is the value of variables[i]
+        struct FetchQuery {
+            std::string sql;
+            std::vector<std::string> variables;
+        };
+
+        std::shared_ptr<whz_db_pool> db_pool_;
         std::shared_ptr<TemplateDefiner> template_definer_;
 
         // Private constructor
-        TemplateProcessor(std::unique_ptr<SQLite::Database> db);
+        TemplateProcessor(std::shared_ptr<whz_db_pool> db_pool);
 
         // Helper functions
-        [[nodiscard]] std::expected<std::string, std::string> ReadTemplateFile(const std::string& template_file);
-        [[nodiscard]] std::expected<bustache::format, std::string> CompileTemplate(const std::string& template_content);
-        // FIXME
         [[nodiscard]] std::expected<DataContext, std::string> FetchData(const std::string& template_file);
+        [[nodiscard]] std::vector<FetchQuery> PlanFetchQueries(const std::vector<std::string>& variables) const;
+        [[nodiscard]] static std::expected<std::vector<std::string>, std::string> RunFetchQuery(whz_db_connection& connection,
+                                                                                              const FetchQuery& query);
+        [[nodiscard]] std::vector<std::string> OutputCacheTags(const whz_compiled_template& compiled,
+                                                               const std::string& template_file) const;
     };
 
 } // whz
@@ -0,0 +1,296 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include "whz_trace.hpp"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <random>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#include "fmt/format.h"
+#include "whz_config.hpp"
+
+namespace whz {
+
+    namespace {
+        std::uint64_t ClockNs(clockid_t clock) {
+            timespec ts{};
+            ::clock_gettime(clock, &ts);
+            return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<std::uint64_t>(ts.tv_nsec);
+        }
+
+        bool HasInvariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+            unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) {
+                return false;
+            }
+            __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+            return (edx & (1u << 8)) != 0;
+#else
+            return false;
+#endif
+        }
+
+        void AppendJsonString(std::string &out, std::string_view text) {
+            out += '"';
+            for (const char c : text) {
+                switch (c) {
+                    case '"': out += "\\\""; break;
+                    case '\\': out += "\\\\"; break;
+                    case '\n': out += "\\n"; break;
+                    case '\r': out += "\\r"; break;
+                    case '\t': out += "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c));
+                        } else {
+                            out += c;
+                        }
+                }
+            }
+            out += '"';
+        }
+
+        // The spans written per request: name, start phase, end phase. The first one is the parent of the others.
+        struct span_def {
+            std::string_view name;
+            trace_phase from;
+            trace_phase to;
+        };
+        constexpr span_def Spans[] = {
+                {"http.request", trace_phase::accepted, trace_phase::write_end},
+                {"wait_first_byte", trace_phase::accepted, trace_phase::first_byte_read},
+                {"read_headers", trace_phase::first_byte_read, trace_phase::headers_parsed},
+                {"handler", trace_phase::handler_start, trace_phase::handler_end},
+                {"write", trace_phase::write_start, trace_phase::write_end},
+        };
+    }
+
+    std::uint64_t whz_trace_clock::now() {
+#if defined(__x86_64__) || defined(__i386__)
+        if (s_use_tsc) {
+            return __rdtsc();
+        }
+#endif
+        return ClockNs(CLOCK_MONOTONIC_COARSE);
+    }
+
+    std::uint64_t whz_trace_clock::to_epoch_ns(std::uint64_t ticks) {
+        const auto delta = static_cast<double>(static_cast<std::int64_t>(ticks - s_tick_anchor)) * s_ns_per_tick;
+        return s_epoch_anchor_ns + static_cast<std::int64_t>(delta);
+    }
+
+    /**
+     * @brief Count TSC ticks over 20 ms of CLOCK_MONOTONIC, enough for an error well below a microsecond per second.
+     * Without an invariant TSC the ticks are CLOCK_MONOTONIC_COARSE nanoseconds already. Done only once, a restart
+     * of the tracer must not switch the clock under requests that are being traced.
+     *
+     */
+    void whz_trace_clock::calibrate() {
+        static std::once_flag calibrated;
+        std::call_once(calibrated, [] {
+            s_use_tsc = false;
+            s_ns_per_tick = 1.0;
+#if defined(__x86_64__) || defined(__i386__)
+            if (HasInvariantTsc()) {
+                const std::uint64_t mono_start = ClockNs(CLOCK_MONOTONIC);
+                const std::uint64_t tsc_start = __rdtsc();
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                const std::uint64_t mono_end = ClockNs(CLOCK_MONOTONIC);
+                const std::uint64_t tsc_end = __rdtsc();
+                if (tsc_end > tsc_start) {
+                    s_ns_per_tick = static_cast<double>(mono_end - mono_start) / static_cast<double>(tsc_end - tsc_start);
+                    s_use_tsc = true;
+                }
+            }
+#endif
+            s_tick_anchor = now();
+            s_epoch_anchor_ns = ClockNs(CLOCK_REALTIME);
+        });
+    }
+
+    whz_tracer::~whz_tracer() {
+        stop();
+    }
+
+    whz_tracer_options whz_tracer::options_from_config() {
+        whz_tracer_options options;
+        options.sample_rate = Config::get<Config::ConfigParameter::TRACE_SAMPLE_RATE>();
+        options.path = Config::get<Config::ConfigParameter::TRACE_PATH>();
+        if (Config::get<Config::ConfigParameter::TRACE_FORMAT>() == "otlp") {
+            options.format = whz_tracer_options::file_format::otlp;
+        }
+        return options;
+    }
+
+    bool whz_tracer::start(const whz_tracer_options& options) {
+        stop();
+        if (options.sample_rate == 0 || options.path.empty()) {
+            return false;
+        }
+        this->_options = options;
+        whz_trace_clock::calibrate();
+
+        this->_fd = ::open(options.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+        if (this->_fd < 0) {
+            WHZ_LOG_ERROR(this->_qlogger, "Trace file {} not opened: {}", options.path.string(), std::strerror(errno));
+            return false;
+        }
+        struct stat st{};
+        const bool empty = ::fstat(this->_fd, &st) != 0 || st.st_size == 0;
+        this->_first_event = empty;
+        if (empty && options.format == whz_tracer_options::file_format::chrome) {
+            // The closing ] is optional in the Chrome trace format, the file can be appended to and read at any time
+            [[maybe_unused]] auto written = ::write(this->_fd, "[\n", 2);
+        }
+
+        this->_writer = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+        // Release: a thread that sees the rate also sees the clock parameters written by calibrate()
+        this->_sample_rate.store(options.sample_rate, std::memory_order_release);
+        WHZ_LOG_INFO(this->_qlogger, "Tracing 1 in {} requests to {}", options.sample_rate, options.path.string());
+        return true;
+    }
+
+    void whz_tracer::stop() {
+        this->_sample_rate.store(0, std::memory_order_relaxed);
+        if (this->_writer.joinable()) {
+            this->_writer.request_stop();
+            this->_writer.join();
+        }
+        if (this->_fd >= 0) {
+            ::close(this->_fd);
+            this->_fd = -1;
+        }
+    }
+
+    void whz_tracer::finish(whz_request_trace& trace, std::string_view method, std::string_view path,
+                            std::uint16_t status) {
+        if (!trace.active) {
+            return;
+        }
+        trace.active = false;
+        finished_trace finished{trace, std::string(method), std::string(path), status,
+                                static_cast<std::uint64_t>(::gettid())};
+        std::lock_guard lock(this->_mutex);
+        this->_pending.push_back(std::move(finished));
+    }
+
+    void whz_tracer::run(std::stop_token stop_token) {
+        while (!stop_token.stop_requested()) {
+            {
+                std::unique_lock lock(this->_mutex);
+                this->_wake.wait_for(lock, stop_token, this->_options.flush_interval, [] { return false; });
+            }
+            write_pending();
+        }
+        write_pending();
+    }
+
+    void whz_tracer::write_pending() {
+        std::vector<finished_trace> batch;
+        {
+            std::lock_guard lock(this->_mutex);
+            batch.swap(this->_pending);
+        }
+        if (batch.empty() || this->_fd < 0) {
+            return;
+        }
+
+        std::string out;
+        for (const auto& finished : batch) {
+            if (this->_options.format == whz_tracer_options::file_format::otlp) {
+                append_otlp(out, finished);
+            } else {
+                append_chrome(out, finished);
+            }
+        }
+        std::size_t offset = 0;
+        while (offset < out.size()) {
+            const ssize_t n = ::write(this->_fd, out.data() + offset, out.size() - offset);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                WHZ_LOG_ERROR(this->_qlogger, "Trace write to {} failed: {}", this->_options.path.string(),
+                              std::strerror(errno));
+                return;
+            }
+            offset += static_cast<std::size_t>(n);
+        }
+    }
+
+    /// One complete ("X") event per span, in microseconds. The request span carries the method, path and status.
+    void whz_tracer::append_chrome(std::string& out, const finished_trace& finished) {
+        auto it = std::back_inserter(out);
+        const auto pid = static_cast<long>(::getpid());
+        for (const auto& span : Spans) {
+            const std::uint64_t from = finished.trace[span.from];
+            const std::uint64_t to = finished.trace[span.to];
+            if (from == 0 || to == 0 || to < from) {
+                continue;   // The request ended before this phase, e.g. a parse error has no handler span
+            }
+            const std::uint64_t start_ns = whz_trace_clock::to_epoch_ns(from);
+            const std::uint64_t end_ns = whz_trace_clock::to_epoch_ns(to);
+            out += std::exchange(this->_first_event, false) ? "" : ",\n";
+            // Microseconds with the nanoseconds as fraction, printed from integers as a double would round them
+            fmt::format_to(it, R"({{"name":"{}","cat":"http","ph":"X","ts":{}.{:03},"dur":{}.{:03},"pid":{},"tid":{})",
+                           span.name, start_ns / 1000, start_ns % 1000, (end_ns - start_ns) / 1000,
+                           (end_ns - start_ns) % 1000, pid, finished.thread_id);
+            if (span.from == trace_phase::accepted && span.to == trace_phase::write_end) {
+                out += R"(,"args":{"method":)";
+                AppendJsonString(out, finished.method);
+                out += R"(,"path":)";
+                AppendJsonString(out, finished.path);
+                fmt::format_to(it, R"(,"status":{}}})", finished.status);
+            }
+            out += '}';
+        }
+    }
+
+    /// One ExportTraceServiceRequest per request and line, the request span is the parent of the phase spans
+    void whz_tracer::append_otlp(std::string& out, const finished_trace& finished) const {
+        thread_local std::mt19937_64 random{std::random_device{}()};
+        auto it = std::back_inserter(out);
+        const std::string trace_id = fmt::format("{:016x}{:016x}", random(), random());
+        const std::string parent_id = fmt::format("{:016x}", random());
+
+        out += R"({"resourceSpans":[{"resource":{"attributes":[{"key":"service.name","value":{"stringValue":"whz-core"}}]},)"
+               R"("scopeSpans":[{"scope":{"name":"whz"},"spans":[)";
+        bool first = true;
+        for (const auto& span : Spans) {
+            const std::uint64_t from = finished.trace[span.from];
+            const std::uint64_t to = finished.trace[span.to];
+            if (from == 0 || to == 0 || to < from) {
+                continue;
+            }
+            const bool is_parent = span.from == trace_phase::accepted && span.to == trace_phase::write_end;
+            out += std::exchange(first, false) ? "" : ",";
+            fmt::format_to(it, R"({{"traceId":"{}","spanId":"{}",)", trace_id,
+                           is_parent ? parent_id : fmt::format("{:016x}", random()));
+            if (!is_parent) {
+                fmt::format_to(it, R"("parentSpanId":"{}",)", parent_id);
+            }
+            fmt::format_to(it, R"("name":"{}","kind":{},"startTimeUnixNano":"{}","endTimeUnixNano":"{}")", span.name,
+                           is_parent ? 2 : 1, whz_trace_clock::to_epoch_ns(from), whz_trace_clock::to_epoch_ns(to));
+            if (is_parent) {
+                out += R"(,"attributes":[{"key":"http.request.method","value":{"stringValue":)";
+                AppendJsonString(out, finished.method);
+                out += R"(}},{"key":"url.path","value":{"stringValue":)";
+                AppendJsonString(out, finished.path);
+                fmt::format_to(it, R"(}}}},{{"key":"http.response.status_code","value":{{"intValue":"{}"}}}}])",
+                               finished.status);
+            }
+            out += '}';
+        }
+        out += "]}]}]}\n";
+    }
+
+} // whz
@@ -0,0 +1,145 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "whz_quill_wrapper.hpp"
+
+namespace whz {
+
+    /**
+     * @brief Cheap timestamps for tracing. On x86 with an invariant TSC this is rdtsc, a few cycles, converted to
+     * nanoseconds only when the trace is written. Elsewhere it's CLOCK_MONOTONIC_COARSE, which is as cheap but only
+     * has the resolution of the kernel tick.
+     *
+     */
+    class whz_trace_clock {
+    public:
+        [[nodiscard]] static std::uint64_t now();
+        /// Nanoseconds since the epoch of a now() value
+        [[nodiscard]] static std::uint64_t to_epoch_ns(std::uint64_t ticks);
+        /// Measure the TSC frequency against the monotonic clock, done by whz_tracer::start() before it publishes
+        /// the sample rate, which orders these plain statics before any now() of a sampled request
+        static void calibrate();
+
+    private:
+        inline static bool s_use_tsc = false;
+        inline static double s_ns_per_tick = 1.0;
+        inline static std::uint64_t s_tick_anchor = 0;
+        inline static std::uint64_t s_epoch_anchor_ns = 0;
+    };
+
+    /// Points in the life of a request that a trace records
+    enum class trace_phase : std::uint8_t {
+        accepted, first_byte_read, headers_parsed, handler_start, handler_end, write_start, write_end, count
+    };
+
+    /// The timestamps of one sampled request, lives in the connection. mark() is a single branch when not sampled.
+    struct whz_request_trace {
+        bool active = false;
+        std::array<std::uint64_t, static_cast<std::size_t>(trace_phase::count)> at{};
+
+        void mark(trace_phase phase) {
+            if (active) {
+                at[static_cast<std::size_t>(phase)] = whz_trace_clock::now();
+            }
+        }
+        /// Mark only the first time, e.g. the first read of a request that arrives in several reads
+        void mark_once(trace_phase phase) {
+            if (active && at[static_cast<std::size_t>(phase)] == 0) {
+                at[static_cast<std::size_t>(phase)] = whz_trace_clock::now();
+            }
+        }
+        [[nodiscard]] std::uint64_t operator[](trace_phase phase) const { return at[static_cast<std::size_t>(phase)]; }
+    };
+
+    /// Settings of the tracer, see whz_tracer::options_from_config() for the matching config parameters
+    struct whz_tracer_options {
+        enum class file_format { chrome, otlp };
+
+        std::uint64_t sample_rate = 0;      /// Trace one in this many requests, 0 = off
+        std::filesystem::path path = "whz_trace.json";
+        file_format format = file_format::chrome;
+        std::chrono::milliseconds flush_interval{1000};
+    };
+
+    /**
+     * @brief Singleton that samples requests for tracing and writes the finished traces. The sampling decision is a
+     * thread local counter, requests that aren't sampled only pay the branches in whz_request_trace::mark(). Finished
+     * traces are queued and written by a background thread, as Chrome trace events (load the file in Perfetto or
+     * chrome://tracing) or as OTLP JSON, one ExportTraceServiceRequest per line as written by the OpenTelemetry
+     * file exporter.
+     *
+     */
+    class whz_tracer {
+    public:
+        whz_tracer(const whz_tracer&) = delete;
+        whz_tracer& operator=(const whz_tracer&) = delete;
+
+        static whz_tracer& getInstance() {
+            static whz_tracer instance;
+            return instance;
+        }
+
+        /// The options from TRACE_SAMPLE_RATE, TRACE_PATH and TRACE_FORMAT of the loaded config
+        static whz_tracer_options options_from_config();
+
+        /// Open the file and start the writer thread, true if tracing runs. A sample rate of 0 leaves it off.
+        bool start(const whz_tracer_options& options);
+        /// Write the queued traces and stop the writer thread
+        void stop();
+
+        /// Start a trace for a new request if it's sampled, stamping the accepted phase
+        void begin(whz_request_trace& trace) {
+            const std::uint64_t rate = _sample_rate.load(std::memory_order_acquire);
+            if (rate != 0 && ++_thread_requests % rate == 0) {
+                trace = whz_request_trace{};
+                trace.active = true;
+                trace.mark(trace_phase::accepted);
+            }
+        }
+        /// Queue a finished trace for writing, does nothing if it wasn't sampled
+        void finish(whz_request_trace& trace, std::string_view method, std::string_view path, std::uint16_t status);
+
+    private:
+        struct finished_trace {
+            whz_request_trace trace;
+            std::string method;
+            std::string path;
+            std::uint16_t status = 0;
+            std::uint64_t thread_id = 0;
+        };
+
+        whz_tracer() = default;
+        ~whz_tracer();
+
+        void run(std::stop_token stop_token);
+        void write_pending();
+        void append_chrome(std::string& out, const finished_trace& finished);
+        void append_otlp(std::string& out, const finished_trace& finished) const;
+
+        whz_tracer_options _options;
+        std::atomic<std::uint64_t> _sample_rate{0};   /// Published after calibrate(), read with acquire in begin()
+        std::mutex _mutex;                      /// Guards _pending
+        std::vector<finished_trace> _pending;
+        std::condition_variable_any _wake;
+        int _fd = -1;
+        bool _first_event = true;               /// Chrome format: no comma before the first event of the file
+        std::jthread _writer;
+        whz::whz_qlogger _qlogger{"tracer"};
+
+        inline static thread_local std::uint64_t _thread_requests = 0;
+    };
+
+} // whz
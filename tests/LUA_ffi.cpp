@@ -0,0 +1,79 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <string>
+#include <string_view>
+#include "whz_LUA_ffi.hpp"
+
+namespace {
+  // Owns a whz_buf like the Lua wrapper does
+  struct buffer {
+    whz_buf* buf = whz_buf_new(4); // Small, so the escapers have to grow it
+    ~buffer() { whz_buf_free(buf); }
+    [[nodiscard]] std::string_view view() const { return {buf->data, buf->size}; }
+  };
+
+  std::string JsonString(std::string_view text) {
+    buffer b;
+    REQUIRE(whz_buf_append_json_string(b.buf, text.data(), text.size()) == 0);
+    return std::string(b.view());
+  }
+}
+
+TEST_CASE("JSON strings are quoted and escaped", "[ffi]") {
+  REQUIRE(JsonString("") == R"("")");
+  REQUIRE(JsonString("plain text") == R"("plain text")");
+  REQUIRE(JsonString(R"(say "hi" \o/)") == R"("say \"hi\" \\o/")");
+  REQUIRE(JsonString("a\nb\rc\td\be\ff") == R"("a\nb\rc\td\be\ff")");
+  REQUIRE(JsonString(std::string_view("\x01\x1f\0", 3)) == R"("\u0001\u001f\u0000")");
+  REQUIRE(JsonString("\x7f") == "\"\x7f\"");
+  REQUIRE(JsonString("caf\xc3\xa9 \xe2\x82\xac") == "\"caf\xc3\xa9 \xe2\x82\xac\""); // UTF-8 passes through
+}
+
+TEST_CASE("JSON strings append to what the buffer holds", "[ffi]") {
+  buffer b;
+  REQUIRE(whz_buf_append(b.buf, "[", 1) == 0);
+  REQUIRE(whz_buf_append_json_string(b.buf, "x\"", 2) == 0);
+  REQUIRE(whz_buf_append(b.buf, ",", 1) == 0);
+  REQUIRE(whz_buf_append_json_string(b.buf, "y", 1) == 0);
+  REQUIRE(whz_buf_append(b.buf, "]", 1) == 0);
+  REQUIRE(b.view() == R"(["x\"","y"])");
+
+  whz_buf_reset(b.buf);
+  REQUIRE(b.view().empty());
+}
+
+TEST_CASE("URL decoding handles escapes and '+'", "[ffi]") {
+  buffer b;
+  const std::string_view text = "a+b%20c%2Fd%c3%A9";
+  REQUIRE(whz_buf_append_url_decoded(b.buf, text.data(), text.size()) == 0);
+  REQUIRE(b.view() == "a b c/d\xc3\xa9");
+}
+
+TEST_CASE("Malformed URL escapes leave the buffer unchanged", "[ffi]") {
+  buffer b;
+  REQUIRE(whz_buf_append(b.buf, "kept", 4) == 0);
+  for (const std::string_view bad : {"%", "%4", "abc%", "%zz", "%4g", "ok%2"}) {
+    REQUIRE(whz_buf_append_url_decoded(b.buf, bad.data(), bad.size()) == -1);
+    REQUIRE(b.view() == "kept");
+  }
+}
+
+TEST_CASE("HTML escaping replaces the five special characters", "[ffi]") {
+  buffer b;
+  const std::string_view text = R"(<a href="x?a=1&b='2'">)";
+  REQUIRE(whz_buf_append_html_escaped(b.buf, text.data(), text.size()) == 0);
+  REQUIRE(b.view() == "&lt;a href=&quot;x?a=1&amp;b=&#39;2&#39;&quot;&gt;");
+}
+
+TEST_CASE("JSON numbers use the shortest form", "[ffi]") {
+  buffer b;
+  for (const double value : {42.0, -3.0, 0.5, 1e300, std::nan(""), HUGE_VAL}) {
+    REQUIRE(whz_buf_append_json_number(b.buf, value) == 0);
+    REQUIRE(whz_buf_append(b.buf, " ", 1) == 0);
+  }
+  REQUIRE(b.view() == "42 -3 0.5 1e+300 null null ");
+}
@@ -0,0 +1,94 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <span>
+#include <string>
+#include "whz_access_log_format.hpp"
+
+using namespace whz;
+
+namespace {
+  // 12/Oct/2024:13:55:36 UTC
+  constexpr std::uint64_t RequestTimeNs = 1728741336ull * 1'000'000'000 + 123'456'789;
+
+  access_record MakeRecord() {
+    access_record record;
+    record.timestamp_ns = RequestTimeNs;
+    record.latency_ns = 1'234'567;
+    record.bytes_in = 78;
+    record.bytes_out = 2326;
+    record.peer_address = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 192, 168, 1, 10};
+    record.peer_port = 51234;
+    record.status = 200;
+    record.method = access_method_from("GET");
+    record.set_path("/index.whzt?lang=en");
+    return record;
+  }
+}
+
+TEST_CASE("A record is written as a Common Log Format line", "[access_log]") {
+  std::string line;
+  append_clf(line, MakeRecord());
+  REQUIRE(line == "192.168.1.10 - - [12/Oct/2024:13:55:36 +0000] \"GET /index.whzt?lang=en\" 200 2326 1234\n");
+}
+
+TEST_CASE("CLF lines show IPv6 peers and unknown methods", "[access_log]") {
+  access_record record = MakeRecord();
+  record.peer_address = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+  record.method = access_method_from("BREW");
+  record.status = 404;
+  record.bytes_out = 0;
+  record.latency_ns = 999;
+
+  std::string line = "previous line\n";
+  append_clf(line, record);
+  REQUIRE(line == "previous line\n::1 - - [12/Oct/2024:13:55:36 +0000] \"- /index.whzt?lang=en\" 404 0 0\n");
+}
+
+TEST_CASE("Paths are cut at max_path", "[access_log]") {
+  access_record record;
+  record.set_path(std::string(access_record::max_path + 50, 'a'));
+  REQUIRE(record.path_length == access_record::max_path);
+  REQUIRE(record.path_view() == std::string(access_record::max_path, 'a'));
+}
+
+TEST_CASE("Methods round-trip through their byte", "[access_log]") {
+  for (const std::string_view method : {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"}) {
+    REQUIRE(access_method_name(access_method_from(method)) == method);
+  }
+  REQUIRE(access_method_from("get") == access_method::other);
+  REQUIRE(access_method_name(static_cast<access_method>(200)) == "-");
+}
+
+TEST_CASE("Binary records decode to what was written", "[access_log]") {
+  std::string buffer;
+  const access_record first = MakeRecord();
+  access_record second = MakeRecord();
+  second.set_path("/");
+  access_log_binary::append(buffer, first);
+  access_log_binary::append(buffer, second);
+  REQUIRE(buffer.size() == 2 * access_log_binary::record_header + first.path_length + 1);
+
+  auto decoded = access_log_binary::decode(std::span<const char>(buffer));
+  REQUIRE(decoded.has_value());
+  REQUIRE(decoded->second == access_log_binary::record_header + first.path_length);
+  REQUIRE(decoded->first.timestamp_ns == first.timestamp_ns);
+  REQUIRE(decoded->first.peer_string() == "192.168.1.10");
+  REQUIRE(decoded->first.path_view() == "/index.whzt?lang=en");
+
+  auto next = access_log_binary::decode(std::span<const char>(buffer).subspan(decoded->second));
+  REQUIRE(next.has_value());
+  REQUIRE(next->first.path_view() == "/");
+}
+
+TEST_CASE("Incomplete binary records aren't decoded", "[access_log]") {
+  std::string buffer;
+  access_log_binary::append(buffer, MakeRecord());
+  const std::span<const char> data(buffer);
+
+  REQUIRE(!access_log_binary::decode(data.first(access_log_binary::record_header - 1)));
+  REQUIRE(!access_log_binary::decode(data.first(buffer.size() - 1)));
+  REQUIRE(access_log_binary::decode(data));
+}
@@ -0,0 +1,88 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include "whz_bench_histogram.hpp"
+
+using whz::latency_histogram;
+
+namespace {
+  // Relative error of a percentile against the exact value
+  bool Within(std::uint64_t value, std::uint64_t exact, double error) {
+    const double diff = static_cast<double>(value) - static_cast<double>(exact);
+    return (diff < 0 ? -diff : diff) <= error * static_cast<double>(exact);
+  }
+}
+
+TEST_CASE("An empty latency histogram reports zero", "[bench]") {
+  const latency_histogram histogram;
+  REQUIRE(histogram.total() == 0);
+  REQUIRE(histogram.percentile(50) == 0);
+  REQUIRE(histogram.mean() == 0.0);
+}
+
+TEST_CASE("Small latencies are recorded exactly", "[bench]") {
+  latency_histogram histogram;
+  for (std::uint64_t ns = 0; ns < latency_histogram::linear; ++ns) {
+    histogram.record(ns);
+  }
+  REQUIRE(histogram.total() == latency_histogram::linear);
+  REQUIRE(histogram.percentile(0) == 0);
+  REQUIRE(histogram.percentile(50) == 63);
+  REQUIRE(histogram.percentile(100) == latency_histogram::linear - 1);
+  REQUIRE(histogram.max() == latency_histogram::linear - 1);
+  REQUIRE(histogram.mean() == 63.5);
+}
+
+TEST_CASE("Percentiles stay within 1.6% at every magnitude", "[bench]") {
+  for (const std::uint64_t scale : {std::uint64_t{1'000}, std::uint64_t{1'000'000}, std::uint64_t{1'000'000'000}}) {
+    latency_histogram histogram;
+    for (std::uint64_t i = 1; i <= 10'000; ++i) {
+      histogram.record(i * scale / 10);
+    }
+    REQUIRE(Within(histogram.percentile(50), 5'000 * scale / 10, 0.016));
+    REQUIRE(Within(histogram.percentile(90), 9'000 * scale / 10, 0.016));
+    REQUIRE(Within(histogram.percentile(99.9), 9'990 * scale / 10, 0.016));
+    REQUIRE(histogram.percentile(100) == histogram.max());
+    REQUIRE(histogram.max() == 10'000 * scale / 10);
+  }
+}
+
+TEST_CASE("A percentile never exceeds the largest value", "[bench]") {
+  latency_histogram histogram;
+  histogram.record(1'000'003);
+  REQUIRE(histogram.percentile(50) == 1'000'003);
+  REQUIRE(histogram.percentile(99.99) == 1'000'003);
+}
+
+TEST_CASE("Values above the range are reported at its end", "[bench]") {
+  latency_histogram histogram;
+  const std::uint64_t huge = std::uint64_t{1} << 50;
+  histogram.record(huge);
+  histogram.record(10);
+  REQUIRE(histogram.total() == 2);
+  REQUIRE(histogram.max() == huge);
+  REQUIRE(histogram.percentile(50) == 10);
+  REQUIRE(histogram.percentile(100) == (std::uint64_t{1} << latency_histogram::max_bits) - 1);
+}
+
+TEST_CASE("Merged histograms match one that recorded everything", "[bench]") {
+  latency_histogram first;
+  latency_histogram second;
+  latency_histogram all;
+  for (std::uint64_t i = 0; i < 5'000; ++i) {
+    first.record(i * 997);
+    second.record(i * 1'009 + 50);
+    all.record(i * 997);
+    all.record(i * 1'009 + 50);
+  }
+  first.merge(second);
+  REQUIRE(first.total() == all.total());
+  REQUIRE(first.max() == all.max());
+  REQUIRE(first.mean() == all.mean());
+  for (const double percent : {1.0, 25.0, 50.0, 75.0, 99.0, 99.9}) {
+    REQUIRE(first.percentile(percent) == all.percentile(percent));
+  }
+}
@@ -0,0 +1,201 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "whz_config.hpp"
+
+using whz::Config;
+
+namespace {
+  // A config file in the temp folder, removed at the end of the test
+  struct config_file {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "whz_config_test.json";
+
+    explicit config_file(const std::string& content) { write(content); }
+    ~config_file() { std::filesystem::remove(path); }
+
+    void write(const std::string& content) const {
+      std::ofstream out(path, std::ios::trunc);
+      out << content;
+    }
+  };
+
+  // Counts the reloads while it's in scope, a reload listener can't be removed again
+  struct reload_spy {
+    struct state {
+      bool active = true;
+      int calls = 0;
+      std::uint64_t previous_timeout = 0;
+      std::uint64_t current_timeout = 0;
+    };
+    std::shared_ptr<state> seen = std::make_shared<state>();
+
+    reload_spy() {
+      Config::get_instance().on_reload([seen = seen](const whz::config_snapshot& previous,
+                                                     const whz::config_snapshot& current) {
+        if (seen->active) {
+          seen->previous_timeout = previous.connection_timeout_ms;
+          seen->current_timeout = current.connection_timeout_ms;
+          ++seen->calls;
+        }
+      });
+    }
+    ~reload_spy() { seen->active = false; }
+  };
+}
+
+TEST_CASE("Parameters are read with their type", "[config]") {
+  const config_file file(R"({
+    "DATABASE_READ_CONNECTIONS": 3,
+    "TEMPLATE_WATCH": false,
+    "METRICS_PATH": "/stats",
+    "UNKNOWN": "ignored"
+  })");
+  auto& config = Config::get_instance();
+  REQUIRE(config.read_config(file.path.string()));
+  REQUIRE(config.is_config_loaded());
+
+  REQUIRE(Config::get<Config::ConfigParameter::DATABASE_READ_CONNECTIONS>() == 3);
+  REQUIRE(Config::get<Config::ConfigParameter::TEMPLATE_WATCH>() == false);
+  REQUIRE(Config::get<Config::ConfigParameter::METRICS_PATH>() == "/stats");
+  REQUIRE(std::any_cast<std::string>(config.get_config_value(Config::ConfigParameter::METRICS_PATH)) == "/stats");
+}
+
+TEST_CASE("Missing, empty and mistyped parameters get their default", "[config]") {
+  const config_file file(R"({
+    "DATABASE_READ_CONNECTIONS": "",
+    "TEMPLATE_WATCH": "yes",
+    "CONNECTION_TIMEOUT_MS": -5
+  })");
+  REQUIRE(Config::get_instance().read_config(file.path.string()));
+
+  const whz::config_snapshot defaults;
+  REQUIRE(Config::get<Config::ConfigParameter::DATABASE_READ_CONNECTIONS>() == defaults.database_read_connections);
+  REQUIRE(Config::get<Config::ConfigParameter::TEMPLATE_WATCH>() == defaults.template_watch);
+  REQUIRE(Config::get<Config::ConfigParameter::CONNECTION_TIMEOUT_MS>() == defaults.connection_timeout_ms);
+  REQUIRE(Config::get<Config::ConfigParameter::METRICS_PATH>() == defaults.metrics_path);
+}
+
+TEST_CASE("Invalid values are set back to their default", "[config]") {
+  const config_file file(R"({
+    "ACCESS_LOG_FORMAT": "json",
+    "TRACE_FORMAT": "otlp",
+    "METRICS_PATH": "metrics"
+  })");
+  REQUIRE(Config::get_instance().read_config(file.path.string()));
+
+  REQUIRE(Config::get<Config::ConfigParameter::ACCESS_LOG_FORMAT>() == "binary");
+  REQUIRE(Config::get<Config::ConfigParameter::TRACE_FORMAT>() == "otlp");
+  REQUIRE(Config::get<Config::ConfigParameter::METRICS_PATH>() == "/metrics");
+}
+
+TEST_CASE("A file that isn't a JSON object keeps the current config", "[config]") {
+  const config_file good(R"({"METRICS_PATH": "/kept"})");
+  auto& config = Config::get_instance();
+  REQUIRE(config.read_config(good.path.string()));
+
+  good.write("[1, 2, 3]");
+  REQUIRE(!config.read_config(good.path.string()));
+  good.write("{ not json");
+  REQUIRE(!config.read_config(good.path.string()));
+  REQUIRE(!config.read_config((std::filesystem::temp_directory_path() / "whz_no_such_config.json").string()));
+  REQUIRE(Config::get<Config::ConfigParameter::METRICS_PATH>() == "/kept");
+}
+
+TEST_CASE("A written config reads back the same", "[config]") {
+  const config_file file(R"({
+    "ACCESS_LOG_PATH": "logs/access \"main\".log",
+    "OUTPUT_CACHE_MAX_MB": 128,
+    "TEMPLATE_MEMORY_MAP": true
+  })");
+  auto& config = Config::get_instance();
+  REQUIRE(config.read_config(file.path.string()));
+
+  const auto written = std::filesystem::temp_directory_path() / "whz_config_written.json";
+  REQUIRE(config.createJSON_config(written.string()));
+  const whz::config_snapshot before = config.snapshot();
+  REQUIRE(config.read_config(written.string()));
+  std::filesystem::remove(written);
+
+  REQUIRE(Config::get<Config::ConfigParameter::ACCESS_LOG_PATH>() == before.access_log_path);
+  REQUIRE(Config::get<Config::ConfigParameter::ACCESS_LOG_PATH>() == "logs/access \"main\".log");
+  REQUIRE(Config::get<Config::ConfigParameter::OUTPUT_CACHE_MAX_MB>() == 128);
+  REQUIRE(Config::get<Config::ConfigParameter::TEMPLATE_MEMORY_MAP>());
+}
+
+TEST_CASE("Reload sorts the changes into applied and restart required", "[config]") {
+  const config_file file(R"({"CONNECTION_TIMEOUT_MS": 100, "DATABASE_PATH": "a.db", "METRICS_PATH": "/metrics"})");
+  auto& config = Config::get_instance();
+  REQUIRE(config.read_config(file.path.string()));
+  const reload_spy spy;
+
+  file.write(R"({"CONNECTION_TIMEOUT_MS": 200, "DATABASE_PATH": "b.db", "METRICS_PATH": "/metrics"})");
+  auto report = config.reload();
+  REQUIRE(report.loaded);
+  REQUIRE(report.problems.empty());
+  REQUIRE(report.applied == std::vector<std::string_view>{"CONNECTION_TIMEOUT_MS"});
+  REQUIRE(report.restart_required == std::vector<std::string_view>{"DATABASE_PATH"});
+  REQUIRE(spy.seen->calls == 1);
+  REQUIRE(spy.seen->previous_timeout == 100);
+  REQUIRE(spy.seen->current_timeout == 200);
+  REQUIRE(Config::get<Config::ConfigParameter::CONNECTION_TIMEOUT_MS>() == 200);
+
+  report = config.reload(); // Same file again
+  REQUIRE(report.loaded);
+  REQUIRE(report.applied.empty());
+  REQUIRE(report.restart_required.empty());
+  REQUIRE(spy.seen->calls == 2);
+}
+
+TEST_CASE("Reload rejects a file with a wrong value as a whole", "[config]") {
+  const config_file file(R"({"CONNECTION_TIMEOUT_MS": 300, "TRACE_FORMAT": "chrome"})");
+  auto& config = Config::get_instance();
+  REQUIRE(config.read_config(file.path.string()));
+  const reload_spy spy;
+
+  file.write(R"({"CONNECTION_TIMEOUT_MS": 400, "TRACE_FORMAT": "xml"})");
+  auto report = config.reload();
+  REQUIRE(!report.loaded);
+  REQUIRE(!report.problems.empty());
+  file.write(R"({"CONNECTION_TIMEOUT_MS": "400"})");
+  REQUIRE(!config.reload().loaded);
+  file.write("{ not json");
+  REQUIRE(!config.reload().loaded);
+
+  REQUIRE(spy.seen->calls == 0);
+  REQUIRE(Config::get<Config::ConfigParameter::CONNECTION_TIMEOUT_MS>() == 300);
+  REQUIRE(Config::get<Config::ConfigParameter::TRACE_FORMAT>() == "chrome");
+}
+
+TEST_CASE("A reload listener may register another listener", "[config]") {
+  const config_file file(R"({"CONNECTION_TIMEOUT_MS": 500})");
+  auto& config = Config::get_instance();
+  REQUIRE(config.read_config(file.path.string()));
+
+  // Would deadlock if the listeners were called under the reload lock
+  const reload_spy nested;
+  auto registered = std::make_shared<bool>(false);
+  config.on_reload([registered, nested = nested.seen](const whz::config_snapshot&, const whz::config_snapshot&) {
+    if (!*registered) {
+      *registered = true;
+      Config::get_instance().on_reload([nested](const whz::config_snapshot&, const whz::config_snapshot&) {
+        if (nested->active) {
+          ++nested->calls;
+        }
+      });
+    }
+  });
+
+  REQUIRE(config.reload().loaded);
+  REQUIRE(*registered);
+  const int before = nested.seen->calls; // The spy itself counts every reload
+  REQUIRE(config.reload().loaded);
+  REQUIRE(nested.seen->calls == before + 2); // The spy and the listener registered during the first reload
+}
@@ -0,0 +1,66 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "whz_flat_map.hpp"
+
+using whz::whz_flat_map;
+
+TEST_CASE("An empty flat map finds nothing", "[flat_map]") {
+  const whz_flat_map<int> empty;
+  REQUIRE(empty.empty());
+  REQUIRE(empty.find("") == nullptr);
+  REQUIRE(empty.find("index.whzt") == nullptr);
+
+  const whz_flat_map<int> built(std::vector<std::pair<std::string, int>>{});
+  REQUIRE(built.size() == 0);
+  REQUIRE(!built.contains("index.whzt"));
+}
+
+TEST_CASE("A flat map finds every key it was built from", "[flat_map]") {
+  std::vector<std::pair<std::string, int>> entries;
+  for (int i = 0; i < 1000; ++i) {
+    entries.emplace_back("templates/page" + std::to_string(i) + ".whzt", i);
+  }
+  const whz_flat_map<int> map(entries);
+
+  REQUIRE(map.size() == 1000);
+  for (const auto& [key, value] : entries) {
+    const int* found = map.find(key);
+    REQUIRE(found != nullptr);
+    REQUIRE(*found == value);
+  }
+  REQUIRE(map.find("templates/page1000.whzt") == nullptr);
+  REQUIRE(map.find("templates/page1.whz") == nullptr);
+  REQUIRE(map.find("") == nullptr);
+}
+
+TEST_CASE("The last of duplicate keys wins", "[flat_map]") {
+  const whz_flat_map<std::string> map({{"a", "first"}, {"b", "other"}, {"a", "second"}});
+  REQUIRE(map.size() == 2);
+  REQUIRE(*map.find("a") == "second");
+  REQUIRE(*map.find("b") == "other");
+}
+
+TEST_CASE("Entries round-trip into the next version of a flat map", "[flat_map]") {
+  const whz_flat_map<int> first({{"x", 1}, {"y", 2}, {"z", 3}});
+
+  auto entries = first.entries();
+  std::ranges::sort(entries);
+  REQUIRE(entries == std::vector<std::pair<std::string, int>>{{"x", 1}, {"y", 2}, {"z", 3}});
+
+  entries.emplace_back("y", 20);
+  const whz_flat_map<int> next(std::move(entries));
+  REQUIRE(next.size() == 3);
+  REQUIRE(*next.find("y") == 20);
+  REQUIRE(*first.find("y") == 2);
+
+  int visited = 0;
+  next.for_each([&visited](std::string_view, const int&) { ++visited; });
+  REQUIRE(visited == 3);
+}
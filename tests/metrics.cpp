@@ -0,0 +1,109 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "whz_metrics.hpp"
+
+using whz::whz_histogram;
+using whz::whz_metrics;
+
+TEST_CASE("Histogram buckets cover the range without gaps", "[metrics]") {
+  REQUIRE(whz_histogram::bucket_of(0) == 0);
+  REQUIRE(whz_histogram::bucket_of(1023) == 0);
+  REQUIRE(whz_histogram::bucket_of(1024) == 1);
+  REQUIRE(whz_histogram::bucket_of(1535) == 1);
+  REQUIRE(whz_histogram::bucket_of(1536) == 2);
+  REQUIRE(whz_histogram::bucket_of(2048) == 3);
+  REQUIRE(whz_histogram::bucket_of(~std::uint64_t{0}) == whz_histogram::buckets - 1);
+
+  // Every finite bucket starts where the previous one ends
+  for (std::size_t b = 1; b + 1 < whz_histogram::buckets; ++b) {
+    const std::uint64_t lower = whz_histogram::upper_bound_ns(b - 1);
+    const std::uint64_t upper = whz_histogram::upper_bound_ns(b);
+    REQUIRE(lower < upper);
+    REQUIRE(whz_histogram::bucket_of(lower) == b);
+    REQUIRE(whz_histogram::bucket_of(upper - 1) == b);
+  }
+}
+
+TEST_CASE("Histogram buckets are at most a third of their upper bound wide", "[metrics]") {
+  for (std::size_t b = 2; b + 1 < whz_histogram::buckets; ++b) {
+    const std::uint64_t lower = whz_histogram::upper_bound_ns(b - 1);
+    const std::uint64_t upper = whz_histogram::upper_bound_ns(b);
+    REQUIRE((upper - lower) * 3 <= upper);
+  }
+}
+
+TEST_CASE("The last bucket is +Inf", "[metrics]") {
+  REQUIRE(whz_histogram::upper_bound_ns(whz_histogram::buckets - 1) == 0);
+  const std::uint64_t last_finite = whz_histogram::upper_bound_ns(whz_histogram::buckets - 2);
+  REQUIRE(whz_histogram::bucket_of(last_finite) == whz_histogram::buckets - 1);
+}
+
+TEST_CASE("Scrape sums the shards of all threads", "[metrics]") {
+  auto& registry = whz_metrics::getInstance();
+  const auto requests = registry.counter("test_requests_total", "Requests", R"(code="200")");
+  const auto open = registry.gauge("test_open", "Open things");
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        requests.inc();
+      }
+      open.inc(2);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  open.dec(); // On another thread than the increments
+
+  const std::string out = registry.scrape();
+  REQUIRE(out.contains("# HELP test_requests_total Requests\n# TYPE test_requests_total counter\n"));
+  REQUIRE(out.contains("test_requests_total{code=\"200\"} 4000\n"));
+  REQUIRE(out.contains("test_open 7\n"));
+}
+
+TEST_CASE("Scrape writes cumulative histogram buckets", "[metrics]") {
+  auto& registry = whz_metrics::getInstance();
+  const auto latency = registry.histogram("test_latency_seconds", "Latency");
+  latency.observe_ns(500);          // Bucket 0
+  latency.observe_ns(1500);         // Bucket 1
+  latency.observe_ns(1'000'000'000'000); // +Inf
+
+  const std::string out = registry.scrape();
+  REQUIRE(out.contains("# TYPE test_latency_seconds histogram\n"));
+  REQUIRE(out.contains("test_latency_seconds_bucket{le=\"1.024e-06\"} 1\n"));
+  REQUIRE(out.contains("test_latency_seconds_bucket{le=\"1.536e-06\"} 2\n"));
+  REQUIRE(out.contains("test_latency_seconds_bucket{le=\"+Inf\"} 3\n"));
+  REQUIRE(out.contains("test_latency_seconds_count 3\n"));
+  REQUIRE(out.contains("test_latency_seconds_sum 1000.000002\n"));
+}
+
+TEST_CASE("Registering a series twice returns the same one", "[metrics]") {
+  auto& registry = whz_metrics::getInstance();
+  registry.counter("test_twice_total", "Twice").inc();
+  registry.counter("test_twice_total", "Twice").inc();
+  registry.gauge_callback("test_callback", "Callback", {}, [] { return 1.5; });
+  registry.gauge_callback("test_callback", "Callback", {}, [] { return 2.5; });
+
+  const std::string out = registry.scrape();
+  REQUIRE(out.contains("test_twice_total 2\n"));
+  REQUIRE(out.contains("test_callback 1.5\n"));
+  REQUIRE(!out.contains("test_callback 2.5\n"));
+}
+
+TEST_CASE("Callback counters are exported as counters", "[metrics]") {
+  auto& registry = whz_metrics::getInstance();
+  auto steps = std::make_shared<std::uint64_t>(7); // The registry outlives the test
+  registry.counter_callback("test_steps_total", "Steps", R"(pool="main")", [steps] { return static_cast<double>(*steps); });
+  REQUIRE(registry.scrape().contains("# TYPE test_steps_total counter\ntest_steps_total{pool=\"main\"} 7\n"));
+  *steps = 9;
+  REQUIRE(registry.scrape().contains("test_steps_total{pool=\"main\"} 9\n"));
+}
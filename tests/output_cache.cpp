@@ -0,0 +1,138 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "whz_output_cache.hpp"
+
+using whz::whz_output_cache;
+
+namespace {
+  // The cache is a singleton, every test starts from an empty, enabled one
+  whz_output_cache& EmptyCache() {
+    auto& cache = whz_output_cache::getInstance();
+    cache.configure(std::size_t{16} * 1024 * 1024, std::chrono::seconds{60});
+    cache.clear();
+    return cache;
+  }
+
+  bool Cached(whz_output_cache& cache, std::string_view name, std::uint64_t data_hash = 0) {
+    std::string output;
+    return cache.get(whz_output_cache::make_key(name, data_hash), name, output);
+  }
+
+  void Put(whz_output_cache& cache, std::string_view name, std::string_view content,
+           const std::vector<std::string>& tags, std::uint64_t render_epoch) {
+    cache.put(whz_output_cache::make_key(name, 0), name, content, tags, render_epoch);
+  }
+}
+
+TEST_CASE("Stored output is appended on a hit", "[output_cache]") {
+  auto& cache = EmptyCache();
+  const auto key = whz_output_cache::make_key("index.whzt", 7);
+  cache.put(key, "index.whzt", "<p>hi</p>", {"template:index.whzt"}, cache.epoch());
+
+  std::string output = "<html>";
+  std::vector<std::string> tags;
+  REQUIRE(cache.get(key, "index.whzt", output, &tags));
+  REQUIRE(output == "<html><p>hi</p>");
+  REQUIRE(tags == std::vector<std::string>{"template:index.whzt"});
+
+  REQUIRE(!cache.get(key, "other.whzt", output)); // Same key, other template
+  REQUIRE(!Cached(cache, "index.whzt", 8));        // Other data
+}
+
+TEST_CASE("Data hashes don't depend on the order of the fields", "[output_cache]") {
+  const std::vector<std::pair<std::string, std::string>> one{{"a", "1"}, {"b", "2"}};
+  const std::vector<std::pair<std::string, std::string>> other{{"b", "2"}, {"a", "1"}};
+  const std::vector<std::pair<std::string, std::string>> swapped{{"a", "2"}, {"b", "1"}};
+  REQUIRE(whz_output_cache::hash_data(one) == whz_output_cache::hash_data(other));
+  REQUIRE(whz_output_cache::hash_data(one) != whz_output_cache::hash_data(swapped));
+}
+
+TEST_CASE("Invalidating a tag drops only the entries carrying it", "[output_cache]") {
+  auto& cache = EmptyCache();
+  Put(cache, "products.whzt", "P", {"table:products", "template:products.whzt"}, cache.epoch());
+  Put(cache, "users.whzt", "U", {"table:users"}, cache.epoch());
+  Put(cache, "untagged.whzt", "X", {}, cache.epoch());
+
+  cache.invalidate_tag("table:products");
+  REQUIRE(!Cached(cache, "products.whzt"));
+  REQUIRE(Cached(cache, "users.whzt"));
+  REQUIRE(Cached(cache, "untagged.whzt"));
+
+  cache.invalidate_tag("template:products.whzt"); // Its other tag, nothing left to drop
+  cache.invalidate_tag("table:users");
+  REQUIRE(!Cached(cache, "users.whzt"));
+  REQUIRE(Cached(cache, "untagged.whzt"));
+}
+
+TEST_CASE("Output rendered before an invalidation of its data isn't stored", "[output_cache]") {
+  auto& cache = EmptyCache();
+  const auto render_epoch = cache.epoch();
+  cache.invalidate_tag("table:orders"); // The data changed while rendering
+  REQUIRE(cache.epoch() > render_epoch);
+
+  Put(cache, "orders.whzt", "stale", {"table:orders"}, render_epoch);
+  REQUIRE(!Cached(cache, "orders.whzt"));
+  Put(cache, "other.whzt", "fresh", {"table:other"}, render_epoch); // Other tags aren't affected
+  REQUIRE(Cached(cache, "other.whzt"));
+  Put(cache, "orders.whzt", "fresh", {"table:orders"}, cache.epoch());
+  REQUIRE(Cached(cache, "orders.whzt"));
+}
+
+TEST_CASE("A replaced entry is only invalidated by the tags it has now", "[output_cache]") {
+  auto& cache = EmptyCache();
+  Put(cache, "page.whzt", "old", {"tag:old", "tag:both"}, cache.epoch());
+  Put(cache, "page.whzt", "new", {"tag:both", "tag:new"}, cache.epoch());
+
+  cache.invalidate_tag("tag:old");
+  std::string output;
+  REQUIRE(cache.get(whz_output_cache::make_key("page.whzt", 0), "page.whzt", output));
+  REQUIRE(output == "new");
+  cache.invalidate_tag("tag:both");
+  REQUIRE(!Cached(cache, "page.whzt"));
+
+  Put(cache, "page.whzt", "again", {"tag:new"}, cache.epoch());
+  cache.invalidate_tag("tag:new");
+  REQUIRE(!Cached(cache, "page.whzt"));
+}
+
+TEST_CASE("A cache with a size of 0 stores nothing", "[output_cache]") {
+  auto& cache = EmptyCache();
+  Put(cache, "kept.whzt", "K", {}, cache.epoch());
+  cache.configure(0, std::chrono::seconds{60});
+  REQUIRE(!cache.is_enabled());
+  REQUIRE(!Cached(cache, "kept.whzt"));
+  Put(cache, "kept.whzt", "K", {}, cache.epoch());
+  REQUIRE(!Cached(cache, "kept.whzt"));
+  EmptyCache();
+}
+
+TEST_CASE("Puts and invalidations on several threads leave no stale entry", "[output_cache]") {
+  auto& cache = EmptyCache();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t] {
+      for (int i = 0; i < 2000; ++i) {
+        const std::string name = "page" + std::to_string((i + t) % 50) + ".whzt";
+        if (i % 10 == t) {
+          cache.invalidate_tag("table:shared");
+        } else {
+          Put(cache, name, name, {"table:shared", "template:" + name}, cache.epoch());
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  cache.invalidate_tag("table:shared");
+  for (int i = 0; i < 50; ++i) {
+    REQUIRE(!Cached(cache, "page" + std::to_string(i) + ".whzt"));
+  }
+}
@@ -0,0 +1,140 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "whz_socket_handoff.hpp"
+
+using namespace whz;
+
+namespace {
+  // Both ends of a connected Unix socket, closed at the end of the test
+  struct unix_pair {
+    std::array<int, 2> fds{-1, -1};
+    unix_pair() { REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()) == 0); }
+    ~unix_pair() {
+      for (int fd : fds) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+    }
+  };
+
+  // A TCP socket listening on a free port of the loopback interface
+  int ListenOnLoopback() {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+    REQUIRE(::listen(fd, 8) == 0);
+    return fd;
+  }
+
+  int PortOf(int fd) {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    REQUIRE(::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == 0);
+    return ntohs(address.sin_port);
+  }
+}
+
+TEST_CASE("Listening sockets arrive at the other end of the Unix socket", "[handoff]") {
+  unix_pair channel;
+  const std::array<int, 2> listeners{ListenOnLoopback(), ListenOnLoopback()};
+
+  REQUIRE(socket_handoff::send_sockets(channel.fds[0], listeners));
+  auto received = socket_handoff::receive_sockets(channel.fds[1]);
+  REQUIRE(received.has_value());
+  REQUIRE(received->size() == 2);
+
+  for (std::size_t i = 0; i < listeners.size(); ++i) {
+    const int fd = (*received)[i];
+    REQUIRE(fd != listeners[i]); // A new descriptor for the same socket
+    REQUIRE(PortOf(fd) == PortOf(listeners[i]));
+    int accepting = 0;
+    socklen_t length = sizeof(accepting);
+    REQUIRE(::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &length) == 0);
+    REQUIRE(accepting == 1);
+    REQUIRE((::fcntl(fd, F_GETFD) & FD_CLOEXEC) != 0);
+    ::close(fd);
+    ::close(listeners[i]);
+  }
+}
+
+TEST_CASE("Sending no or too many sockets fails", "[handoff]") {
+  unix_pair channel;
+  REQUIRE(!socket_handoff::send_sockets(channel.fds[0], {}));
+  const std::vector<int> too_many(socket_handoff::max_sockets + 1, channel.fds[0]);
+  REQUIRE(!socket_handoff::send_sockets(channel.fds[0], too_many));
+}
+
+TEST_CASE("A peer that isn't a whz server is rejected", "[handoff]") {
+  unix_pair channel;
+  REQUIRE(::write(channel.fds[0], "HTTP", 4) == 4); // No descriptors
+  auto received = socket_handoff::receive_sockets(channel.fds[1]);
+  REQUIRE(!received.has_value());
+
+  ::close(channel.fds[0]);
+  channel.fds[0] = -1;
+  REQUIRE(!socket_handoff::receive_sockets(channel.fds[1]).has_value()); // Closed without sending
+}
+
+TEST_CASE("The receiver connects, takes the sockets and confirms", "[handoff]") {
+  const auto socket_path = std::filesystem::temp_directory_path() / ("whz_handoff_test_" + std::to_string(::getpid()));
+  std::filesystem::remove(socket_path);
+
+  const int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  REQUIRE(::bind(server, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+  REQUIRE(::listen(server, 1) == 0);
+
+  const int listener = ListenOnLoopback();
+  char confirmed = 0;
+  std::thread old_process([&] {
+    const int peer = ::accept(server, nullptr, nullptr);
+    if (peer >= 0) {
+      const int sockets[] = {listener};
+      if (socket_handoff::send_sockets(peer, sockets) && ::read(peer, &confirmed, 1) != 1) {
+        confirmed = 0;
+      }
+      ::close(peer);
+    }
+  });
+
+  auto receiver = whz_handoff_receiver::connect(socket_path);
+  REQUIRE(receiver.has_value());
+  const std::vector<int> sockets = receiver->take_sockets();
+  REQUIRE(sockets.size() == 1);
+  REQUIRE(PortOf(sockets[0]) == PortOf(listener));
+  REQUIRE(receiver->take_sockets().empty());
+  REQUIRE(receiver->confirm());
+  old_process.join();
+  REQUIRE(confirmed == socket_handoff::confirm_byte);
+
+  ::close(sockets[0]);
+  ::close(listener);
+  ::close(server);
+  std::filesystem::remove(socket_path);
+}
+
+TEST_CASE("Connecting without a running server fails", "[handoff]") {
+  const auto socket_path = std::filesystem::temp_directory_path() / "whz_handoff_nobody_listens";
+  std::filesystem::remove(socket_path);
+  REQUIRE(!whz_handoff_receiver::connect(socket_path, std::chrono::milliseconds(100)).has_value());
+  REQUIRE(!whz_handoff_receiver::connect("").has_value());
+}
@@ -0,0 +1,142 @@
+//
+// Created by Pat Le Cat on 19/10/2026.
+//
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <unistd.h>
+#include "whz_template_pack.hpp"
+
+using whz::whz_template_pack;
+
+namespace {
+  // A pack file in the temp folder, removed at the end of the test
+  struct pack_file {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("whz_template_pack_test_" + std::to_string(::getpid()) + ".mmf")).string();
+    ~pack_file() { std::filesystem::remove(path); }
+
+    [[nodiscard]] std::string read() const {
+      std::ifstream in(path, std::ios::binary);
+      return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    }
+    void write(const std::string& bytes) const {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out << bytes;
+    }
+  };
+
+  // Overwrite a field of the first index entry of the pack
+  template <typename T>
+  void PatchFirstEntry(const pack_file& file, std::size_t field_offset, T value) {
+    std::string bytes = file.read();
+    std::memcpy(bytes.data() + sizeof(whz_template_pack::header) + field_offset, &value, sizeof(value));
+    file.write(bytes);
+  }
+
+  void WriteSample(const pack_file& file) {
+    REQUIRE(whz_template_pack::write(file.path, {{"pages/b.whzt", "B {{name}}"},
+                                                 {"a.whzt", "A"},
+                                                 {"empty.whzt", ""},
+                                                 {"a.whzt", "second A"}}));
+  }
+}
+
+TEST_CASE("A written pack finds every template", "[template_pack]") {
+  const pack_file file;
+  WriteSample(file);
+  auto pack = whz_template_pack::open(file.path);
+  REQUIRE(pack.has_value());
+
+  const auto& p = *pack;
+  REQUIRE(p->size() == 3); // The duplicate name is written once
+  REQUIRE(p->find("pages/b.whzt") == "B {{name}}");
+  REQUIRE(p->find("empty.whzt") == "");
+  REQUIRE(p->find("a.whzt").has_value());
+  REQUIRE(!p->find("b.whzt"));
+  REQUIRE(!p->find(""));
+  for (std::size_t i = 0; i < p->size(); ++i) {
+    REQUIRE(p->find(p->name_at(i)) == p->content_at(i));
+    REQUIRE(p->content_hash_at(i) == whz_template_pack::hash(p->content_at(i)));
+  }
+}
+
+TEST_CASE("An empty pack opens and finds nothing", "[template_pack]") {
+  const pack_file file;
+  REQUIRE(whz_template_pack::write(file.path, {}));
+  auto pack = whz_template_pack::open(file.path);
+  REQUIRE(pack.has_value());
+  REQUIRE((*pack)->size() == 0);
+  REQUIRE(!(*pack)->find("a.whzt"));
+}
+
+TEST_CASE("A rewritten pack doesn't change one that is open", "[template_pack]") {
+  const pack_file file;
+  REQUIRE(whz_template_pack::write(file.path, {{"a.whzt", "old"}}));
+  auto old_pack = whz_template_pack::open(file.path);
+  REQUIRE(old_pack.has_value());
+
+  REQUIRE(whz_template_pack::write(file.path, {{"a.whzt", "new"}}));
+  REQUIRE((*old_pack)->find("a.whzt") == "old");
+  REQUIRE((*whz_template_pack::open(file.path))->find("a.whzt") == "new");
+}
+
+TEST_CASE("Missing and truncated packs aren't opened", "[template_pack]") {
+  const pack_file file;
+  REQUIRE(!whz_template_pack::open(file.path));
+
+  WriteSample(file);
+  const std::string bytes = file.read();
+  file.write(bytes.substr(0, bytes.size() - 1));
+  REQUIRE(!whz_template_pack::open(file.path));
+  file.write(bytes.substr(0, sizeof(whz_template_pack::header) - 1));
+  REQUIRE(!whz_template_pack::open(file.path));
+
+  std::string wrong_magic = bytes;
+  wrong_magic[0] = 'X';
+  file.write(wrong_magic);
+  REQUIRE(!whz_template_pack::open(file.path));
+}
+
+TEST_CASE("A corrupt index isn't opened", "[template_pack]") {
+  const pack_file file;
+  constexpr auto huge = std::numeric_limits<std::uint64_t>::max() - 2;
+
+  SECTION("Offset and length wrap around") {
+    WriteSample(file);
+    PatchFirstEntry(file, offsetof(whz_template_pack::index_entry, content_offset), huge);
+    PatchFirstEntry(file, offsetof(whz_template_pack::index_entry, content_length), std::uint64_t{16});
+    REQUIRE(!whz_template_pack::open(file.path));
+  }
+  SECTION("Content past the end of the file") {
+    WriteSample(file);
+    PatchFirstEntry(file, offsetof(whz_template_pack::index_entry, content_length), huge);
+    REQUIRE(!whz_template_pack::open(file.path));
+  }
+  SECTION("Name inside the index") {
+    WriteSample(file);
+    PatchFirstEntry(file, offsetof(whz_template_pack::index_entry, name_offset), std::uint64_t{0});
+    REQUIRE(!whz_template_pack::open(file.path));
+  }
+  SECTION("Name hash that doesn't match") {
+    WriteSample(file);
+    PatchFirstEntry(file, offsetof(whz_template_pack::index_entry, name_hash), std::uint64_t{42});
+    REQUIRE(!whz_template_pack::open(file.path));
+  }
+}
+
+TEST_CASE("A changed template content isn't opened", "[template_pack]") {
+  const pack_file file;
+  REQUIRE(whz_template_pack::write(file.path, {{"a.whzt", "content"}}));
+  std::string bytes = file.read();
+  bytes.back() = 'X';
+  file.write(bytes);
+  REQUIRE(!whz_template_pack::open(file.path));
+}